@@ -0,0 +1,65 @@
+# Archive test: FASTQ, FASTA and other input through an archive, its members
+# packed at once, listed and extracted one at a time and all at once; and
+# lists that make no archive.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   PASS     – path to the key/passphrase file
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+write_sized_fastq("${WORKDIR}/a.fq" 1048576)
+write_fasta("${WORKDIR}/b.fa" 20 5000)
+string(REPEAT "chr1\t12345\t.\tA\tG\t50\tPASS\tDP=14\n" 1000 vcf)
+file(WRITE "${WORKDIR}/c.vcf" "##fileformat=VCFv4.2\n${vcf}")
+set(inputs a.fq b.fa c.vcf)
+
+# Archive, its members named "member_" and the file name
+set(archive_list "")
+foreach(in ${inputs})
+    string(APPEND archive_list "${in}\tmember_${in}\n")
+endforeach()
+file(WRITE "${WORKDIR}/archive.txt" "${archive_list}")
+run_cryfa("${WORKDIR}/archive" -k "${PASS}" -t 4 --archive -o "${WORKDIR}/archive.crf"
+          "${WORKDIR}/archive.txt")
+
+run_cryfa("${WORKDIR}/list" -k "${PASS}" -d --list "${WORKDIR}/archive.crf")
+file(STRINGS "${WORKDIR}/list.out" listed)
+list(LENGTH listed n)
+if(NOT n EQUAL 3)
+    message(FATAL_ERROR "--list gave ${n} members, not 3:\n${listed}")
+endif()
+foreach(in ${inputs})
+    if(NOT listed MATCHES "member_${in}\t[0-9]+")
+        message(FATAL_ERROR "--list misses \"member_${in}\":\n${listed}")
+    endif()
+endforeach()
+message(STATUS "archive_list: passed")
+
+run_cryfa("${WORKDIR}/extract_one" -k "${PASS}" -d --extract member_b.fa
+          -o "${WORKDIR}/one.fa" "${WORKDIR}/archive.crf")
+expect_same("${WORKDIR}/b.fa" "${WORKDIR}/one.fa" "extract member_b.fa")
+expect_cryfa_error("${WORKDIR}/extract_missing" "no member \"member_d\"" -k "${PASS}" -d
+                   --extract member_d -o "${WORKDIR}/none" "${WORKDIR}/archive.crf")
+message(STATUS "archive_extract: passed")
+
+run_cryfa("${WORKDIR}/extract_all" -k "${PASS}" -d -t 4 "${WORKDIR}/archive.crf")
+foreach(in ${inputs})
+    expect_same("${WORKDIR}/${in}" "${WORKDIR}/member_${in}" "extract member_${in}")
+endforeach()
+message(STATUS "archive_extract_all: passed")
+
+# Lists that make no archive: a name twice, a name out of the directory and
+# a file missing among others
+file(WRITE "${WORKDIR}/twice.txt" "a.fq\tsame\nb.fa\tsame\n")
+expect_cryfa_error("${WORKDIR}/archive_twice" "\"same\" is listed more than once" -k "${PASS}"
+                   --archive -o "${WORKDIR}/twice.crf" "${WORKDIR}/twice.txt")
+file(WRITE "${WORKDIR}/outside.txt" "a.fq\t../a.fq\n")
+expect_cryfa_error("${WORKDIR}/archive_outside" "is not a valid archive member name" -k "${PASS}"
+                   --archive -o "${WORKDIR}/outside.crf" "${WORKDIR}/outside.txt")
+file(WRITE "${WORKDIR}/missing.txt" "a.fq\tone\nnone.fq\ttwo\nb.fa\tthree\n")
+expect_cryfa_error("${WORKDIR}/archive_missing" "\"none.fq\" cannot be opened" -k "${PASS}" -t 4
+                   --archive -o "${WORKDIR}/missing.crf" "${WORKDIR}/missing.txt")
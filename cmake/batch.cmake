@@ -0,0 +1,62 @@
+# Batch test: FASTQ, FASTA and other input through --batch, several files
+# at once, with output files given and named by default, and a file missing.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   PASS     – path to the key/passphrase file
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}/default")
+
+write_sized_fastq("${WORKDIR}/a.fq" 1048576)
+write_fasta("${WORKDIR}/b.fa" 20 5000)
+string(REPEAT "chr1\t12345\t.\tA\tG\t50\tPASS\tDP=14\n" 1000 vcf)
+file(WRITE "${WORKDIR}/c.vcf" "##fileformat=VCFv4.2\n${vcf}")
+write_sized_fastq("${WORKDIR}/d.fq" 65536)
+set(inputs a.fq b.fa c.vcf d.fq)
+
+# --batch, with output files given, then by default: ".cryfa" appended and
+# removed
+set(enc_list "")
+set(dec_list "")
+foreach(in ${inputs})
+    string(APPEND enc_list "${in}\t${in}.crf\n")
+    string(APPEND dec_list "${in}.crf\t${in}.out\n")
+endforeach()
+file(WRITE "${WORKDIR}/enc.txt" "# Input\tOutput\n${enc_list}")
+file(WRITE "${WORKDIR}/dec.txt" "${dec_list}")
+run_cryfa("${WORKDIR}/batch.enc" -k "${PASS}" -t 4 --batch "${WORKDIR}/enc.txt")
+run_cryfa("${WORKDIR}/batch.dec" -k "${PASS}" -d -t 4 --batch "${WORKDIR}/dec.txt")
+foreach(in ${inputs})
+    expect_same("${WORKDIR}/${in}" "${WORKDIR}/${in}.out" "batch ${in}")
+endforeach()
+message(STATUS "batch: passed")
+
+# The budget split between the files in flight
+foreach(in ${inputs})
+    file(REMOVE "${WORKDIR}/${in}.out")
+endforeach()
+run_cryfa("${WORKDIR}/budget.enc" -k "${PASS}" -t 4 --max-memory 32M
+          --batch "${WORKDIR}/enc.txt")
+run_cryfa("${WORKDIR}/budget.dec" -k "${PASS}" -d -t 4 --max-memory 32M
+          --batch "${WORKDIR}/dec.txt")
+foreach(in ${inputs})
+    expect_same("${WORKDIR}/${in}" "${WORKDIR}/${in}.out" "batch ${in} in a budget")
+endforeach()
+message(STATUS "batch_budget: passed")
+
+file(COPY_FILE "${WORKDIR}/c.vcf" "${WORKDIR}/default/c.vcf")
+file(WRITE "${WORKDIR}/default.txt" "default/c.vcf\n")
+run_cryfa("${WORKDIR}/default.enc" -k "${PASS}" --batch "${WORKDIR}/default.txt")
+file(REMOVE "${WORKDIR}/default/c.vcf")
+file(WRITE "${WORKDIR}/default.txt" "default/c.vcf.cryfa\n")
+run_cryfa("${WORKDIR}/default.dec" -k "${PASS}" -d --batch "${WORKDIR}/default.txt")
+expect_same("${WORKDIR}/c.vcf" "${WORKDIR}/default/c.vcf" "batch default/c.vcf")
+message(STATUS "batch_default_names: passed")
+
+# A file missing among others fails the batch
+file(WRITE "${WORKDIR}/missing.txt" "a.fq\ta.fq.crf\nnone.fq\tnone.fq.crf\nb.fa\tb.fa.crf\n")
+expect_cryfa_error("${WORKDIR}/batch_missing" "\"none.fq\" cannot be opened" -k "${PASS}" -t 4
+                   --batch "${WORKDIR}/missing.txt")
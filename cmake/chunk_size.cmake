@@ -0,0 +1,97 @@
+# Chunk size test: files encrypted as generic files, in chunks of sizes the
+# pipeline picks, each written after its size (flag 130), round-trip. Chunks
+# are multiples of 64 KiB up to 4 MiB, and 64 KiB where --max-memory allows
+# no more. FASTA the format cannot hold is encrypted as a generic file. Chunk
+# records swapped or dropped must fail to decrypt.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   SPLICE   – path to the splice_file helper
+#   PASS     – path to the key/passphrase file
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+# Sizes of the chunks of the generic file encrypted as <path>, in <var>. A
+# record of a chunk holds its size in decimal, byte 254, then it; the first
+# record holds the header, and the last one ends the file
+function(chunk_sizes path var)
+    record_bounds("${path}" records)
+    list(LENGTH records n)
+    math(EXPR last "${n} - 3")
+    set(sizes "")
+    foreach(i RANGE 3 ${last} 2)
+        list(GET records ${i} record_size)
+        math(EXPR plain "${record_size} - 8 - 12")
+        foreach(digits RANGE 1 8)
+            math(EXPR size "${plain} - ${digits} - 1")
+            string(LENGTH "${size}" length)
+            if(length EQUAL digits)
+                list(APPEND sizes ${size})
+                break()
+            endif()
+        endforeach()
+    endforeach()
+    set(${var} "${sizes}" PARENT_SCOPE)
+endfunction()
+
+# Text of no FASTA/FASTQ lines, 4 MiB and a partial chunk
+string(RANDOM LENGTH 1048576 ALPHABET "abcdefghijklmnopqrstuvwxyz0123456789 .,;:\n"
+       RANDOM_SEED 5 text)
+string(REPEAT "${text}" 4 text)
+file(WRITE "${WORKDIR}/in.txt" "${text}tail\n")
+file(SIZE "${WORKDIR}/in.txt" in_size)
+
+roundtrip(generic "${WORKDIR}/in.txt" ENCRYPT -t 4 DECRYPT -t 4)
+chunk_sizes("${WORKDIR}/generic.enc.out" sizes)
+set(total 0)
+list(POP_BACK sizes last_size)
+foreach(size IN LISTS sizes)
+    math(EXPR step "${size} % 65536")
+    if(NOT step EQUAL 0 OR size LESS 65536 OR size GREATER 4194304)
+        message(FATAL_ERROR "generic: a chunk of ${size} bytes, not of 64 KiB steps up to 4 MiB")
+    endif()
+    math(EXPR total "${total} + ${size}")
+endforeach()
+math(EXPR total "${total} + ${last_size}")
+if(NOT total EQUAL in_size)
+    message(FATAL_ERROR "generic: chunks of ${total} bytes in all, not ${in_size}")
+endif()
+
+roundtrip(generic_budget "${WORKDIR}/in.txt" ENCRYPT -t 4 --max-memory 16M DECRYPT -t 4)
+chunk_sizes("${WORKDIR}/generic_budget.enc.out" sizes)
+list(REMOVE_DUPLICATES sizes)
+if(NOT sizes STREQUAL "65536;${last_size}")
+    message(FATAL_ERROR "generic_budget: chunks of ${sizes} bytes, not of 64 KiB")
+endif()
+
+# FASTQ forced to be a generic file, and FASTA with a header of UTF-8
+write_sized_fastq("${WORKDIR}/in.fq" 2097152)
+roundtrip(forced "${WORKDIR}/in.fq" ENCRYPT -t 4 -f DECRYPT -t 4)
+random_bases(bases 5000 1)
+file(WRITE "${WORKDIR}/in.fa" ">seq1 café\n${bases}\n>seq2\n${bases}\n")
+roundtrip(fasta_utf8 "${WORKDIR}/in.fa")
+file(READ "${WORKDIR}/fasta_utf8.enc.err" err)
+if(NOT err MATCHES "isn't FASTA/FASTQ")
+    message(FATAL_ERROR "fasta_utf8: not encrypted as a generic file:\n${err}")
+endif()
+
+# Chunk records swapped, or one dropped
+set(enc "${WORKDIR}/generic_budget.enc.out")
+file(SIZE "${enc}" enc_size)
+record_bounds("${enc}" records)
+list(GET records 2 second_offset)
+list(GET records 3 second_size)
+list(GET records 4 third_offset)
+list(GET records 5 third_size)
+math(EXPR after_third "${third_offset} + ${third_size}")
+math(EXPR rest_size "${enc_size} - ${after_third}")
+splice_file("${WORKDIR}/swapped.crf" "${enc}" 0 ${second_offset} ${third_offset} ${third_size}
+            ${second_offset} ${second_size} ${after_third} ${rest_size})
+expect_cryfa_error("${WORKDIR}/swapped" "MAC not valid|corrupted file" -k "${PASS}" -d
+                   "${WORKDIR}/swapped.crf")
+splice_file("${WORKDIR}/dropped.crf" "${enc}" 0 ${third_offset} ${after_third} ${rest_size})
+expect_cryfa_error("${WORKDIR}/dropped" "MAC not valid|corrupted file" -k "${PASS}" -d
+                   "${WORKDIR}/dropped.crf")
@@ -0,0 +1,65 @@
+# Damaged input test: encrypted files cut short, with records reordered,
+# dropped or appended, must fail to decrypt; the format before records must
+# still decrypt.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   SPLICE   – path to the splice_file helper
+#   PASS     – path to the key/passphrase file
+#   INPUT    – path to a FASTQ input (example/in.fq)
+#   LEGACY   – INPUT, encrypted in the format before records (example/in.fq.legacy.crf)
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+set(damaged "MAC not valid|corrupted file")
+
+# Encrypted file of a few records: the header, chunks and the final one
+write_sized_fastq("${WORKDIR}/in.fq" 3145728)
+roundtrip(intact "${WORKDIR}/in.fq" ENCRYPT -t 4)
+set(enc "${WORKDIR}/intact.enc.out")
+file(SIZE "${enc}" enc_size)
+record_bounds("${enc}" records)
+list(LENGTH records n)
+if(n LESS 8)
+    message(FATAL_ERROR "expected at least 4 records in \"${enc}\", not ${n} / 2")
+endif()
+list(GET records 0 first_offset)
+list(GET records 1 first_size)
+list(GET records 2 second_offset)
+list(GET records 3 second_size)
+math(EXPR last "${n} - 2")
+list(GET records ${last} final_offset)
+list(GET records -1 final_size)
+math(EXPR after_second "${second_offset} + ${second_size}")
+math(EXPR rest_size "${enc_size} - ${after_second}")
+
+# Cut before the final record, and within a record
+splice_file("${WORKDIR}/no_final.crf" "${enc}" 0 ${final_offset})
+expect_cryfa_error("${WORKDIR}/no_final" "${damaged}" -k "${PASS}" -d "${WORKDIR}/no_final.crf")
+math(EXPR cut "${second_offset} + 100")
+splice_file("${WORKDIR}/cut.crf" "${enc}" 0 ${cut})
+expect_cryfa_error("${WORKDIR}/cut" "${damaged}" -k "${PASS}" -d "${WORKDIR}/cut.crf")
+
+# Two records swapped, and one dropped
+splice_file("${WORKDIR}/swapped.crf" "${enc}" 0 8 ${second_offset} ${second_size}
+            ${first_offset} ${first_size} ${after_second} ${rest_size})
+expect_cryfa_error("${WORKDIR}/swapped" "${damaged}" -k "${PASS}" -d "${WORKDIR}/swapped.crf")
+splice_file("${WORKDIR}/dropped.crf" "${enc}" 0 ${second_offset} ${after_second} ${rest_size})
+expect_cryfa_error("${WORKDIR}/dropped" "${damaged}" -k "${PASS}" -d "${WORKDIR}/dropped.crf")
+
+# Data after the final record
+splice_file("${WORKDIR}/appended.crf" "${enc}" 0 ${enc_size} ${final_offset} ${final_size})
+expect_cryfa_error("${WORKDIR}/appended" "${damaged}" -k "${PASS}" -d "${WORKDIR}/appended.crf")
+
+# The format before records: one GCM message, with its tag at the end
+run_cryfa("${WORKDIR}/legacy" -k "${PASS}" -d "${LEGACY}")
+expect_same("${INPUT}" "${WORKDIR}/legacy.out" legacy)
+message(STATUS "legacy: passed")
+file(SIZE "${LEGACY}" legacy_size)
+math(EXPR legacy_cut "${legacy_size} - 1")
+splice_file("${WORKDIR}/legacy_cut.crf" "${LEGACY}" 0 ${legacy_cut})
+expect_cryfa_error("${WORKDIR}/legacy_cut" "${damaged}" -k "${PASS}" -d
+                   "${WORKDIR}/legacy_cut.crf")
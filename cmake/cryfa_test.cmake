@@ -0,0 +1,150 @@
+# Functions shared by the integration tests. Each test script sets CRYFA,
+# PASS and WORKDIR via -D, then includes this file.
+#
+# cryfa reports errors on standard error, with "Error:", so a run fails on
+# either a nonzero exit code or that mark. Errors caught past the checks,
+# e.g. of decryption, are printed as they are, and exit with 0.
+
+cmake_minimum_required(VERSION 3.20)
+
+# Run cryfa with ARGN, in WORKDIR; standard output goes to <log>.out,
+# standard error to <log>.err
+function(run_cryfa log)
+    execute_process(
+        COMMAND "${CRYFA}" ${ARGN}
+        WORKING_DIRECTORY "${WORKDIR}"
+        OUTPUT_FILE "${log}.out"
+        ERROR_FILE "${log}.err"
+        RESULT_VARIABLE rc
+    )
+    file(READ "${log}.err" err)
+    if(NOT rc EQUAL 0 OR err MATCHES "Error:")
+        message(FATAL_ERROR "cryfa ${ARGN} failed (exit code ${rc}):\n${err}")
+    endif()
+endfunction()
+
+# Run cryfa with ARGN, in WORKDIR, expecting it to fail with an error
+# matching <pattern>
+function(expect_cryfa_error log pattern)
+    execute_process(
+        COMMAND "${CRYFA}" ${ARGN}
+        WORKING_DIRECTORY "${WORKDIR}"
+        OUTPUT_FILE "${log}.out"
+        ERROR_FILE "${log}.err"
+        RESULT_VARIABLE rc
+    )
+    file(READ "${log}.err" err)
+    string(REGEX REPLACE "[ \t\r\n]+" " " err "${err}")  # Messages are wrapped
+    if(NOT err MATCHES "${pattern}")
+        message(FATAL_ERROR "cryfa ${ARGN} should have failed with \"${pattern}\" "
+                            "(exit code ${rc}):\n${err}")
+    endif()
+    cmake_path(GET log FILENAME name)
+    message(STATUS "${name}: failed as expected")
+endfunction()
+
+function(expect_same expected actual what)
+    execute_process(
+        COMMAND "${CMAKE_COMMAND}" -E compare_files "${expected}" "${actual}"
+        RESULT_VARIABLE rc
+    )
+    if(NOT rc EQUAL 0)
+        message(FATAL_ERROR "${what}: \"${actual}\" differs from \"${expected}\"")
+    endif()
+endfunction()
+
+# Encrypt <input> and decrypt it again, then compare with <input>, or with
+# EXPECT if given. ENCRYPT and DECRYPT are extra options of each step.
+#   roundtrip(<name> <input> [ENCRYPT args...] [DECRYPT args...] [EXPECT file])
+function(roundtrip name input)
+    cmake_parse_arguments(PARSE_ARGV 2 arg "" "EXPECT" "ENCRYPT;DECRYPT")
+    if(NOT arg_EXPECT)
+        set(arg_EXPECT "${input}")
+    endif()
+    set(log "${WORKDIR}/${name}")
+    run_cryfa("${log}.enc" -k "${PASS}" ${arg_ENCRYPT} "${input}")
+    run_cryfa("${log}.dec" -k "${PASS}" -d ${arg_DECRYPT} "${log}.enc.out")
+    expect_same("${arg_EXPECT}" "${log}.dec.out" "${name}")
+    message(STATUS "${name}: passed")
+endfunction()
+
+# FASTQ of exactly <size> bytes, of 210-byte reads and one shorter read to
+# make up the size, as <path>
+function(write_sized_fastq path size)
+    string(REPEAT "ACGTTGCA" 13 bases)
+    string(REPEAT "IIII5555" 13 scores)
+    string(SUBSTRING "${bases}" 0 100 bases)
+    string(SUBSTRING "${scores}" 0 100 scores)
+    set(read "@read\n${bases}\n+\n${scores}\n")
+    string(LENGTH "${read}" read_size)
+    math(EXPR reads "${size} / ${read_size} - 1")
+    math(EXPR rest "${size} - ${reads} * ${read_size}")
+    # The last read: "@last" and "+" lines, and as many bases as scores
+    math(EXPR last_bases "(${rest} - 10) / 2")
+    math(EXPR header_pad "${rest} - 10 - 2 * ${last_bases}")
+    string(REPEAT "x" ${header_pad} pad)
+    string(SUBSTRING "${bases}${bases}${bases}" 0 ${last_bases} last_seq)
+    string(SUBSTRING "${scores}${scores}${scores}" 0 ${last_bases} last_qs)
+
+    string(REPEAT "${read}" ${reads} text)
+    file(WRITE "${path}" "${text}@last${pad}\n${last_seq}\n+\n${last_qs}\n")
+    file(SIZE "${path}" written)
+    if(NOT written EQUAL size)
+        message(FATAL_ERROR "wrote ${written} bytes to \"${path}\", not ${size}")
+    endif()
+endfunction()
+
+# Offsets and sizes of the records of an encrypted file, as a list of
+# <offset> <size> pairs, in <var>. A record is its 8-byte little-endian
+# plaintext size, the ciphertext and a 12-byte tag; the file starts with an
+# 8-byte mark
+function(record_bounds path var)
+    file(SIZE "${path}" size)
+    set(offset 8)
+    set(bounds "")
+    while(offset LESS size)
+        file(READ "${path}" hex OFFSET ${offset} LIMIT 8 HEX)
+        set(value "")
+        foreach(i RANGE 0 14 2)
+            string(SUBSTRING "${hex}" ${i} 2 byte)
+            set(value "${byte}${value}")
+        endforeach()
+        math(EXPR record_size "0x${value} + 8 + 12")
+        list(APPEND bounds ${offset} ${record_size})
+        math(EXPR offset "${offset} + ${record_size}")
+    endwhile()
+    set(${var} "${bounds}" PARENT_SCOPE)
+endfunction()
+
+# Write the byte ranges of <input>, given as <offset> <size> pairs in ARGN,
+# in that order, to <output>. SPLICE is the splice_file helper
+function(splice_file output input)
+    execute_process(
+        COMMAND "${SPLICE}" "${output}" "${input}" ${ARGN}
+        RESULT_VARIABLE rc
+        ERROR_VARIABLE err
+    )
+    if(NOT rc EQUAL 0)
+        message(FATAL_ERROR "splice_file failed (exit code ${rc}):\n${err}")
+    endif()
+endfunction()
+
+# <length> random bases, the same for the same <seed>, in <var>
+function(random_bases var length seed)
+    string(RANDOM LENGTH ${length} ALPHABET ACGT RANDOM_SEED ${seed} bases)
+    set(${var} "${bases}" PARENT_SCOPE)
+endfunction()
+
+# FASTA of <count> random sequences of <length> bases, in lines of 60, as
+# <path>
+function(write_fasta path count length)
+    set(text "")
+    foreach(i RANGE 1 ${count})
+        random_bases(bases ${length} ${i})
+        string(REGEX REPLACE "(............................................................)"
+               "\\1\n" bases "${bases}")
+        string(REGEX REPLACE "\n$" "" bases "${bases}")
+        string(APPEND text ">seq${i} random sequence ${i}\n${bases}\n")
+    endforeach()
+    file(WRITE "${path}" "${text}")
+endfunction()
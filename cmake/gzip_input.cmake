@@ -0,0 +1,32 @@
+# Compressed input test: encrypt plain gzip and BGZF input, decrypt, and
+# compare with the uncompressed original.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   PASS     – path to the key/passphrase file
+#   INPUT    – path to a FASTQ input (example/in.fq)
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+# Plain gzip, one member
+file(COPY_FILE "${INPUT}" "${WORKDIR}/in.fq")
+file(ARCHIVE_CREATE OUTPUT "${WORKDIR}/in.fq.gz" PATHS "${WORKDIR}/in.fq"
+     FORMAT raw COMPRESSION GZip)
+roundtrip(gzip "${WORKDIR}/in.fq.gz" EXPECT "${WORKDIR}/in.fq")
+
+# Plain gzip, inflating to a multiple of the 1 MiB inflate buffer: the member
+# ends as the buffer fills
+write_sized_fastq("${WORKDIR}/2mib.fq" 2097152)
+file(ARCHIVE_CREATE OUTPUT "${WORKDIR}/2mib.fq.gz" PATHS "${WORKDIR}/2mib.fq"
+     FORMAT raw COMPRESSION GZip)
+roundtrip(gzip_buffer_multiple "${WORKDIR}/2mib.fq.gz" ENCRYPT -t 2
+          EXPECT "${WORKDIR}/2mib.fq")
+
+# BGZF, as cryfa writes it on decryption with --bgzf
+run_cryfa("${WORKDIR}/to_bgzf.enc" -k "${PASS}" "${WORKDIR}/2mib.fq")
+run_cryfa("${WORKDIR}/to_bgzf.dec" -k "${PASS}" -d --bgzf "${WORKDIR}/to_bgzf.enc.out")
+file(RENAME "${WORKDIR}/to_bgzf.dec.out" "${WORKDIR}/2mib.fq.gz")
+roundtrip(bgzf "${WORKDIR}/2mib.fq.gz" ENCRYPT -t 4 EXPECT "${WORKDIR}/2mib.fq")
@@ -0,0 +1,55 @@
+# Header dictionary test: Illumina headers, their tokens coded by the
+# dictionary, encrypted and decrypted again; and headers with bytes the codes
+# take, in the reads it is trained on or past them, which keep none.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   PASS     – path to the key/passphrase file
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+# Tokens of the dictionary, as reported with -v, of the run logged as <log>,
+# in <var>
+function(dict_tokens log var)
+    file(READ "${log}.err" err)
+    if(NOT err MATCHES "Header dictionary: ([0-9]+) tokens")
+        message(FATAL_ERROR "no header dictionary reported:\n${err}")
+    endif()
+    set(${var} ${CMAKE_MATCH_1} PARENT_SCOPE)
+endfunction()
+
+# 64 reads of one run, over 4 MB in all: past the reads trained on
+string(REPEAT "IIII5555" 13 scores)
+string(SUBSTRING "${scores}" 0 100 scores)
+set(run "")
+foreach(i RANGE 1 64)
+    random_bases(bases 100 ${i})
+    math(EXPR x "1000 + ${i} * 37")
+    math(EXPR y "2000 + ${i} * 53")
+    math(EXPR tile "1101 + ${i} % 4")
+    string(APPEND run
+           "@M01234:55:000000000-A1B2C:1:${tile}:${x}:${y} 1:N:0:1\n${bases}\n+\n${scores}\n")
+endforeach()
+string(REPEAT "${run}" 320 reads)
+file(WRITE "${WORKDIR}/illumina.fq" "${reads}")
+
+roundtrip(header_dict "${WORKDIR}/illumina.fq" ENCRYPT -v -t 4)
+dict_tokens("${WORKDIR}/header_dict.enc" tokens)
+if(tokens EQUAL 0)
+    message(FATAL_ERROR "header_dict: no tokens for Illumina headers")
+endif()
+
+# A header with "é", first or last: no dictionary, and the same reads back
+set(odd "@M01234:55:000000000-A1B2C:1:1101:99:99 é\nACGT\n+\nIIII\n")
+file(WRITE "${WORKDIR}/odd_first.fq" "${odd}${reads}")
+file(WRITE "${WORKDIR}/odd_last.fq" "${reads}${odd}")
+foreach(name odd_first odd_last)
+    roundtrip(${name} "${WORKDIR}/${name}.fq" ENCRYPT -v -t 4)
+    dict_tokens("${WORKDIR}/${name}.enc" tokens)
+    if(NOT tokens EQUAL 0)
+        message(FATAL_ERROR "${name}: ${tokens} tokens, though a header takes their codes")
+    endif()
+endforeach()
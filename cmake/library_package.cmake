@@ -0,0 +1,54 @@
+# Installed library test: install libcryfa to a scratch prefix, then build the
+# library tests as a project of its own, finding it with find_package(cryfa),
+# and run them. Checks the installed library links with what its package
+# declares only.
+# Variables passed in via -D:
+#   BUILD        – the build tree of cryfa
+#   CONFIG       – its configuration, for multi-config generators
+#   SOURCE       – the source tree of cryfa
+#   C_COMPILER   – the C and C++ compilers it was built with
+#   CXX_COMPILER
+#   CRYPTOPP     – the Crypto++ library it links to, unless bundled
+#   WORKDIR      – scratch directory (created fresh each run)
+
+cmake_minimum_required(VERSION 3.20)
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+function(run what)
+    execute_process(
+        COMMAND ${ARGN}
+        OUTPUT_VARIABLE out
+        ERROR_VARIABLE out
+        RESULT_VARIABLE rc
+    )
+    if(NOT rc EQUAL 0)
+        message(FATAL_ERROR "${what} failed (exit code ${rc}):\n${out}")
+    endif()
+    message(STATUS "${what}: passed")
+endfunction()
+
+run(install "${CMAKE_COMMAND}" --install "${BUILD}" --config "${CONFIG}"
+    --prefix "${WORKDIR}/prefix")
+set(hints)
+if(CRYPTOPP)
+    set(hints "-DCRYFA_CRYPTOPP_LIBRARY=${CRYPTOPP}")
+endif()
+run(configure "${CMAKE_COMMAND}" -S "${SOURCE}/test/package" -B "${WORKDIR}/build"
+    "-DCMAKE_PREFIX_PATH=${WORKDIR}/prefix"
+    "-DCMAKE_BUILD_TYPE=${CONFIG}"
+    "-DCMAKE_C_COMPILER=${C_COMPILER}"
+    "-DCMAKE_CXX_COMPILER=${CXX_COMPILER}"
+    ${hints}
+    "-DCRYFA_TEST_DIR=${SOURCE}/test")
+run(build "${CMAKE_COMMAND}" --build "${WORKDIR}/build" --config "${CONFIG}")
+
+foreach(test library_test library_c_test)
+    file(GLOB_RECURSE program "${WORKDIR}/build/${test}" "${WORKDIR}/build/${test}.exe")
+    if(NOT program)
+        message(FATAL_ERROR "${test} was not built")
+    endif()
+    list(GET program 0 program)
+    run(${test} "${program}")
+endforeach()
@@ -0,0 +1,29 @@
+# Long-read test: reads split across chunks, with --long and detected past
+# 256 KB, encrypted and decrypted again; and --long with paired reads.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   PASS     – path to the key/passphrase file
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+set(long "")
+foreach(i RANGE 1 3)
+    random_bases(bases 300000 ${i})
+    string(REPLACE "A" "I" scores "${bases}")
+    string(REPLACE "C" "5" scores "${scores}")
+    string(REPLACE "G" "?" scores "${scores}")
+    string(REPLACE "T" "#" scores "${scores}")
+    string(APPEND long "@long${i} length=300000\n${bases}\n+\n${scores}\n")
+endforeach()
+file(WRITE "${WORKDIR}/long.fq" "${long}")
+roundtrip(long "${WORKDIR}/long.fq" ENCRYPT -t 4 --long)
+roundtrip(long_detected "${WORKDIR}/long.fq" ENCRYPT -t 4)
+
+file(COPY_FILE "${WORKDIR}/long.fq" "${WORKDIR}/mates.fq")
+expect_cryfa_error("${WORKDIR}/long_paired" "cannot be combined with paired mode" -k "${PASS}"
+                   --long --paired "${WORKDIR}/mates.fq" -o "${WORKDIR}/paired.crf"
+                   "${WORKDIR}/long.fq")
@@ -0,0 +1,41 @@
+# Memory budget test: --max-memory 16M on 32 MB of FASTQ, plain and with the
+# reads kept in order, which round-trips, with the peak resident size that
+# --stats reports held near the budget; and budgets that are too small or not
+# sizes.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   PASS     – path to the key/passphrase file
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+# Peak resident size in the stats file <path> no more than 48 MiB: the budget
+# and the executable. Without the budget, keeping the order takes over 64 MiB
+function(expect_peak_rss path)
+    file(READ "${path}" json)
+    string(JSON peak GET "${json}" peak_rss_bytes)
+    if(peak GREATER 50331648)  # 0 where it is not known
+        message(FATAL_ERROR "\"${path}\": a peak resident size of ${peak} bytes, "
+                            "past 48 MiB with --max-memory 16M")
+    endif()
+endfunction()
+
+write_sized_fastq("${WORKDIR}/in.fq" 33554432)
+roundtrip(max_memory "${WORKDIR}/in.fq"
+          ENCRYPT -t 4 --max-memory 16M --stats "${WORKDIR}/enc.json"
+          DECRYPT -t 4 --max-memory 16M --stats "${WORKDIR}/dec.json")
+expect_peak_rss("${WORKDIR}/enc.json")
+expect_peak_rss("${WORKDIR}/dec.json")
+roundtrip(max_memory_keep "${WORKDIR}/in.fq"
+          ENCRYPT -t 4 --max-memory 16M --reorder keep --stats "${WORKDIR}/keep_enc.json"
+          DECRYPT -t 4 --max-memory 16M --stats "${WORKDIR}/keep_dec.json")
+expect_peak_rss("${WORKDIR}/keep_enc.json")
+expect_peak_rss("${WORKDIR}/keep_dec.json")
+
+expect_cryfa_error("${WORKDIR}/max_memory_small" "must be at least 16 MiB" -k "${PASS}"
+                   --max-memory 8M "${WORKDIR}/in.fq")
+expect_cryfa_error("${WORKDIR}/max_memory_size" "is not a size" -k "${PASS}"
+                   --max-memory lots "${WORKDIR}/in.fq")
@@ -0,0 +1,50 @@
+# Output test: encryption and decryption to a file with -o, which workers
+# write at their offsets, must match the same through standard output; BGZF
+# output must be well formed and read back.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   PASS     – path to the key/passphrase file
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+write_sized_fastq("${WORKDIR}/in.fq" 3145728)
+
+# Encrypted to a file and to standard output, each decrypted both ways
+run_cryfa("${WORKDIR}/file.enc" -k "${PASS}" -t 4 -o "${WORKDIR}/file.crf" "${WORKDIR}/in.fq")
+file(SIZE "${WORKDIR}/file.enc.out" piped)
+if(NOT piped EQUAL 0)
+    message(FATAL_ERROR "with -o, cryfa wrote ${piped} bytes to standard output")
+endif()
+run_cryfa("${WORKDIR}/pipe.enc" -k "${PASS}" -t 4 "${WORKDIR}/in.fq")
+file(RENAME "${WORKDIR}/pipe.enc.out" "${WORKDIR}/pipe.crf")
+foreach(enc file pipe)
+    run_cryfa("${WORKDIR}/${enc}_file.dec" -k "${PASS}" -d -t 4 -o "${WORKDIR}/${enc}_file.fq"
+              "${WORKDIR}/${enc}.crf")
+    expect_same("${WORKDIR}/in.fq" "${WORKDIR}/${enc}_file.fq" "${enc}_file")
+    run_cryfa("${WORKDIR}/${enc}_pipe.dec" -k "${PASS}" -d -t 4 "${WORKDIR}/${enc}.crf")
+    expect_same("${WORKDIR}/in.fq" "${WORKDIR}/${enc}_pipe.dec.out" "${enc}_pipe")
+    message(STATUS "${enc}: passed")
+endforeach()
+
+# BGZF, to a file and to standard output: gzip members with the "BC" extra
+# field, ending with the empty EOF block, and the same when inflated
+set(bgzf_eof "1f8b08040000000000ff0600424302001b0003000000000000000000")
+run_cryfa("${WORKDIR}/bgzf_file" -k "${PASS}" -d --bgzf -t 4 -o "${WORKDIR}/file.fq.gz"
+          "${WORKDIR}/file.crf")
+run_cryfa("${WORKDIR}/bgzf_pipe" -k "${PASS}" -d --bgzf -t 4 "${WORKDIR}/pipe.crf")
+file(RENAME "${WORKDIR}/bgzf_pipe.out" "${WORKDIR}/pipe.fq.gz")
+foreach(out file pipe)
+    set(gz "${WORKDIR}/${out}.fq.gz")
+    file(SIZE "${gz}" size)
+    math(EXPR eof_offset "${size} - 28")
+    file(READ "${gz}" head LIMIT 16 HEX)
+    file(READ "${gz}" eof OFFSET ${eof_offset} HEX)
+    if(NOT head MATCHES "^1f8b0804..........ff0600424302" OR NOT eof STREQUAL bgzf_eof)
+        message(FATAL_ERROR "\"${gz}\" is not BGZF")
+    endif()
+    roundtrip(bgzf_${out} "${gz}" EXPECT "${WORKDIR}/in.fq")
+endforeach()
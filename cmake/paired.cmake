@@ -0,0 +1,34 @@
+# Paired-end test: the reads and their mates, with "/1" and "/2" headers and
+# other bases, encrypted into one file and decrypted to two again; and mates
+# of another number of reads.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   PASS     – path to the key/passphrase file
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+write_sized_fastq("${WORKDIR}/reads.fq" 1048576)
+file(READ "${WORKDIR}/reads.fq" reads)
+
+string(REPLACE "@read\n" "@read/1\n" r1 "${reads}")
+string(REPLACE "@read\n" "@read/2\n" r2 "${reads}")
+string(REPLACE "ACGTTGCA" "TTGCAACG" r2 "${r2}")
+file(WRITE "${WORKDIR}/r1.fq" "${r1}")
+file(WRITE "${WORKDIR}/r2.fq" "${r2}")
+run_cryfa("${WORKDIR}/paired.enc" -k "${PASS}" -t 4 --paired "${WORKDIR}/r2.fq"
+          -o "${WORKDIR}/paired.crf" "${WORKDIR}/r1.fq")
+run_cryfa("${WORKDIR}/paired.dec" -k "${PASS}" -d -t 4 --paired "${WORKDIR}/r2.out.fq"
+          -o "${WORKDIR}/r1.out.fq" "${WORKDIR}/paired.crf")
+expect_same("${WORKDIR}/r1.fq" "${WORKDIR}/r1.out.fq" "paired reads")
+expect_same("${WORKDIR}/r2.fq" "${WORKDIR}/r2.out.fq" "paired mates")
+message(STATUS "paired: passed")
+
+# The mates one read short
+string(REGEX REPLACE "@[^\n]*\n[^\n]*\n\\+\n[^\n]*\n$" "" short "${r2}")
+file(WRITE "${WORKDIR}/short.fq" "${short}")
+expect_cryfa_error("${WORKDIR}/paired_short" "different numbers of reads" -k "${PASS}" -t 4
+                   --paired "${WORKDIR}/short.fq" -o "${WORKDIR}/short.crf" "${WORKDIR}/r1.fq")
@@ -0,0 +1,268 @@
+# Thread-scaling performance test: encode and decode generated FASTQ and
+# FASTA at several thread counts, then compare throughput, parallel
+# efficiency and per-stage MB/s with a stored baseline.
+# Variables passed in via -D:
+#   CRYFA      – path to the cryfa executable
+#   GEN        – path to the cryfa-gen executable
+#   PASS       – path to the key/passphrase file
+#   WORKDIR    – scratch directory (created fresh each run)
+#   BASELINE   – baseline JSON; written by the first run, or when the
+#                environment has CRYFA_PERF_UPDATE_BASELINE=1
+#   SIZE_MB    – size of each generated input, in MiB
+#   THREADS    – thread counts; N is the number of logical cores, and counts
+#                above it are left out
+#   RUNS       – runs of each case; the best is kept
+#   TOLERANCE  – regression allowed, in percent, before the test fails
+#
+# CMake has integer arithmetic only, so rates are kept in thousandths.
+
+cmake_minimum_required(VERSION 3.20)  # string(JSON)
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+# Stages below this busy time, in ms, in the baseline are too short to compare
+set(MIN_STAGE_MS 50)
+
+# Number of the stats, e.g. "12.3456" or "2.4e-05" as string(JSON) gives it,
+# as an integer in 1/10^digits
+function(decimal_to_int out value digits)
+    string(REGEX MATCH "^([0-9]+)\\.?([0-9]*)([eE]([-+]?[0-9]+))?$" matched "${value}")
+    if(matched STREQUAL "")
+        message(FATAL_ERROR "\"${value}\" is not a decimal number")
+    endif()
+    set(whole "${CMAKE_MATCH_1}")
+    set(fraction "${CMAKE_MATCH_2}")
+    set(exponent "${CMAKE_MATCH_4}")
+    if(NOT exponent STREQUAL "")
+        set(mantissa "${whole}${fraction}")
+        string(LENGTH "${whole}" point)
+        string(LENGTH "${mantissa}" length)
+        math(EXPR point "${point} + ${exponent}")
+        if(point LESS_EQUAL 0)
+            math(EXPR shift "-${point}")
+            string(REPEAT "0" ${shift} zeros)
+            set(whole 0)
+            set(fraction "${zeros}${mantissa}")
+        elseif(point GREATER_EQUAL length)
+            math(EXPR shift "${point} - ${length}")
+            string(REPEAT "0" ${shift} zeros)
+            set(whole "${mantissa}${zeros}")
+            set(fraction "")
+        else()
+            string(SUBSTRING "${mantissa}" 0 ${point} whole)
+            string(SUBSTRING "${mantissa}" ${point} -1 fraction)
+        endif()
+    endif()
+    set(fraction "${fraction}000000000")
+    string(SUBSTRING "${fraction}" 0 ${digits} fraction)
+    string(REGEX REPLACE "^0+([0-9])" "\\1" fraction "${fraction}")
+    string(REPEAT "0" ${digits} zeros)
+    math(EXPR result "${whole} * 1${zeros} + ${fraction}")
+    set(${out} ${result} PARENT_SCOPE)
+endfunction()
+
+# Integer in thousandths, as a decimal string
+function(milli_to_string out value)
+    math(EXPR whole "${value} / 1000")
+    math(EXPR fraction "${value} % 1000 + 1000")
+    string(SUBSTRING "${fraction}" 1 3 fraction)
+    set(${out} "${whole}.${fraction}" PARENT_SCOPE)
+endfunction()
+
+function(run_cryfa log)
+    execute_process(
+        COMMAND "${CRYFA}" ${ARGN}
+        OUTPUT_FILE "${log}.out"
+        ERROR_FILE "${log}.err"
+        RESULT_VARIABLE rc
+    )
+    if(NOT rc EQUAL 0)
+        file(READ "${log}.err" err)
+        message(FATAL_ERROR "cryfa ${ARGN} failed (exit code ${rc}):\n${err}")
+    endif()
+endfunction()
+
+# ── Thread counts ────────────────────────────────────────────────────────────
+cmake_host_system_information(RESULT n_cores QUERY NUMBER_OF_LOGICAL_CORES)
+string(REPLACE " " ";" THREADS "${THREADS}")
+set(thread_counts "")
+foreach(t IN LISTS THREADS)
+    if(t STREQUAL "N")
+        set(t ${n_cores})
+    endif()
+    if(t GREATER 0 AND NOT t GREATER n_cores AND NOT t IN_LIST thread_counts)
+        list(APPEND thread_counts ${t})
+    endif()
+endforeach()
+list(SORT thread_counts COMPARE NATURAL)
+list(GET thread_counts 0 first_threads)
+message(STATUS "Threads: ${thread_counts} (${n_cores} logical cores)")
+
+# ── Inputs ───────────────────────────────────────────────────────────────────
+set(GEN_FQ --size ${SIZE_MB} --length 100~20 --seed 48)
+set(GEN_FA --size ${SIZE_MB} --fasta --length 1000~300 --lowercase 0.1 --seed 48)
+foreach(format fq fa)
+    string(TOUPPER "${format}" FORMAT)
+    execute_process(
+        COMMAND "${GEN}" ${GEN_${FORMAT}} -o "${WORKDIR}/in.${format}"
+        RESULT_VARIABLE rc
+    )
+    if(NOT rc EQUAL 0)
+        message(FATAL_ERROR "cryfa-gen failed (exit code ${rc})")
+    endif()
+endforeach()
+
+# ── Runs ─────────────────────────────────────────────────────────────────────
+# Each case, e.g. fq_encode_t4, keeps its best MB/s and the per-stage MB/s of
+# the same run: <case>_rate, <case>_stages, <case>_stage_<stage>_{rate,ms}
+set(cases "")
+foreach(format fq fa)
+    set(input "${WORKDIR}/in.${format}")
+    file(SIZE "${input}" input_bytes)
+    foreach(threads IN LISTS thread_counts)
+        foreach(run RANGE 1 ${RUNS})
+            set(encrypted "${WORKDIR}/${format}_t${threads}.crf")
+            set(decrypted "${WORKDIR}/${format}_t${threads}.dec")
+            run_cryfa("${WORKDIR}/encode" -k "${PASS}" -t ${threads}
+                      --stats "${WORKDIR}/encode.json" "${input}")
+            file(RENAME "${WORKDIR}/encode.out" "${encrypted}")
+            run_cryfa("${WORKDIR}/decode" -k "${PASS}" -t ${threads} -d
+                      --stats "${WORKDIR}/decode.json" "${encrypted}")
+            file(RENAME "${WORKDIR}/decode.out" "${decrypted}")
+            execute_process(
+                COMMAND "${CMAKE_COMMAND}" -E compare_files "${input}" "${decrypted}"
+                RESULT_VARIABLE rc
+            )
+            if(NOT rc EQUAL 0)
+                message(FATAL_ERROR "Round-trip mismatch: ${format} at ${threads} threads")
+            endif()
+
+            foreach(direction encode decode)
+                set(case "${format}_${direction}_t${threads}")
+                file(READ "${WORKDIR}/${direction}.json" stats)
+                string(JSON wall GET "${stats}" wall_seconds)
+                decimal_to_int(wall_us "${wall}" 6)
+                if(wall_us LESS 1)
+                    set(wall_us 1)
+                endif()
+                # Bytes per µs is MB/s
+                math(EXPR rate "${input_bytes} * 1000 / ${wall_us}")
+                if(DEFINED ${case}_rate AND NOT rate GREATER ${case}_rate)
+                    continue()
+                endif()
+                if(NOT case IN_LIST cases)
+                    list(APPEND cases ${case})
+                endif()
+                set(${case}_rate ${rate})
+                set(${case}_stages "")
+                string(JSON n_stages LENGTH "${stats}" stages)
+                math(EXPR last "${n_stages} - 1")
+                foreach(i RANGE ${last})
+                    string(JSON stage MEMBER "${stats}" stages ${i})
+                    string(JSON stage_rate GET "${stats}" stages ${stage} mb_per_busy_second)
+                    string(JSON stage_busy GET "${stats}" stages ${stage} busy_seconds)
+                    decimal_to_int(${case}_stage_${stage}_rate "${stage_rate}" 3)
+                    decimal_to_int(${case}_stage_${stage}_ms "${stage_busy}" 3)
+                    list(APPEND ${case}_stages ${stage})
+                endforeach()
+            endforeach()
+            file(REMOVE "${encrypted}" "${decrypted}")
+        endforeach()
+    endforeach()
+endforeach()
+
+# Parallel efficiency: speedup over the fewest threads, over the ratio of
+# threads; 1.000 is linear scaling
+foreach(case IN LISTS cases)
+    string(REGEX REPLACE "_t([0-9]+)$" "" base "${case}")
+    string(REGEX REPLACE "^.*_t" "" threads "${case}")
+    set(first_rate ${${base}_t${first_threads}_rate})
+    math(EXPR ${case}_efficiency
+         "${${case}_rate} * 1000 * ${first_threads} / (${first_rate} * ${threads})")
+endforeach()
+
+# ── Results ──────────────────────────────────────────────────────────────────
+set(json "{\n  \"threads_available\": ${n_cores},\n  \"size_mb\": ${SIZE_MB},\n  \"cases\": {")
+set(separator "\n")
+message(STATUS "case                     MB/s   efficiency")
+foreach(case IN LISTS cases)
+    milli_to_string(rate "${${case}_rate}")
+    milli_to_string(efficiency "${${case}_efficiency}")
+    set(stages_json "")
+    set(stage_separator "")
+    foreach(stage IN LISTS ${case}_stages)
+        milli_to_string(stage_rate "${${case}_stage_${stage}_rate}")
+        string(APPEND stages_json "${stage_separator}\"${stage}\": {\"mb_per_busy_second\": "
+               "${stage_rate}, \"busy_ms\": ${${case}_stage_${stage}_ms}}")
+        set(stage_separator ", ")
+    endforeach()
+    string(APPEND json "${separator}    \"${case}\": {\"mb_per_second\": ${rate}, "
+           "\"efficiency\": ${efficiency}, \"stages\": {${stages_json}}}")
+    set(separator ",\n")
+    string(LENGTH "${case}" length)
+    math(EXPR pad "22 - ${length}")
+    string(REPEAT " " ${pad} padding)
+    message(STATUS "${case}${padding}${rate}   ${efficiency}")
+endforeach()
+string(APPEND json "\n  }\n}\n")
+file(WRITE "${WORKDIR}/perf_scaling.json" "${json}")
+message(STATUS "Results: ${WORKDIR}/perf_scaling.json")
+
+if(NOT EXISTS "${BASELINE}" OR "$ENV{CRYFA_PERF_UPDATE_BASELINE}")
+    file(WRITE "${BASELINE}" "${json}")
+    message(STATUS "Baseline written: ${BASELINE}")
+    return()
+endif()
+
+# ── Comparison with the baseline ─────────────────────────────────────────────
+file(READ "${BASELINE}" baseline)
+math(EXPR keep "100 - ${TOLERANCE}")
+set(failures "")
+foreach(case IN LISTS cases)
+    string(JSON base_case ERROR_VARIABLE missing GET "${baseline}" cases ${case})
+    if(missing)
+        continue()  # Thread count not in the baseline
+    endif()
+    foreach(metric mb_per_second efficiency)
+        string(JSON base_value GET "${base_case}" ${metric})
+        decimal_to_int(base_value "${base_value}" 3)
+        if(metric STREQUAL "mb_per_second")
+            set(value ${${case}_rate})
+        else()
+            set(value ${${case}_efficiency})
+        endif()
+        math(EXPR floor "${base_value} * ${keep} / 100")
+        if(value LESS floor)
+            milli_to_string(value "${value}")
+            milli_to_string(base_value "${base_value}")
+            list(APPEND failures "${case} ${metric}: ${value}, baseline ${base_value}")
+        endif()
+    endforeach()
+    foreach(stage IN LISTS ${case}_stages)
+        string(JSON base_stage ERROR_VARIABLE missing GET "${base_case}" stages ${stage})
+        if(missing)
+            continue()
+        endif()
+        string(JSON base_ms GET "${base_stage}" busy_ms)
+        if(base_ms LESS MIN_STAGE_MS)
+            continue()
+        endif()
+        string(JSON base_value GET "${base_stage}" mb_per_busy_second)
+        decimal_to_int(base_value "${base_value}" 3)
+        math(EXPR floor "${base_value} * ${keep} / 100")
+        if(${case}_stage_${stage}_rate LESS floor)
+            milli_to_string(value "${${case}_stage_${stage}_rate}")
+            milli_to_string(base_value "${base_value}")
+            list(APPEND failures
+                 "${case} ${stage} mb_per_busy_second: ${value}, baseline ${base_value}")
+        endif()
+    endforeach()
+endforeach()
+
+if(failures)
+    list(JOIN failures "\n  " failures)
+    message(FATAL_ERROR "Throughput regressed more than ${TOLERANCE}% from ${BASELINE}:\n"
+                        "  ${failures}")
+endif()
+message(STATUS "Thread-scaling test passed.")
@@ -0,0 +1,26 @@
+# Quality score binning test, lossy: "I" (Phred 40) and "5" (Phred 20) to
+# the representative of their bins, by each scheme; and an unknown scheme.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   PASS     – path to the key/passphrase file
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+write_sized_fastq("${WORKDIR}/reads.fq" 1048576)
+file(READ "${WORKDIR}/reads.fq" reads)
+
+string(REPLACE "5" "7" illumina8 "${reads}")
+file(WRITE "${WORKDIR}/illumina8.fq" "${illumina8}")
+roundtrip(qbin_illumina8 "${WORKDIR}/reads.fq" ENCRYPT --qbin illumina8
+          EXPECT "${WORKDIR}/illumina8.fq")
+string(REPLACE "I" "D" ncbi4 "${reads}")
+string(REPLACE "5" ":" ncbi4 "${ncbi4}")
+file(WRITE "${WORKDIR}/ncbi4.fq" "${ncbi4}")
+roundtrip(qbin_ncbi4 "${WORKDIR}/reads.fq" ENCRYPT --qbin ncbi4 EXPECT "${WORKDIR}/ncbi4.fq")
+
+expect_cryfa_error("${WORKDIR}/qbin_unknown" "is not a quality score binning scheme" -k "${PASS}"
+                   --qbin illumina4 "${WORKDIR}/reads.fq")
@@ -0,0 +1,43 @@
+# Reference test: reads from a reference, some with a mismatch, and reads
+# from elsewhere, compacted against it and decrypted again; and decryption
+# without the reference, or with another.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   PASS     – path to the key/passphrase file
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+# Reads from the first sequence of the reference, some with a mismatch, and
+# reads from elsewhere, in no order
+write_fasta("${WORKDIR}/ref.fa" 2 50000)
+random_bases(genome 50000 1)
+string(REPEAT "IIII5555" 13 scores)
+string(SUBSTRING "${scores}" 0 100 scores)
+set(sample "")
+foreach(i RANGE 1 2000)
+    math(EXPR kind "${i} % 4")
+    if(kind EQUAL 3)
+        random_bases(bases 100 "1${i}")
+    else()
+        math(EXPR offset "${i} * 7919 % 49900")
+        string(SUBSTRING "${genome}" ${offset} 100 bases)
+        if(kind EQUAL 2)
+            string(SUBSTRING "${bases}" 0 50 head)
+            string(SUBSTRING "${bases}" 51 49 tail)
+            set(bases "${head}N${tail}")
+        endif()
+    endif()
+    string(APPEND sample "@sample.${i} ${i}/1\n${bases}\n+\n${scores}\n")
+endforeach()
+file(WRITE "${WORKDIR}/sample.fq" "${sample}")
+roundtrip(ref "${WORKDIR}/sample.fq" ENCRYPT -t 4 --ref "${WORKDIR}/ref.fa"
+          DECRYPT -t 4 --ref "${WORKDIR}/ref.fa")
+expect_cryfa_error("${WORKDIR}/ref_missing" "set it with \"--ref\"" -k "${PASS}" -d
+                   "${WORKDIR}/ref.enc.out")
+write_fasta("${WORKDIR}/other.fa" 3 50000)
+expect_cryfa_error("${WORKDIR}/ref_other" "is not the one" -k "${PASS}" -d
+                   --ref "${WORKDIR}/other.fa" "${WORKDIR}/ref.enc.out")
@@ -0,0 +1,70 @@
+# Reordering test: reads encrypted with their order kept, or dropped, and
+# decrypted again; and modes that do not reorder.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   PASS     – path to the key/passphrase file
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+# Records of a FASTQ, each as one element, in <var>
+function(fastq_records path var)
+    file(STRINGS "${path}" lines)
+    set(records "")
+    set(record "")
+    foreach(line ${lines})
+        string(APPEND record "${line}|")
+        string(REGEX MATCHALL "\\|" fields "${record}")
+        list(LENGTH fields n)
+        if(n EQUAL 4)
+            list(APPEND records "${record}")
+            set(record "")
+        endif()
+    endforeach()
+    set(${var} "${records}" PARENT_SCOPE)
+endfunction()
+
+# Reads of a sample: from one sequence, some with a mismatch, and from
+# elsewhere, in no order
+random_bases(genome 50000 1)
+string(REPEAT "IIII5555" 13 scores)
+string(SUBSTRING "${scores}" 0 100 scores)
+set(sample "")
+foreach(i RANGE 1 2000)
+    math(EXPR kind "${i} % 4")
+    if(kind EQUAL 3)
+        random_bases(bases 100 "1${i}")
+    else()
+        math(EXPR offset "${i} * 7919 % 49900")
+        string(SUBSTRING "${genome}" ${offset} 100 bases)
+        if(kind EQUAL 2)
+            string(SUBSTRING "${bases}" 0 50 head)
+            string(SUBSTRING "${bases}" 51 49 tail)
+            set(bases "${head}N${tail}")
+        endif()
+    endif()
+    string(APPEND sample "@sample.${i} ${i}/1\n${bases}\n+\n${scores}\n")
+endforeach()
+file(WRITE "${WORKDIR}/sample.fq" "${sample}")
+
+# Reordering: the order kept, or the same reads in another order
+roundtrip(reorder_keep "${WORKDIR}/sample.fq" ENCRYPT -t 4 --reorder keep)
+run_cryfa("${WORKDIR}/reorder_drop.enc" -k "${PASS}" -t 4 --reorder drop "${WORKDIR}/sample.fq")
+run_cryfa("${WORKDIR}/reorder_drop.dec" -k "${PASS}" -d -t 4
+          "${WORKDIR}/reorder_drop.enc.out")
+fastq_records("${WORKDIR}/sample.fq" expected)
+fastq_records("${WORKDIR}/reorder_drop.dec.out" actual)
+list(SORT expected)
+list(SORT actual)
+if(NOT expected STREQUAL actual)
+    message(FATAL_ERROR "reorder_drop: the reads differ from \"${WORKDIR}/sample.fq\"")
+endif()
+message(STATUS "reorder_drop: passed")
+
+expect_cryfa_error("${WORKDIR}/reorder_unknown" "is not a reordering mode" -k "${PASS}"
+                   --reorder shuffle "${WORKDIR}/sample.fq")
+expect_cryfa_error("${WORKDIR}/reorder_long" "cannot be combined with long-read" -k "${PASS}"
+                   --reorder keep --long "${WORKDIR}/sample.fq")
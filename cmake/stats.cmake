@@ -0,0 +1,54 @@
+# Stage counter test: --stats on encryption and decryption, its JSON read
+# back and checked against the input, which still round-trips; and stats
+# files that cannot be written.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   PASS     – path to the key/passphrase file
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+# Counter <field> of the stage <stage> in the stats file <path>, in <var>
+function(stage_counter path stage field var)
+    file(READ "${path}" json)
+    string(JSON value ERROR_VARIABLE err GET "${json}" stages ${stage} ${field})
+    if(err)
+        message(FATAL_ERROR "\"${path}\": no ${stage}.${field}: ${err}\n${json}")
+    endif()
+    set(${var} ${value} PARENT_SCOPE)
+endfunction()
+
+write_sized_fastq("${WORKDIR}/in.fq" 2097152)
+roundtrip(stats "${WORKDIR}/in.fq" ENCRYPT -t 4 --stats "${WORKDIR}/enc.json"
+          DECRYPT -t 4 --stats "${WORKDIR}/dec.json")
+
+# All of the input read, and all of the output emitted, in chunks
+stage_counter("${WORKDIR}/enc.json" read bytes read)
+stage_counter("${WORKDIR}/dec.json" emit bytes emitted)
+if(NOT read EQUAL 2097152 OR NOT emitted EQUAL 2097152)
+    message(FATAL_ERROR "stats: ${read} bytes read and ${emitted} emitted, not 2097152")
+endif()
+foreach(stage pack seal)
+    stage_counter("${WORKDIR}/enc.json" ${stage} chunks chunks)
+    if(chunks LESS 2)
+        message(FATAL_ERROR "stats: ${chunks} chunks through ${stage}, not several")
+    endif()
+endforeach()
+stage_counter("${WORKDIR}/dec.json" unpack chunks chunks)
+if(chunks LESS 2)
+    message(FATAL_ERROR "stats: ${chunks} chunks through unpack, not several")
+endif()
+file(READ "${WORKDIR}/enc.json" json)
+string(JSON wall GET "${json}" wall_seconds)
+if(NOT wall GREATER 0)
+    message(FATAL_ERROR "stats: a wall time of ${wall} seconds")
+endif()
+message(STATUS "stats_counters: passed")
+
+expect_cryfa_error("${WORKDIR}/stats_unwritable" "failed writing" -k "${PASS}"
+                   --stats "${WORKDIR}/none/stats.json" "${WORKDIR}/in.fq")
+expect_cryfa_error("${WORKDIR}/stats_directory" "failed writing" -k "${PASS}"
+                   --stats "${WORKDIR}" "${WORKDIR}/in.fq")
@@ -0,0 +1,72 @@
+# Trace test: --trace on encryption and decryption, its Chrome trace read
+# back and its spans checked, while the input still round-trips; and a trace
+# file that cannot be written.
+# Variables passed in via -D:
+#   CRYFA    – path to the cryfa executable
+#   PASS     – path to the key/passphrase file
+#   WORKDIR  – scratch directory (created fresh each run)
+
+include("${CMAKE_CURRENT_LIST_DIR}/cryfa_test.cmake")
+
+file(REMOVE_RECURSE "${WORKDIR}")
+file(MAKE_DIRECTORY "${WORKDIR}")
+
+# Check the events of the trace <path>: spans of positive durations, and
+# waits begun and ended, on more than one thread, with spans of each of the
+# stages in ARGN
+function(check_trace path)
+    file(READ "${path}" json)
+    string(JSON n ERROR_VARIABLE err LENGTH "${json}" traceEvents)
+    if(err OR n EQUAL 0)
+        message(FATAL_ERROR "\"${path}\": no trace events ${err}")
+    endif()
+    set(names "")
+    set(threads "")
+    set(async_b "")  # Ids of the waits for order, begun and ended
+    set(async_e "")
+    math(EXPR last "${n} - 1")
+    foreach(i RANGE ${last})
+        string(JSON event GET "${json}" traceEvents ${i})
+        string(JSON ph GET "${event}" ph)
+        if(ph STREQUAL "X")
+            string(JSON dur GET "${event}" dur)
+            if(dur LESS 0)
+                message(FATAL_ERROR "\"${path}\": a span of ${dur} us: ${event}")
+            endif()
+        elseif(ph STREQUAL "b" OR ph STREQUAL "e")
+            string(JSON id GET "${event}" id)
+            list(APPEND async_${ph} ${id})
+        else()
+            message(FATAL_ERROR "\"${path}\": event ${i} is not a span: ${event}")
+        endif()
+        string(JSON name GET "${event}" name)
+        string(JSON tid GET "${event}" tid)
+        list(APPEND names "${name}")
+        list(APPEND threads "${tid}")
+    endforeach()
+    list(SORT async_b)
+    list(SORT async_e)
+    if(NOT async_b STREQUAL async_e)
+        message(FATAL_ERROR "\"${path}\": waits begun and ended differ")
+    endif()
+    foreach(stage ${ARGN})
+        if(NOT stage IN_LIST names)
+            message(FATAL_ERROR "\"${path}\": no span of ${stage}")
+        endif()
+    endforeach()
+    list(REMOVE_DUPLICATES threads)
+    list(LENGTH threads n_threads)
+    if(n_threads LESS 2)
+        message(FATAL_ERROR "\"${path}\": spans of one thread only")
+    endif()
+endfunction()
+
+write_sized_fastq("${WORKDIR}/in.fq" 2097152)
+roundtrip(trace "${WORKDIR}/in.fq" ENCRYPT -t 4 --trace "${WORKDIR}/enc.trace.json"
+          DECRYPT -t 4 --trace "${WORKDIR}/dec.trace.json")
+check_trace("${WORKDIR}/enc.trace.json" read pack seal emit)
+check_trace("${WORKDIR}/dec.trace.json" read open unpack emit)
+message(STATUS "trace_spans: passed")
+
+expect_cryfa_error("${WORKDIR}/trace_unwritable" "failed writing" -k "${PASS}"
+                   --trace "${WORKDIR}/none/trace.json" "${WORKDIR}/in.fq")
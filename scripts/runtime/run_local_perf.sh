@@ -9,6 +9,8 @@ COMPARE_TO=${LOCAL_PERF_COMPARE_TO:-}
 BIN=${LOCAL_PERF_BIN:-build/cryfa}
 KEY_FILE=${LOCAL_PERF_KEY_FILE:-pass.txt}
 INPUT=${LOCAL_PERF_INPUT:-example/in.fq}
+GEN=${LOCAL_PERF_GEN:-}
+GEN_BIN=${LOCAL_PERF_GEN_BIN:-build/cryfa-gen}
 OUT_DIR=${LOCAL_PERF_OUT_DIR:-results/local_perf}
 TARGET_MB=${LOCAL_PERF_TARGET_MB:-200}
 THREADS=${LOCAL_PERF_THREADS:-1 4 8}
@@ -40,6 +42,10 @@ Options:
   --bin PATH            Cryfa binary path (default: build/cryfa)
   --key-file PATH       Key file path (default: pass.txt)
   --input PATH          Seed input or dataset path (default: example/in.fq)
+  --gen "ARGS"          Generate the dataset by cryfa-gen with ARGS instead of
+                        expanding the input, e.g. "--fasta --length 100~20 --seed 7";
+                        --target-mb sets its size, unless ARGS has --size or --reads
+  --gen-bin PATH        cryfa-gen binary path (default: build/cryfa-gen)
   --out-dir PATH        Output folder (default: results/local_perf)
   --target-mb N         Expand the seed input to at least N MiB (default: 200)
   --threads "LIST"      Thread counts to test (default: "1 4 8")
@@ -266,11 +272,59 @@ function build_run_label {
   LABEL_SAFE=$(sanitize_name "$RUN_LABEL")
 }
 
+function build_generated_dataset {
+  local -a gen_args
+  local gen_version
+  local key
+  local ext=fq
+  local tmp
+
+  read -r -a gen_args <<<"$GEN"
+  if [[ " $GEN " != *" --size "* && " $GEN " != *" --reads "* ]]; then
+    (( TARGET_MB > 0 )) || fail "--gen needs --target-mb, or --size or --reads in its arguments."
+    gen_args+=(--size "$TARGET_MB")
+  fi
+  if [[ " $GEN " == *" --fasta "* ]]; then
+    ext=fa
+  fi
+
+  gen_version=$(file_checksum "$GEN_BIN")
+  key=$(cache_key "${gen_args[*]}:${gen_version}")
+  mkdir -p "$OUT_DIR/datasets"
+  DATASET="$OUT_DIR/datasets/gen_${key}.${ext}"
+
+  if [[ -f $DATASET && -f $DATASET.meta ]] &&
+    grep -Fqx "dataset_format=gen1" "$DATASET.meta" &&
+    grep -Fqx "gen_args=${gen_args[*]}" "$DATASET.meta" &&
+    grep -Fqx "gen_checksum=$gen_version" "$DATASET.meta"; then
+    log "Reusing cached generated dataset: $DATASET ($(format_mib "$(file_size_bytes "$DATASET")") MiB)"
+    return
+  fi
+
+  tmp="$DATASET.tmp"
+  rm -f "$tmp"
+  log "Generating synthetic benchmark dataset: $GEN_BIN ${gen_args[*]}"
+  "$GEN_BIN" "${gen_args[@]}" -o "$tmp" || fail "cryfa-gen failed."
+
+  mv "$tmp" "$DATASET"
+  cat >"$DATASET.meta" <<EOF
+dataset_format=gen1
+gen_args=${gen_args[*]}
+gen_checksum=$gen_version
+EOF
+
+  log "Dataset ready: $DATASET ($(format_mib "$(file_size_bytes "$DATASET")") MiB)"
+}
+
 function build_dataset {
   local seed_bytes
   local source_path
   local source_checksum
   local source_key
+  if [[ -n $GEN ]]; then
+    build_generated_dataset
+    return
+  fi
   seed_bytes=$(file_size_bytes "$INPUT")
   source_path=$(resolve_path "$INPUT")
 
@@ -623,6 +677,14 @@ while [[ $# -gt 0 ]]; do
     INPUT=$2
     shift 2
     ;;
+  --gen)
+    GEN=$2
+    shift 2
+    ;;
+  --gen-bin)
+    GEN_BIN=$2
+    shift 2
+    ;;
   --out-dir)
     OUT_DIR=$2
     shift 2
@@ -695,7 +757,12 @@ INPUT=$(resolve_path "$INPUT")
 OUT_DIR=$(resolve_path "$OUT_DIR")
 
 require_file "$KEY_FILE" "key file"
-require_file "$INPUT" "input file"
+if [[ -n $GEN ]]; then
+  GEN_BIN=$(resolve_path "$GEN_BIN")
+  [[ -x $GEN_BIN ]] || fail "cryfa-gen binary \"$GEN_BIN\" does not exist."
+else
+  require_file "$INPUT" "input file"
+fi
 
 if [[ $INTERACTIVE == yes ]] && is_tty; then
   log "Planned benchmark settings:"
@@ -733,7 +800,11 @@ log_section "Local performance benchmark"
 log "Run label: $RUN_LABEL"
 log "Binary: $BIN"
 log "Key file: $KEY_FILE"
-log "Input: $INPUT"
+if [[ -n $GEN ]]; then
+  log "Input: cryfa-gen $GEN"
+else
+  log "Input: $INPUT"
+fi
 log "Output directory: $RUN_DIR"
 log "Requested threads: $THREADS"
 log "Runs per case: $RUNS"
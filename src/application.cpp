@@ -8,22 +8,32 @@
 
 #include "application.hpp"
 
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <filesystem>
 #include <format>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <set>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #include "assert.hpp"
+#include "memory_budget.hpp"
 #include "numeric.hpp"
+#include "output_file.hpp"
 #include "parser.hpp"
+#include "server.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
 
 namespace cryfa {
 
-// Instantiation of static variables in Param structure
-bool Param::verbose = false;
-bool Param::stop_shuffle = false;
-byte Param::n_threads = DEF_N_THR;
-std::string Param::in_file = "";
-std::string Param::key_file = "";
-char Param::format = 'n';
-
 /**
  * @brief Compress and/or shuffle + encrypt
  */
@@ -52,10 +62,11 @@ void application::exe_decrypt_decompress() {
       fa.decompress();
       break;
     case (char)126:
+    case (char)124:  // Paired
+    case (char)123:  // Long reads
       fq.decompress();
       break;
     case (char)125:
-      crypt.decrypt();
       crypt.unshuffle_file();
       break;
     default:
@@ -63,15 +74,346 @@ void application::exe_decrypt_decompress() {
   }
 }
 
+/**
+ * @brief Files of a batch or an archive to process at once: as many as the
+ *        threads, up to MAX_BATCH_JOBS, and as budgets of the smallest size fit
+ * @param par Arguments
+ * @param n_files Number of files
+ */
+static auto files_at_once(const Param& par, size_t n_files) -> size_t {
+  const size_t n_jobs = std::min<size_t>(
+      {std::max<size_t>(1, par.n_threads), MAX_BATCH_JOBS, std::max<size_t>(1, n_files)});
+  if (par.max_memory == 0) {
+    return n_jobs;
+  }
+  return std::clamp<size_t>(par.max_memory / MIN_MEMORY, 1, n_jobs);
+}
+
+/**
+ * @brief Process the files listed in the input file, up to MAX_BATCH_JOBS at
+ *        once, each on a thread of its own and with its own output, on one
+ *        pool of worker threads shared by all their pipelines. The memory
+ *        budget is split between the files in flight. After a failure, no
+ *        more files are started, and the first error is thrown once the
+ *        files running are done
+ * @param action 'c' for compress+encrypt or 'd' for decrypt+decompress
+ */
+void application::exe_batch(char action) {
+  const auto files = batch_list(par.in_file, action);
+  const char format = par.format;  // Forced, or checked for each file
+
+  ThreadPool pool(par.n_threads);
+  KeyCache keys;              // Derived once for all files
+  ReferenceCache references;  // Loaded once for all files
+
+  const size_t n_jobs = files_at_once(par, files.size());
+
+  std::mutex mutex;
+  size_t next = 0;
+  std::exception_ptr failure;
+  auto run_files = [&]() {
+    while (true) {
+      Param filePar = par;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (failure || next == files.size()) {
+          return;
+        }
+        std::tie(filePar.in_file, filePar.out_file) = files[next++];
+        std::cerr << bold("[+]") << " " << filePar.in_file << " -> " << filePar.out_file << '\n';
+      }
+      filePar.pool = &pool;
+      filePar.keys = &keys;
+      filePar.references = &references;
+      filePar.max_memory = par.max_memory / n_jobs;
+
+      try {
+        if (action == 'd') {
+          application(filePar).exe_decrypt_decompress();  // Fresh per-file state
+        } else {
+          filePar.format = format ? format : frmt(filePar.in_file, par.n_threads);
+          application(filePar).exe_compress_encrypt();
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!failure) {
+          failure = std::current_exception();
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> jobs;
+  for (size_t j = 1; j < n_jobs; ++j) {
+    jobs.emplace_back(run_files);
+  }
+  run_files();
+  for (auto& job : jobs) {
+    job.join();
+  }
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+}
+
+/**
+ * @brief New file name in the temporary directory, e.g., of TMPDIR, for the
+ *        records of an archive member
+ */
+static auto staging_path() -> std::filesystem::path {
+  std::error_code ec;
+  const auto dir = std::filesystem::temp_directory_path(ec);
+  assert_single(static_cast<bool>(ec),
+                "no temporary directory for the archive members; set TMPDIR to a writable "
+                "directory.");
+  return dir / std::format("cryfa-member-{:016x}", std::mt19937_64{std::random_device{}()}());
+}
+
+/**
+ * @brief Copy a file to an output, and remove it
+ * @param out Output
+ * @param path File
+ */
+static void append_file(OutputFile& out, const std::filesystem::path& path) {
+  std::ifstream in(path, std::ios::binary);
+  assert_single(!in, std::format("failed reading the temporary file \"{}\".", path.string()));
+  while (in) {
+    std::string block(CHUNK_TARGET_SIZE, '\0');
+    in.read(block.data(), static_cast<std::streamsize>(block.size()));
+    block.resize(static_cast<size_t>(in.gcount()));
+    if (!block.empty()) {
+      out.write(std::move(block));
+    }
+  }
+  assert_single(in.bad(), std::format("failed reading the temporary file \"{}\".", path.string()));
+  in.close();
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+}
+
+/**
+ * @brief Make the following work a member of an archive
+ * @param member Member number, from 1
+ * @param where Archive output, or location of the member in the input archive
+ */
+template <typename Where>
+void application::set_archive_member(u64 member, Where& where) {
+  crypt.set_archive_member(member, where);
+  fa.set_archive_member(member, where);
+  fq.set_archive_member(member, where);
+}
+
+/**
+ * @brief Encrypt the files listed in the input file as the members of one
+ *        archive, followed by its encrypted directory. Up to MAX_BATCH_JOBS
+ *        members are packed at once, each on a thread of its own, to a
+ *        staging file in the temporary directory; their records are sealed
+ *        for their place, so each is appended to the archive as it is, in
+ *        order, as soon as the members before it are
+ */
+void application::exe_archive() {
+  const auto files = batch_list(par.in_file, 'a');
+  const char format = par.format;  // Forced, or checked for each file
+
+  std::set<std::string> names;
+  for (const auto& [inFile, name] : files) {
+    assert_single(!valid_member_name(name),
+                  std::format("\"{}\" is not a valid archive member name.", name));
+    assert_single(!names.insert(name).second,
+                  std::format("\"{}\" is listed more than once.", name));
+  }
+
+  ThreadPool pool(par.n_threads);
+  KeyCache keys;              // Derived once for the archive and all files
+  ReferenceCache references;  // Loaded once for all files
+  crypt.keys = &keys;
+
+  const size_t n_jobs = files_at_once(par, files.size());
+  const u64 member_memory = par.max_memory / n_jobs;
+  OutputFile out(par.out_file, par.n_threads, nullptr,
+                 MemoryBudget::of(member_memory, par.n_threads).output_queue);
+  crypt.begin_archive(out);
+
+  // Staging files of the members, made by the jobs, appended by this thread
+  std::vector<std::filesystem::path> staged(files.size());
+  std::vector<char> packed(files.size(), false);
+  std::mutex mutex;
+  std::condition_variable member_packed;
+  size_t next = 0;
+  std::exception_ptr failure;
+  auto pack_members = [&]() {
+    while (true) {
+      size_t m = 0;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (failure || next == files.size()) {
+          return;
+        }
+        m = next++;
+        std::cerr << bold("[+]") << " " << files[m].first << " -> " << files[m].second << '\n';
+      }
+
+      try {
+        Param memberPar = par;
+        memberPar.pool = &pool;
+        memberPar.keys = &keys;
+        memberPar.references = &references;
+        memberPar.max_memory = member_memory;
+        memberPar.in_file = files[m].first;
+        memberPar.format = format ? format : frmt(memberPar.in_file, par.n_threads);
+        const std::filesystem::path path = staging_path();
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          staged[m] = path;
+        }
+
+        OutputFile staging(path.string(), par.n_threads, nullptr,
+                           MemoryBudget::of(member_memory, par.n_threads).output_queue);
+        application fileApp(memberPar);  // Fresh per-member state
+        fileApp.set_archive_member(m + 1, staging);
+        fileApp.exe_compress_encrypt();
+        staging.close();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        packed[m] = true;
+        member_packed.notify_all();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!failure) {
+          failure = std::current_exception();
+        }
+        member_packed.notify_all();
+      }
+    }
+  };
+
+  std::vector<std::thread> jobs;
+  for (size_t j = 0; j != n_jobs; ++j) {
+    jobs.emplace_back(pack_members);
+  }
+  std::vector<Security::ArchiveMember> members;
+  try {
+    for (size_t m = 0; m != files.size(); ++m) {
+      std::unique_lock<std::mutex> lock(mutex);
+      member_packed.wait(lock, [&]() { return failure || packed[m]; });
+      if (failure) {
+        break;
+      }
+      const std::filesystem::path path = staged[m];
+      lock.unlock();
+
+      const u64 offset = out.size();
+      append_file(out, path);
+      members.push_back({files[m].second, offset, out.size() - offset});
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!failure) {
+      failure = std::current_exception();
+    }
+  }
+  for (auto& job : jobs) {
+    job.join();
+  }
+  for (const auto& path : staged) {
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+  }
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+
+  crypt.write_archive_directory(out, members);
+  out.close();
+}
+
+/**
+ * @brief List the members of the input archive, or extract one or all of them
+ */
+void application::exe_extract() {
+  KeyCache keys;  // Derived once for the archive and all members
+  crypt.keys = &keys;
+  const auto members = crypt.read_archive_directory();
+  if (par.list_members) {
+    for (const auto& member : members) {
+      std::cout << member.name << '\t' << member.size << '\n';
+    }
+    return;
+  }
+
+  ThreadPool pool(par.n_threads);
+  ReferenceCache references;  // Loaded once for all files
+
+  assert_single(par.extract.empty() && !par.out_file.empty(),
+                "all members are extracted to files named after them; use \"--extract\" to "
+                "choose the output file of one.");
+  bool found = false;
+  for (u64 i = 0; i != members.size(); ++i) {
+    if (!par.extract.empty() && members[i].name != par.extract) {
+      continue;
+    }
+    found = true;
+
+    // All members are extracted to files named after them
+    Param memberPar = par;
+    memberPar.pool = &pool;
+    memberPar.keys = &keys;
+    memberPar.references = &references;
+    if (par.extract.empty()) {
+      assert_single(!valid_member_name(members[i].name), "corrupted file.");
+      memberPar.out_file = members[i].name;
+      std::cerr << bold("[+]") << " " << members[i].name << '\n';
+    }
+
+    application fileApp(memberPar);  // Fresh per-member state
+    fileApp.set_archive_member(i + 1, members[i]);
+    fileApp.exe_decrypt_decompress();
+  }
+  assert_single(!found, std::format("no member \"{}\" in the archive.", par.extract));
+}
+
 /**
  * @brief Execute Cryfa
  * @param argc Number of command line arguments
  * @param argv Command line arguments
  */
 void application::exe(int argc, char* argv[]) {
-  const char action = parse(par, argc, argv);
-  if (action == 'd') {
-    exe_decrypt_decompress();
+  Param args;
+  const char action = parse(args, argc, argv);
+  std::optional<Trace> trace;
+  std::optional<Stats> stats;
+  if (!args.stats_file.empty() || !args.trace_file.empty()) {
+    args.stats = &stats.emplace(args.trace_file.empty() ? nullptr : &trace.emplace());
+  }
+  application(args).run(action);
+  if (!args.stats_file.empty()) {
+    stats->write(args.stats_file);
+  }
+  if (trace) {
+    trace->write(args.trace_file);
+  }
+}
+
+/**
+ * @brief Run the job of the arguments
+ * @param action 'c' for compress+encrypt, 'd' for decrypt+decompress or 's'
+ *        for serving
+ */
+void application::run(char action) {
+  if (action == 's') {
+    Server(par).run();
+  } else if (par.batch) {
+    exe_batch(action);
+  } else if (par.archive) {
+    exe_archive();
+  } else if (action == 'd') {
+    if (crypt.is_archive()) {
+      exe_extract();
+    } else {
+      assert_single(par.list_members || !par.extract.empty(),
+                    std::format("\"{}\" is not an archive.", par.in_file));
+      exe_decrypt_decompress();
+    }
   } else if (action == 'c') {
     exe_compress_encrypt();
   }
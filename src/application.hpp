@@ -16,6 +16,10 @@
 
 namespace cryfa {
 
+/**
+ * @brief Application. Runs one job with its own arguments and state, so
+ *        several jobs can run at once in threads of one process
+ */
 class application {
   Param par;
   EnDecrypto crypt;
@@ -24,10 +28,17 @@ class application {
 
   void exe_compress_encrypt();
   void exe_decrypt_decompress();
+  void exe_batch(char);
+  void exe_archive();
+  void exe_extract();
+  template <typename Where>
+  void set_archive_member(u64, Where&);
 
  public:
   application() = default;
+  explicit application(const Param& p) : par(p), crypt(p), fa(p), fq(p) {}
   void exe(int, char**);
+  void run(char);
 };
 
 }  // namespace cryfa
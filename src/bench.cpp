@@ -0,0 +1,391 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file bench.cpp
+ * @brief Microbenchmarks of the packing, unpacking and shuffling kernels, the
+ *        ordered pipeline and the plaintext stream, on synthetic data
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>  // std::exception
+#include <format>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "assert.hpp"
+#include "def.hpp"
+#include "endecrypto.hpp"
+#include "numeric.hpp"
+#include "ordered_pipeline.hpp"
+#include "plaintext_stream.hpp"
+#include "synthetic.hpp"
+#include "time.hpp"
+using namespace cryfa;
+
+namespace {
+constexpr size_t RECORD_SIZE = 150;           // Symbols of a packed field, as a short read's
+constexpr size_t PIPELINE_CHUNK_SIZE = 1 << 16;  // Small, to show the cost per chunk
+
+struct Options {
+  size_t size = 32 << 20;  // Input bytes of each benchmark
+  size_t repeat = 3;       // Runs of each benchmark; the fastest counts
+  size_t n_threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string filter;           // Only the benchmarks whose name has it
+  std::string format = "text";  // text, csv or json
+};
+
+struct Result {
+  std::string name;
+  u64 bytes;
+  double seconds;  // Fastest run
+
+  auto mb_per_second() const -> double { return bytes / seconds / 1e6; }
+};
+
+/**
+ * @brief The kernels, which are members of EnDecrypto
+ */
+class Kernels : public EnDecrypto {
+ public:
+  explicit Kernels(const Param& par) : EnDecrypto(par) {}
+
+  using EnDecrypto::build_hash_tbl;
+  using EnDecrypto::build_unpack_tbl;
+  using EnDecrypto::pack_seq;
+  using EnDecrypto::QsMap;
+  using EnDecrypto::QSs;
+  using EnDecrypto::unpack_large;
+  using EnDecrypto::unpack_seq;
+  using Security::shuffle;
+  using Security::unshuffle;
+};
+
+/**
+ * @brief Packing of quality scores by the size of their alphabet, as
+ *        Fastq::set_packTbl_packFn() and set_unpackTbl_unpackFn() choose
+ */
+struct Variant {
+  const char* pack_name;
+  const char* unpack_name;
+  size_t n_symbols;
+  packFP_t pack;
+  unpackFP_t unpack;  // Null: unpack_large
+  u16 key_len;        // Symbols per entry of the tables
+};
+
+const Variant VARIANTS[] = {
+    {"pack_1to1", "unpack_1B/1to1", 1, &EnDecrypto::pack_1to1, &EnDecrypto::unpack_1B, 1},
+    {"pack_7to1", "unpack_1B/7to1", C1, &EnDecrypto::pack_7to1, &EnDecrypto::unpack_1B,
+     KEYLEN_C1},
+    {"pack_5to1", "unpack_1B/5to1", C2, &EnDecrypto::pack_5to1, &EnDecrypto::unpack_1B,
+     KEYLEN_C2},
+    {"pack_3to1", "unpack_1B/3to1", MAX_C3, &EnDecrypto::pack_3to1, &EnDecrypto::unpack_1B,
+     KEYLEN_C3},
+    {"pack_2to1", "unpack_1B/2to1", MAX_C4, &EnDecrypto::pack_2to1, &EnDecrypto::unpack_1B,
+     KEYLEN_C4},
+    {"pack_3to2", "unpack_2B/3to2", MAX_C5, &EnDecrypto::pack_3to2, &EnDecrypto::unpack_2B,
+     KEYLEN_C5},
+    {"pack_words", "unpack_8B/words", 94, &EnDecrypto::pack_words, &EnDecrypto::unpack_8B, 1},
+    {"pack_qL_fq", "unpack_large/qL_fq", 94, &EnDecrypto::pack_qL_fq, nullptr, KEYLEN_C5},
+};
+
+/**
+ * @brief Run a benchmark the times asked, and keep its fastest run
+ */
+void bench(const Options& opt, std::vector<Result>& results, const std::string& name, u64 bytes,
+           const std::function<void()>& run) {
+  if (!opt.filter.empty() && name.find(opt.filter) == std::string::npos) {
+    return;
+  }
+  double best = 0;
+  for (size_t r = 0; r != opt.repeat; ++r) {
+    const auto start = now();
+    run();
+    const double seconds = std::chrono::duration<double>(now() - start).count();
+    best = r == 0 ? seconds : std::min(best, seconds);
+  }
+  results.push_back(Result{name, bytes, best});
+}
+
+// Records of a field, packed one after the other, each ended by (char)254
+auto split_records(const std::string& text) -> std::vector<std::string> {
+  std::vector<std::string> records;
+  for (size_t pos = 0; pos < text.size(); pos += RECORD_SIZE) {
+    records.push_back(text.substr(pos, RECORD_SIZE));
+  }
+  return records;
+}
+
+void check_roundtrip(const std::string& name, const std::vector<std::string>& records,
+                     const std::string& unpacked) {
+  std::string joined;
+  for (const std::string& record : records) {
+    joined += record;
+  }
+  assert_single(joined != unpacked, std::format("\"{}\" does not restore its input.", name));
+}
+
+void bench_kernels(const Options& opt, std::vector<Result>& results) {
+  Param par;
+  par.key = "benchmark password";
+  par.quiet = true;
+  Kernels k(par);
+  Synthetic synth;
+
+  // Sequences
+  {
+    const std::vector<std::string> records = split_records(synth.bases(opt.size, 0.001));
+    std::string packed;
+    auto pack = [&]() {
+      packed.clear();
+      for (const std::string& record : records) {
+        k.pack_seq(packed, record);
+        packed += (char)254;
+      }
+    };
+    std::string unpacked;
+    auto unpack = [&]() {
+      unpacked.clear();
+      std::string out;
+      auto i = packed.begin();
+      for (size_t r = 0; r != records.size(); ++r, ++i) {
+        k.unpack_seq(out, i);
+        unpacked += out;
+      }
+    };
+    pack();
+    unpack();
+    check_roundtrip("pack_seq", records, unpacked);
+    bench(opt, results, "pack_seq", opt.size, pack);
+    bench(opt, results, "unpack_seq", opt.size, unpack);
+  }
+
+  // Headers and quality scores, by the size of their alphabet
+  for (const Variant& v : VARIANTS) {
+    std::string alphabet;
+    for (size_t s = 0; s != v.n_symbols; ++s) {
+      alphabet += static_cast<char>('!' + s);
+    }
+    k.QsMap.clear();
+    if (v.n_symbols <= MAX_C5) {
+      k.build_hash_tbl(k.QsMap, alphabet, v.key_len);
+    }
+
+    std::vector<std::string> table;
+    char x_char = '\0';
+    if (v.unpack) {
+      k.QSs = alphabet;
+      k.build_unpack_tbl(table, alphabet, v.key_len);
+    } else {  // The last symbols, and one after them for the others
+      k.QSs = alphabet.substr(alphabet.size() - MAX_C5);
+      k.build_unpack_tbl(table, k.QSs + (x_char = static_cast<char>(k.QSs.back() + 1)),
+                         v.key_len);
+    }
+
+    const std::vector<std::string> records = split_records(synth.symbols(opt.size, alphabet));
+    std::string packed;
+    auto pack = [&]() {
+      packed.clear();
+      for (const std::string& record : records) {
+        (k.*v.pack)(packed, record, k.QsMap);
+        packed += (char)254;
+      }
+    };
+    std::string unpacked;
+    auto unpack = [&]() {
+      unpacked.clear();
+      std::string out;
+      auto i = packed.begin();
+      for (size_t r = 0; r != records.size(); ++r, ++i) {
+        if (v.unpack) {
+          (k.*v.unpack)(out, i, table);
+        } else {
+          k.unpack_large(out, i, x_char, table);
+        }
+        unpacked += out;
+      }
+    };
+    pack();
+    unpack();
+    check_roundtrip(v.pack_name, records, unpacked);
+    bench(opt, results, v.pack_name, opt.size, pack);
+    bench(opt, results, v.unpack_name, opt.size, unpack);
+  }
+
+  // Shuffling, of whole chunks
+  {
+    const std::string text = synth.bases(opt.size);
+    std::vector<std::string> chunks;
+    for (size_t pos = 0; pos < text.size(); pos += CHUNK_TARGET_SIZE) {
+      chunks.push_back(text.substr(pos, CHUNK_TARGET_SIZE));
+    }
+    auto shuffle = [&]() {
+      for (std::string& chunk : chunks) {
+        k.shuffle(chunk);
+      }
+    };
+    auto unshuffle = [&]() {
+      for (std::string& chunk : chunks) {
+        auto i = chunk.begin();
+        k.unshuffle(i, chunk.size());
+      }
+    };
+    shuffle();
+    unshuffle();
+    assert_single(
+        [&]() {
+          std::string joined;
+          for (const std::string& chunk : chunks) {
+            joined += chunk;
+          }
+          return joined != text;
+        }(),
+        "\"shuffle\" does not restore its input.");
+    bench(opt, results, "shuffle", opt.size, shuffle);
+    bench(opt, results, "unshuffle", opt.size, unshuffle);
+  }
+}
+
+void bench_pipeline(const Options& opt, std::vector<Result>& results) {
+  const std::string text = Synthetic().bases(opt.size);
+
+  // Chunks passed through unchanged: what is left is the cost of the pipeline
+  bench(opt, results, std::format("run_ordered_pipeline/{}", opt.n_threads), opt.size, [&]() {
+    size_t pos = 0;
+    u64 emitted = 0;
+    run_ordered_pipeline<std::string>(
+        opt.n_threads,
+        [&]() -> std::optional<std::string> {
+          if (pos >= text.size()) {
+            return std::nullopt;
+          }
+          std::string chunk = text.substr(pos, PIPELINE_CHUNK_SIZE);
+          pos += chunk.size();
+          return chunk;
+        },
+        [](std::string chunk) { return chunk; },
+        [&](std::string chunk) { emitted += chunk.size(); });
+    assert_single(emitted != text.size(), "\"run_ordered_pipeline\" lost chunks.");
+  });
+
+  // Decrypted records handed to the unpacking, as by Security::decrypt_stream()
+  bench(opt, results, "PlaintextStream", opt.size, [&]() {
+    PlaintextStream plaintext;
+    std::thread producer([&]() {
+      for (size_t pos = 0; pos < text.size(); pos += PIPELINE_CHUNK_SIZE) {
+        plaintext.push(std::string_view(text).substr(pos, PIPELINE_CHUNK_SIZE));
+      }
+      plaintext.close();
+    });
+    u64 received = 0;
+    for (std::string chunk; plaintext.read_bytes(CHUNK_TARGET_SIZE, chunk) || !chunk.empty();) {
+      received += chunk.size();
+    }
+    producer.join();
+    assert_single(received != text.size(), "\"PlaintextStream\" lost bytes.");
+  });
+}
+
+void report(const Options& opt, const std::vector<Result>& results) {
+  if (opt.format == "csv") {
+    std::cout << "kernel,bytes,seconds,mb_per_second\n";
+    for (const Result& r : results) {
+      std::cout << std::format("{},{},{:.6f},{:.3f}\n", r.name, r.bytes, r.seconds,
+                               r.mb_per_second());
+    }
+  } else if (opt.format == "json") {
+    std::cout << "[";
+    const char* separator = "\n";
+    for (const Result& r : results) {
+      std::cout << std::format(
+          "{}  {{\"kernel\": \"{}\", \"bytes\": {}, \"seconds\": {:.6f}, \"mb_per_second\": "
+          "{:.3f}}}",
+          separator, r.name, r.bytes, r.seconds, r.mb_per_second());
+      separator = ",\n";
+    }
+    std::cout << "\n]\n";
+  } else {
+    std::cout << std::format("{:<28}{:>12}{:>12}\n", "kernel", "seconds", "MB/s");
+    for (const Result& r : results) {
+      std::cout << std::format("{:<28}{:>12.4f}{:>12.1f}\n", r.name, r.seconds,
+                               r.mb_per_second());
+    }
+  }
+}
+
+void usage() {
+  std::cerr << "Usage: cryfa_bench [--size MB] [--repeat N] [--threads N] [--filter NAME]\n"
+               "                   [--format text|csv|json]\n"
+               "\n"
+               "  --size MB      input of each benchmark, in MiB (default: 32)\n"
+               "  --repeat N     runs of each benchmark; the fastest counts (default: 3)\n"
+               "  --threads N    threads of the ordered pipeline (default: all cores)\n"
+               "  --filter NAME  only the benchmarks whose name has NAME\n"
+               "  --format F     output as a table, CSV or JSON (default: text)\n";
+}
+
+auto parse(int argc, char* argv[]) -> std::optional<Options> {
+  Options opt;
+  for (int a = 1; a != argc; ++a) {
+    const std::string arg = argv[a];
+    if (arg == "-h" || arg == "--help") {
+      usage();
+      return std::nullopt;
+    }
+    assert_single(a + 1 == argc, std::format("no value has been set for \"{}\".", arg));
+    const std::string value = argv[++a];
+    auto number = [&]() -> size_t {
+      assert_single(!is_number(value) || std::stoull(value) == 0,
+                    std::format("\"{}\" needs a positive number.", arg));
+      return std::stoull(value);
+    };
+    if (arg == "--size") {
+      opt.size = number() << 20;
+    } else if (arg == "--repeat") {
+      opt.repeat = number();
+    } else if (arg == "--threads") {
+      opt.n_threads = number();
+    } else if (arg == "--filter") {
+      opt.filter = value;
+    } else if (arg == "--format") {
+      assert_single(value != "text" && value != "csv" && value != "json",
+                    std::format("\"{}\" is not a format; use text, csv or json.", value));
+      opt.format = value;
+    } else {
+      error(std::format("\"{}\" is not an option.", arg));
+    }
+  }
+  return opt;
+}
+}  // namespace
+
+/**
+ * @brief Run the benchmarks
+ * @param argc Number of command line arguments
+ * @param argv Command line arguments
+ * @return SUCCESS or FAILURE
+ */
+int main(int argc, char* argv[]) {
+  try {
+    const std::optional<Options> opt = parse(argc, argv);
+    if (!opt) {
+      return 0;
+    }
+    std::vector<Result> results;
+    bench_kernels(*opt, results);
+    bench_pipeline(*opt, results);
+    report(*opt, results);
+  } catch (std::exception& e) {
+    std::cerr << e.what();
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+}
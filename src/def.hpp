@@ -61,13 +61,21 @@ struct POWER<B, 0> {
 static const std::string THR_ID_HDR = "THRD=";        // Thread ID header
 static const std::string PK_FNAME = "CRYFA_PK";       // Packed file name
 static const std::string PCKD_FNAME = "CRYFA_PCKD";   // Packed file name - joined
-static const std::string SH_FNAME = "CRYFA_SH";       // Shuffled file name
 static const std::string DEC_FNAME = "CRYFA_DEC";     // Decrypted file name
 static const std::string UPK_FNAME = "CRYFA_UPK";     // Unpacked file name
-static const std::string USH_FNAME = "CRYFA_USH";     // Unshuffled file name
 constexpr byte DEF_N_THR = 8;                         // Default number of threads
 constexpr u64 IO_BUFFER_SIZE = 8ULL * 1024ULL;        // Buffered output writes
+constexpr u64 OUTPUT_BUFFER_SIZE = 1024ULL * 1024ULL; // Output writer staging buffer
 constexpr u64 CHUNK_TARGET_SIZE = 1024ULL * 1024ULL;  // Internal worker chunk target
+constexpr u64 FALLOC_SIZE = 64 * CHUNK_TARGET_SIZE;   // Output file preallocation step
+constexpr u64 LONG_PART_SIZE = 420 * 624;             // Long read part: ~1/4 chunk, tuple-aligned
+constexpr u64 SORT_RUN_SIZE = 256 * CHUNK_TARGET_SIZE;  // Memory for sorting before a spill
+constexpr u64 HDR_DICT_SAMPLE = 4 * CHUNK_TARGET_SIZE;  // Input to train the header dictionary on
+constexpr byte MAX_HDR_TOKENS = 64;                   // Header dictionary: codes 128..191
+constexpr size_t MAX_SERVE_JOBS = 256;                // Jobs of the daemon running at once
+constexpr size_t MAX_BATCH_JOBS = 8;                  // Files of a batch processed at once
+constexpr u64 SERVE_MAX_INPUT = 1024 * CHUNK_TARGET_SIZE;  // Input of a daemon job, by default
+constexpr u64 SERVE_MAX_TOTAL_INPUT = 4 * SERVE_MAX_INPUT;  // Of all its jobs at once
 constexpr byte C1 = 2;                                // Cat 1 = 2
 constexpr byte C2 = 3;                                // Cat 2 = 3
 constexpr byte MIN_C3 = 4;                            // 4 <= Cat 3 <= 6
@@ -84,14 +92,45 @@ constexpr byte KEYLEN_C4 = 2;  // 2 to 1 byte
 constexpr byte KEYLEN_C5 = 3;  // 3 to 2 byte
 constexpr int TAG_SIZE = 12;   // GCC mode auth enc
 
-/** @brief Command line input arguments */
+class ThreadPool;
+class KeyCache;
+class ReferenceCache;
+class Stats;
+
+/**
+ * @brief Command line input arguments. Each job has its own copy, so jobs
+ *        with different arguments can run at once in one process
+ */
 struct Param {
-  static bool verbose;          // Verbose mode
-  static bool stop_shuffle;     // Disable shuffling
-  static byte n_threads;        // Number of threads
-  static std::string in_file;   // Input file name
-  static std::string key_file;  // Password file name
-  static char format;           // Format of the input file
+  bool verbose = false;        // Verbose mode
+  bool stop_shuffle = false;   // Disable shuffling
+  bool bgzf = false;           // BGZF-compressed output on decompression
+  bool batch = false;          // Input file lists the files to process
+  bool archive = false;        // Input file lists the members of an archive
+  bool list_members = false;   // List the members of an input archive
+  bool long_reads = false;     // Long-read FASTQ mode
+  bool quiet = false;          // No progress messages
+  byte n_threads = DEF_N_THR;  // Number of threads
+  ThreadPool* pool = nullptr;  // Worker threads of the pipelines -- null: threads of their own
+  KeyCache* keys = nullptr;    // Keys derived by earlier jobs -- null: derive for this job
+  // References loaded by earlier jobs -- null: load for this job
+  ReferenceCache* references = nullptr;
+  Stats* stats = nullptr;      // Counters of the stages -- null: not counted
+  u64 max_memory = 0;          // Bytes the job's buffers may take -- 0: no budget
+  u64 max_input = 0;           // Bytes of input of a daemon job -- 0: no limit
+  u64 max_total_input = 0;     // Of all jobs of the daemon at once -- 0: no limit
+  std::string in_file;         // Input file name
+  std::string key_file;        // Password file name
+  std::string key;             // Password itself -- empty: read from key_file
+  std::string out_file;        // Output file name -- empty: standard output
+  std::string paired_file;     // Mates of the reads: input, or output on decryption
+  std::string extract;         // Archive member to extract -- empty: all
+  std::string qbin;            // Quality score binning scheme -- empty: none
+  std::string ref_file;        // Reference FASTA to map FASTQ reads on -- empty: none
+  std::string reorder;         // Reorder reads, "keep" or "drop" their order -- empty: no
+  std::string stats_file;      // JSON file of the counters of the stages -- empty: none
+  std::string trace_file;      // Chrome trace of the spans of the stages -- empty: none
+  char format = 'n';           // Format of the input file
 };
 }  // namespace cryfa
 
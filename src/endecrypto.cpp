@@ -11,22 +11,28 @@
 #include <algorithm>
 #include <array>
 #include <cmath>  // std::pow
+#include <deque>
 #include <format>
 #include <fstream>
 #include <functional>
 #include <iomanip>  // setw, std::setprecision
 #include <limits>
 #include <mutex>
+#include <optional>
+#include <stdexcept>
 #include <thread>
 #include <vector>
 
 #include "assert.hpp"
 #include "file.hpp"
+#include "gzip.hpp"
+#include "numeric.hpp"
+#include "ordered_pipeline.hpp"
+#include "output_file.hpp"
+#include "plaintext_stream.hpp"
 #include "time.hpp"
 using namespace cryfa;
 
-std::mutex mutxEnDe;
-
 namespace {
 constexpr u16 INVALID_RANK = std::numeric_limits<u16>::max();
 
@@ -56,14 +62,21 @@ auto build_dense_lookup(const std::string& alphabet, bool with_extra) -> DenseLo
   return lookup;
 }
 
+// Lookups of the recent alphabets of a thread. Bounded, as pool threads serve
+// job after job; the returned lookup is only used before the next call
+constexpr size_t MAX_DENSE_LOOKUPS = 16;
+
 auto dense_lookup(const std::string& alphabet, bool with_extra = false) -> const DenseLookup& {
-  thread_local std::vector<DenseLookup> cache;
+  thread_local std::deque<DenseLookup> cache;
   for (const DenseLookup& lookup : cache) {
     if (lookup.with_extra == with_extra && lookup.alphabet == alphabet) {
       return lookup;
     }
   }
 
+  if (cache.size() == MAX_DENSE_LOOKUPS) {
+    cache.pop_front();
+  }
   cache.push_back(build_dense_lookup(alphabet, with_extra));
   return cache.back();
 }
@@ -98,6 +111,20 @@ auto large_tuple_index(const DenseLookup& lookup, char s0, char s1, char s2, boo
   return static_cast<u16>((r0 * lookup.base + r1) * lookup.base + r2);
 }
 
+// Mixed-radix words: k symbols in 8 bytes, with the first byte below 252, so
+// that markers 252..255 only show up between words
+constexpr size_t WORD_BYTES = 8;
+constexpr u64 WORD_LIMIT = 252ULL << 56;
+constexpr size_t MAX_WORD_SYMBOLS = 64;
+
+auto word_symbols(u64 base) -> size_t {
+  size_t k = 0;
+  for (u64 max = 1; k != MAX_WORD_SYMBOLS && max <= WORD_LIMIT / base; max *= base) {
+    ++k;
+  }
+  return k;
+}
+
 auto dna_rank_or_x(char c, bool& not_in) -> byte {
   not_in = false;
   switch (c) {
@@ -534,6 +561,34 @@ void EnDecrypto::pack_1to1(std::string& packed, const std::string& strIn, const
   }
 }
 
+/**
+ * @brief Encapsulate k symbols in an 8-byte mixed-radix word, when # > 39.
+ *        No escapes, e.g., 9 symbols in 8 bytes when # = 94
+ * @param[out] packed Packed string
+ * @param strIn Input string
+ * @param map Hash table
+ */
+void EnDecrypto::pack_words(std::string& packed, const std::string& strIn, const htbl_t& map) {
+  const DenseLookup& lookup = dense_lookup((&map == &QsMap) ? QSs : Hdrs);
+  const size_t k = word_symbols(lookup.base);
+  const size_t n_words = strIn.size() / k;
+
+  const size_t begin = packed.size();
+  packed.resize(begin + WORD_BYTES * n_words);
+  auto out = reinterpret_cast<byte*>(packed.data() + begin);
+  for (size_t w = 0; w != n_words; ++w, out += WORD_BYTES) {
+    u64 word = 0;
+    for (size_t s = 0; s != k; ++s) {
+      word = word * lookup.base + checked_rank(lookup, strIn[w * k + s]);
+    }
+    for (size_t b = WORD_BYTES; b--; word >>= 8) {  // Big endian: the first byte < 252
+      out[b] = static_cast<byte>(word);
+    }
+  }
+
+  append_penalty_tail(packed, strIn, n_words * k);
+}
+
 /**
  * @brief Penalty symbol
  * @param c Input char
@@ -657,6 +712,38 @@ void EnDecrypto::unpack_1B(std::string& out, std::string::iterator& i,
   }
 }
 
+/**
+ * @brief Unpack by reading 8-byte mixed-radix words, when # > 39
+ * @param[out] out Unpacked string
+ * @param i Input string iterator
+ * @param unpack Symbols
+ */
+void EnDecrypto::unpack_8B(std::string& out, std::string::iterator& i,
+                           const std::vector<std::string>& unpack) {
+  out.clear();
+  const u64 base = unpack.size();
+  const size_t k = word_symbols(base);
+  char symbols[MAX_WORD_SYMBOLS];
+
+  while (*i != (char)254) {
+    // Len not multiple of k
+    if (*i == (char)255) {
+      out += penalty_sym(*(i + 1));
+      i += 2;
+      continue;
+    }
+
+    u64 word = 0;
+    for (size_t b = 0; b != WORD_BYTES; ++b, ++i) {
+      word = word << 8 | (byte)*i;
+    }
+    for (size_t s = k; s--; word /= base) {
+      symbols[s] = unpack[word % base].front();
+    }
+    out.append(symbols, k);
+  }
+}
+
 /**
  * @brief Unpack 1 byte to 3 DNA bases
  * @param[out] out DNA bases
@@ -709,175 +796,163 @@ void EnDecrypto::unpack_seq(std::string& out, std::string::iterator& i) {
 }
 
 /**
- * @brief Shuffle a file (not FASTA/FASTQ)
+ * @brief Shuffle + encrypt a file (not FASTA/FASTQ). Shuffled chunks are
+ *        written with their sizes, as they vary, and unshuffling needs them
  */
 void EnDecrypto::shuffle_file() {
-  std::cerr << "\"" << file_name(in_file) << "\" isn't FASTA/FASTQ. We just encrypt it.\n";
-
-  if (!stop_shuffle) {
-    const auto start = now();  // Start timer
-    std::vector<std::thread> arrThread(n_threads);
-
-    // Distribute file among threads, for shuffling
-    for (byte t = 0; t != n_threads; ++t) {
-      arrThread[t] = std::thread(&EnDecrypto::shuffle_block, this, t);
-    }
-    for (auto& thr : arrThread) {
-      if (thr.joinable()) thr.join();
-    }
-
-    // Join partially shuffled files
-    join_shuffled_files();
-
-    const auto finish = now();  // Stop timer
-    std::cerr << "\r" << bold("[+]") << " Shuffling done in " << hms(finish - start);
-  } else {
-    std::ifstream inFile(in_file);
-    std::ofstream pckdFile(PCKD_FNAME);
-
-    pckdFile << (char)125 << (!stop_shuffle ? (char)128 : (char)129);
-    pckdFile << inFile.rdbuf();
-
-    inFile.close();
-    pckdFile.close();
-  }
-
-  // Cout encrypted content
-  encrypt();
-}
-
-/**
- * @brief Shuffle a block of file
- * @param threadID Thread ID
- */
-void EnDecrypto::shuffle_block(byte threadID) {
-  std::ifstream in(in_file);
-  std::ofstream shfile(std::format("{}{}", SH_FNAME, static_cast<unsigned>(threadID)),
-                       std::ios_base::app);
-  // Characters ignored at the beginning
-  in.ignore((std::streamsize)(threadID * CHUNK_TARGET_SIZE));
-
-  for (char c; in.peek() != EOF;) {
-    std::string context;
-    context.reserve(CHUNK_TARGET_SIZE);
-    for (u64 bs = CHUNK_TARGET_SIZE; bs--;) {
-      if (in.get(c)) {
-        context += c;
-      }
+  progress() << "\"" << file_name(in_file) << "\" isn't FASTA/FASTQ. We just encrypt it.\n";
+  const auto start = now();  // Start timer
+
+  ChunkSizer sizer = chunk_sizer();
+  auto read_chunk = [in = open_in(in_file, false),
+                     &sizer]() mutable -> std::optional<std::string> {
+    std::string chunk(sizer.target(), '\0');
+    in->read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    chunk.resize(static_cast<size_t>(in->gcount()));
+    if (chunk.empty()) {
+      return std::nullopt;
     }
+    return chunk;
+  };
 
-    // Shuffle
+  auto shuffle_chunk = [this](std::string chunk) {
     if (!stop_shuffle) {
-      mutxEnDe.lock();  //--------------------------------------------------
+      mutxShuff.lock();  //-------------------------------------------------
       if (shuffInProg) {
-        std::cerr << bold("[+]") << " Shuffling ...";
+        progress() << bold("[+]") << " Shuffling ...";
         shuffle_timer = now();
       }
       shuffInProg = false;
-      mutxEnDe.unlock();  //------------------------------------------------
+      mutxShuff.unlock();  //-----------------------------------------------
 
-      shuffle(context);
+      shuffle(chunk);
+      std::string packed = std::format("{}{}", chunk.size(), (char)254);
+      packed += chunk;
+      return packed;
     }
+    return chunk;
+  };
 
-    // Write header containing threadID for each partially shuffled file
-    shfile << std::format("{}{}\n", THR_ID_HDR, static_cast<unsigned>(threadID));
-    shfile << context << '\n';
+  encrypt_stream([&](RecordSink& records) {
+    std::string header;
+    header += (char)125;
+    header += (!stop_shuffle ? (char)130 : (char)129);  // 130: shuffled, in sized chunks
+    records.emit(header);
 
-    // Ignore to go to the next related chunk
-    in.ignore((std::streamsize)((n_threads - 1) * CHUNK_TARGET_SIZE));
-  }
-  shfile.close();
+    records.run_pipeline<std::string>(n_threads, read_chunk, shuffle_chunk, &sizer);
+
+    if (!stop_shuffle) {
+      const auto finish = now();  // Stop timer
+      progress() << "\r" << bold("[+]") << " Shuffling done in " << hms(finish - start);
+    }
+  });
 }
 
 /**
- * @brief Unshuffle a file (not FASTA/FASTQ)
+ * @brief Decrypt + unshuffle a file (not FASTA/FASTQ)
  */
 void EnDecrypto::unshuffle_file() {
-  std::ifstream in(DEC_FNAME);
-  in.ignore(1);
-  char c;
-  in.get(c);
-  if (c == (char)128) {
-    in.close();
-
-    const auto start = now();  // Start timer
-    std::vector<std::thread> arrThread(n_threads);
-
-    // Distribute file among threads, for unshuffling
-    for (byte t = 0; t != n_threads; ++t) {
-      arrThread[t] = std::thread(&EnDecrypto::unshuffle_block, this, t);
-    }
-    for (auto& thr : arrThread) {
-      if (thr.joinable()) {
-        thr.join();
-      }
+  const auto start = now();  // Start timer
+
+  const MemoryBudget budget = memory();
+  PlaintextStream plaintext(stats, budget.plaintext_buffer);
+  std::exception_ptr decrypt_error;
+  std::thread decrypt_thread([&]() {
+    try {
+      decrypt_stream([&](std::string_view decrypted) { plaintext.push(decrypted); });
+      plaintext.close();
+    } catch (...) {
+      decrypt_error = std::current_exception();
+      plaintext.fail(decrypt_error);
     }
+  });
 
-    // Delete decrypted file
-    std::remove(DEC_FNAME.c_str());
-
-    // Join partially unshuffled files
-    join_unshuffled_files();
-
-    const auto finish = now();  // Stop timer
-    std::cerr << "\r" << bold("[+]") << " Unshuffling done in " << hms(finish - start);
-  } else if (c == (char)129) {
-    std::cout << in.rdbuf();
-
-    in.close();
-    std::remove(DEC_FNAME.c_str());
-  } else {
-    std::cerr << bold("Error:", "red") << " file corrupted.";
-    in.close();
-  }
-}
-
-/**
- * @brief Unshuffle a block of file
- * @param threadID Thread ID
- */
-void EnDecrypto::unshuffle_block(byte threadID) {
-  std::ifstream in(DEC_FNAME);
-  std::ofstream ushfile(std::format("{}{}", USH_FNAME, static_cast<unsigned>(threadID)),
-                        std::ios_base::app);
-
-  // filetype char (125) + shuffed (128) + characters ignored at the beginning
-  in.ignore((std::streamsize)(2 + threadID * CHUNK_TARGET_SIZE));
-
-  for (char c; in.peek() != EOF;) {
-    std::string unshText;
-    unshText.reserve(CHUNK_TARGET_SIZE);
-    for (u64 bs = CHUNK_TARGET_SIZE; bs--;) {
-      if (in.get(c)) {
-        unshText += c;
-      }
+  auto join_decrypt = [&]() {
+    if (decrypt_thread.joinable()) {
+      decrypt_thread.join();
+    }
+    if (decrypt_error) {
+      std::rethrow_exception(decrypt_error);
     }
+  };
 
-    auto i = unshText.begin();
+  try {
+    const auto file_type = plaintext.get();
+    if (!file_type || *file_type != (char)125) {
+      throw std::runtime_error("corrupted file.");
+    }
 
-    // Unshuffle
-    if (shuffled) {
-      mutxEnDe.lock();  //--------------------------------------------------
-      if (shuffInProg) {
-        std::cerr << bold("[+]") << " Unshuffling ...";
-        shuffle_timer = now();
+    // 128: shuffled, in chunks of CHUNK_TARGET_SIZE, 129: not shuffled,
+    // 130: shuffled, each chunk after its size
+    const auto shuffle_flag = plaintext.get();
+    if (!shuffle_flag || (*shuffle_flag != (char)128 && *shuffle_flag != (char)129 &&
+                          *shuffle_flag != (char)130)) {
+      throw std::runtime_error("corrupted file.");
+    }
+    shuffled = (*shuffle_flag != (char)129);  // Check if file had been shuffled
+    const bool sized = (*shuffle_flag == (char)130);
+
+    auto read_chunk = [&]() -> std::optional<std::string> {
+      std::string chunk;
+      if (sized) {
+        std::string chunk_size_str;
+        if (!plaintext.read_until((char)254, chunk_size_str)) {
+          if (!chunk_size_str.empty()) {
+            throw std::runtime_error("corrupted file.");
+          }
+          return std::nullopt;
+        }
+        if (chunk_size_str.empty() || !is_number(chunk_size_str) ||
+            !plaintext.read_bytes(std::stoull(chunk_size_str), chunk)) {
+          throw std::runtime_error("corrupted file.");
+        }
+        return chunk;
       }
-      shuffInProg = false;
-      mutxEnDe.unlock();  //------------------------------------------------
+      if (!plaintext.read_bytes(CHUNK_TARGET_SIZE, chunk) && chunk.empty()) {
+        return std::nullopt;
+      }
+      return chunk;
+    };
+
+    auto unshuffle_chunk = [this](std::string chunk) {
+      if (shuffled) {
+        mutxShuff.lock();  //-----------------------------------------------
+        if (shuffInProg) {
+          progress() << bold("[+]") << " Unshuffling ...";
+          shuffle_timer = now();
+        }
+        shuffInProg = false;
+        mutxShuff.unlock();  //---------------------------------------------
 
-      unshuffle(i, unshText.size());
+        auto i = chunk.begin();
+        unshuffle(i, chunk.size());
+      }
+      return chunk;
+    };
+
+    OutputFile out(out_file, n_threads, out_sink, budget.output_queue);
+    run_ordered_pipeline<std::string>(
+        n_threads, read_chunk, bgzf_output(bgzf, unshuffle_chunk),
+        [&](std::string output) { out.write(std::move(output)); }, pool,
+        {stats, Stage::plaintext_pull, Stage::none}, budget);
+    if (bgzf) {
+      out.write(bgzf_eof());
     }
+    out.close();
+  } catch (...) {
+    plaintext.fail(std::current_exception());
+    if (decrypt_thread.joinable()) {
+      decrypt_thread.join();
+    }
+    throw;
+  }
 
-    // Write header containing threadID for each partially unshuffled file
-    ushfile << std::format("{}{}\n", THR_ID_HDR, static_cast<unsigned>(threadID));
-    ushfile << unshText << '\n';
+  join_decrypt();
 
-    // Ignore to go to the next related chunk
-    in.ignore((std::streamsize)((n_threads - 1) * CHUNK_TARGET_SIZE));
+  if (shuffled) {
+    const auto finish = now();  // Stop timer
+    progress() << "\r" << bold("[+]") << " Unshuffling done in " << hms(finish - start);
   }
-
-  ushfile.close();
-  in.close();
 }
 
 /**
@@ -1002,97 +1077,3 @@ void EnDecrypto::join_unpacked_files() const {
     std::remove(upkdFileName.c_str());
   }
 }
-
-/**
- * @brief Join partially shuffled files
- */
-void EnDecrypto::join_shuffled_files() const {
-  std::vector<std::ifstream> shFile(n_threads);
-  std::ofstream shdFile(PCKD_FNAME);  // Output Shuffled file
-  std::string content;
-  content.reserve(IO_BUFFER_SIZE);
-  auto write_content = [&]() { shdFile << content; };
-
-  content += (char)125;
-  content += (!stop_shuffle ? (char)128 : (char)129);
-
-  // Input files
-  for (byte t = n_threads; t--;) {
-    shFile[t].open(std::format("{}{}", SH_FNAME, static_cast<unsigned>(t)));
-  }
-
-  while (!shFile[0].eof()) {
-    for (byte t = 0; t != n_threads; ++t) {
-      bool prevLineNotThrID = false;  // If previous line was "THR=" or not
-
-      for (std::string line; std::getline(shFile[t], line).good() &&
-                             line != std::format("{}{}", THR_ID_HDR, static_cast<unsigned>(t));) {
-        if (prevLineNotThrID) {
-          content += '\n';
-        }
-        content += line;
-
-        if (content.size() >= IO_BUFFER_SIZE) {
-          write_content();
-          content.clear();
-          content.reserve(IO_BUFFER_SIZE);
-        }
-
-        prevLineNotThrID = true;
-      }
-    }
-  }
-  write_content();
-
-  // Close/delete input/output files
-  shdFile.close();
-  for (byte t = n_threads; t--;) {
-    shFile[t].close();
-    std::string shFileName = std::format("{}{}", SH_FNAME, static_cast<unsigned>(t));
-    std::remove(shFileName.c_str());
-  }
-}
-
-/**
- * @brief Join partially unshuffled files
- */
-void EnDecrypto::join_unshuffled_files() const {
-  byte t;  // For threads
-  std::vector<std::ifstream> ushdFile(n_threads);
-  for (t = n_threads; t--;) {
-    ushdFile[t].open(std::format("{}{}", USH_FNAME, static_cast<unsigned>(t)));
-  }
-  std::string content;
-  content.reserve(IO_BUFFER_SIZE);
-  auto write_content = [&]() { std::cout << content; };
-
-  while (!ushdFile[0].eof()) {
-    for (t = 0; t != n_threads; ++t) {
-      bool prevLineNotThrID = false;  // If previous line was "THR=" or not
-
-      for (std::string line; std::getline(ushdFile[t], line).good() &&
-                             line != std::format("{}{}", THR_ID_HDR, static_cast<unsigned>(t));) {
-        if (prevLineNotThrID) {
-          content += '\n';
-        }
-        content += line;
-
-        if (content.size() >= IO_BUFFER_SIZE) {
-          write_content();
-          content.clear();
-          content.reserve(IO_BUFFER_SIZE);
-        }
-
-        prevLineNotThrID = true;
-      }
-    }
-  }
-  write_content();
-
-  // Close/delete input/output files
-  for (t = n_threads; t--;) {
-    ushdFile[t].close();
-    std::string ushdFileName = std::format("{}{}", USH_FNAME, static_cast<unsigned>(t));
-    std::remove(ushdFileName.c_str());
-  }
-}
@@ -28,6 +28,7 @@ typedef void (EnDecrypto::*unpackFP_t)(std::string&, std::string::iterator&,
 class EnDecrypto : public Security {
  public:
   EnDecrypto() = default;
+  explicit EnDecrypto(const Param& par) : Security(par) {}
 
   void pack_hL_fa_fq(std::string&, const std::string&, const htbl_t&);
   void pack_qL_fq(std::string&, const std::string&, const htbl_t&);
@@ -37,8 +38,10 @@ class EnDecrypto : public Security {
   void pack_5to1(std::string&, const std::string&, const htbl_t&);
   void pack_7to1(std::string&, const std::string&, const htbl_t&);
   void pack_1to1(std::string&, const std::string&, const htbl_t&);
+  void pack_words(std::string&, const std::string&, const htbl_t&);
   void unpack_2B(std::string&, std::string::iterator&, const std::vector<std::string>&);
   void unpack_1B(std::string&, std::string::iterator&, const std::vector<std::string>&);
+  void unpack_8B(std::string&, std::string::iterator&, const std::vector<std::string>&);
   void shuffle_file();
   void unshuffle_file();
 
@@ -59,14 +62,10 @@ class EnDecrypto : public Security {
   void unpack_large(std::string&, std::string::iterator&, char, const std::vector<std::string>&);
   void join_packed_files(const std::string&, const std::string&, char, bool) const;
   void join_unpacked_files() const;
-  void join_shuffled_files() const;
-  void join_unshuffled_files() const;
 
  private:
   void pack_large(std::string&, const std::string&, const std::string&, const htbl_t&);
   auto penalty_sym(char) const -> char;
-  void shuffle_block(byte);
-  void unshuffle_block(byte);
 };
 
 /**
@@ -8,6 +8,7 @@
 
 #include "fasta.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <exception>
 #include <format>
@@ -19,22 +20,23 @@
 #include <thread>
 #include <vector>
 
+#include "gzip.hpp"
 #include "ordered_pipeline.hpp"
+#include "output_file.hpp"
 #include "plaintext_stream.hpp"
 #include "string.hpp"
 #include "time.hpp"
 using namespace cryfa;
 
-std::mutex mutxFA;
-
 namespace {
 struct FastaRecord {
-  std::string header;
+  std::string header;  // Empty: the sequence of the last chunk's last record goes on
   std::vector<std::string> sequence_lines;
 };
 
 struct FastaChunk {
   std::vector<FastaRecord> records;
+  u64 bytes = 0;  // Size of the records in the input
 };
 }  // namespace
 
@@ -42,65 +44,88 @@ struct FastaChunk {
  * @brief Compress
  */
 void Fasta::compress() {
-  if (!verbose) {
-    std::cerr << bold("[+]") << " Compacting ...";
-  }
   const auto start = now();  // Start timer
 
   std::string headers;
   packfa_s pkStruct;  // Collection of inputs to pass to pack...
 
   if (verbose) {
-    std::cerr << bold("[+]") << " Calculating no. unique characters ...";
+    progress() << bold("[+]") << " Calculating no. unique characters ...";
+  }
+  // Gather different chars in all headers and max length in all bases. Files
+  // the format cannot hold are encrypted as they are
+  if (!gather_h_bs(headers)) {
+    if (verbose) {
+      progress() << "\n";
+    }
+    shuffle_file();
+    return;
+  }
+  if (!verbose) {
+    progress() << bold("[+]") << " Compacting ...";
   }
-  // Gather different chars in all headers and max length in all bases
-  gather_h_bs(headers);
   // Show number of different chars in headers -- ignore '>'=62
   if (verbose) {
-    std::cerr << "\r" << bold("[+]") << " No. unique characters: headers => " << headers.length()
+    progress() << "\r" << bold("[+]") << " No. unique characters: headers => " << headers.length()
               << "   \n";
   }
 
   // Set Hash table and pack function
   set_hashTbl_packFn(pkStruct, headers);
 
-  auto read_chunk = [this, in = std::ifstream(in_file),
-                     pending_header = std::string{}]() mutable -> std::optional<FastaChunk> {
+  ChunkSizer sizer = chunk_sizer();
+  // A header, or a line of a sequence cut at the end of the last chunk
+  auto read_chunk = [in = open_in(in_file), pending = std::string{},
+                     &sizer]() mutable -> std::optional<FastaChunk> {
+    const u64 chunk_size = sizer.target();
     FastaChunk chunk;
     std::string line;
-    u64 chunk_bytes = 0;
 
-    if (pending_header.empty()) {
-      while (std::getline(in, line)) {
+    if (pending.empty()) {
+      while (std::getline(*in, line)) {
         if (!line.empty() && line.front() == '>') {
-          pending_header = std::move(line);
+          pending = std::move(line);
           break;
         }
       }
     }
 
-    if (pending_header.empty()) {
+    if (pending.empty()) {
       return std::nullopt;
     }
 
-    while (!pending_header.empty()) {
+    while (!pending.empty()) {
       FastaRecord record;
-      record.header = std::move(pending_header);
-      pending_header.clear();
-      chunk_bytes += record.header.size() + 1;
+      if (pending.front() == '>') {
+        record.header = std::move(pending);
+        chunk.bytes += record.header.size() + 1;
+      } else {  // The rest of the sequence goes on, without a header
+        chunk.bytes += pending.size() + 1;
+        record.sequence_lines.push_back(std::move(pending));
+      }
+      pending.clear();
 
-      while (std::getline(in, line)) {
+      while (std::getline(*in, line)) {
         if (!line.empty() && line.front() == '>') {
-          pending_header = std::move(line);
+          pending = std::move(line);
+          break;
+        }
+
+        // Cut a long sequence at a line, but not after a lone empty line,
+        // which packs to nothing
+        const bool lone_empty =
+            record.sequence_lines.size() == 1 && record.sequence_lines.front().empty();
+        if (chunk.bytes >= chunk_size && !line.empty() && !lone_empty) {
+          pending = std::move(line);
           break;
         }
 
-        chunk_bytes += line.size() + 1;
+        chunk.bytes += line.size() + 1;
         record.sequence_lines.push_back(std::move(line));
       }
 
       chunk.records.push_back(std::move(record));
-      if (chunk_bytes >= CHUNK_TARGET_SIZE) {
+      if (chunk.bytes >= chunk_size) {
         break;
       }
     }
@@ -111,14 +136,16 @@ void Fasta::compress() {
   auto pack_chunk = [this, pkStruct](FastaChunk chunk) {
     packFP_t packHdr = pkStruct.packHdrFP;
     std::string context;
-    context.reserve(CHUNK_TARGET_SIZE);
+    context.reserve(chunk.bytes);
     std::string seq;
-    seq.reserve(CHUNK_TARGET_SIZE);
+    seq.reserve(chunk.bytes);
 
     for (const FastaRecord& record : chunk.records) {
-      context += (char)253;
-      (this->*packHdr)(context, record.header.substr(1), HdrMap);
-      context += (char)254;
+      if (!record.header.empty()) {
+        context += (char)253;
+        (this->*packHdr)(context, record.header.substr(1), HdrMap);
+        context += (char)254;
+      }
 
       seq.clear();
       for (const std::string& line : record.sequence_lines) {
@@ -133,13 +160,13 @@ void Fasta::compress() {
     }
 
     if (!stop_shuffle) {
-      mutxFA.lock();  //----------------------------------------------------
+      mutxShuff.lock();  //-------------------------------------------------
       if (verbose && shuffInProg) {
-        std::cerr << bold("[+]") << " Shuffling ...";
+        progress() << bold("[+]") << " Shuffling ...";
         shuffle_timer = now();
       }
       shuffInProg = false;
-      mutxFA.unlock();  //--------------------------------------------------
+      mutxShuff.unlock();  //-----------------------------------------------
 
       shuffle(context);
     }
@@ -149,25 +176,25 @@ void Fasta::compress() {
     return packed;
   };
 
-  encrypt_stream([&](const PlaintextSink& emit) {
+  encrypt_stream([&](RecordSink& records) {
     std::string header;
     header.reserve(headers.size() + 3);
     header += (char)127;
-    header += (!stop_shuffle ? (char)128 : (char)129);
+    header += (!stop_shuffle ? (char)130 : (char)131);  // Wide alphabets in words
     header += headers;
     header += (char)254;
-    emit(header);
+    records.emit(header);
 
-    run_ordered_pipeline<FastaChunk>(n_threads, read_chunk, pack_chunk, emit);
-    emit(std::string(1, (char)252));
+    records.run_pipeline<FastaChunk>(n_threads, read_chunk, pack_chunk, &sizer);
+    records.emit(std::string(1, (char)252));
 
     if (verbose && !stop_shuffle) {
-      std::cerr << "\r" << bold("[+]") << " Shuffling done in " << hms(now() - shuffle_timer);
-      std::cerr << bold("[+]") << " Compacting ...";
+      progress() << "\r" << bold("[+]") << " Shuffling done in " << hms(now() - shuffle_timer);
+      progress() << bold("[+]") << " Compacting ...";
     }
 
     const auto finish = now();  // Stop timer
-    std::cerr << "\r" << bold("[+]") << " Compacting done in " << hms(finish - start);
+    progress() << "\r" << bold("[+]") << " Compacting done in " << hms(finish - start);
   });
 }
 
@@ -180,13 +207,9 @@ void Fasta::set_hashTbl_packFn(packfa_s& pkStruct, const std::string& headers) {
   const size_t headersLen = headers.length();
 
   // Header
-  if (headersLen > MAX_C5) {  // If len > 39, filter the last 39 ones
-    Hdrs = headers.substr(headersLen - MAX_C5);
-    // ASCII char after the last char in Hdrs -- always <= (char) 127
-    HdrsX = Hdrs;
-    HdrsX += (char)(Hdrs.back() + 1);
-    build_hash_tbl(HdrMap, HdrsX, KEYLEN_C5);
-    pkStruct.packHdrFP = &EnDecrypto::pack_hL_fa_fq;
+  if (headersLen > MAX_C5) {  // If len > 39, mixed-radix words
+    Hdrs = headers;
+    pkStruct.packHdrFP = &EnDecrypto::pack_words;
   } else {
     Hdrs = headers;
 
@@ -274,13 +297,13 @@ void Fasta::pack(const packfa_s& pkStruct, byte threadID) {
 
     // Shuffle
     if (!stop_shuffle) {
-      mutxFA.lock();  //----------------------------------------------------
+      mutxShuff.lock();  //-------------------------------------------------
       if (verbose && shuffInProg) {
-        std::cerr << bold("[+]") << " Shuffling ...";
+        progress() << bold("[+]") << " Shuffling ...";
         shuffle_timer = now();
       }
       shuffInProg = false;
-      mutxFA.unlock();  //--------------------------------------------------
+      mutxShuff.unlock();  //-----------------------------------------------
 
       shuffle(context);
     }
@@ -306,27 +329,34 @@ void Fasta::pack(const packfa_s& pkStruct, byte threadID) {
 /**
  * @brief Gather chars of all headers & max length of DNA bases lines, excluding '>'
  * @param[out] headers Chars of all headers
+ * @return False if the file cannot be packed as it is: text before the first
+ *         header, headers with chars past 127 or '\r', or no newline at the
+ *         end
  */
-void Fasta::gather_h_bs(std::string& headers) {
+bool Fasta::gather_h_bs(std::string& headers) {
   u32 maxBLen = 0;  // Max length of each line of bases
-  bool hChars[127];
-  std::memset(hChars + 32, false, 95);
+  bool hChars[256] = {};
 
-  std::ifstream in(in_file);
+  auto in = open_in(in_file);
   std::string line;
-  while (getline(in, line).good()) {
+  for (bool first = true; getline(*in, line).good(); first = false) {
     if (line[0] == '>') {
       for (char c : line) {
-        hChars[c] = true;
+        hChars[(byte)c] = true;
       }
+    } else if (first) {
+      return false;
     } else if (line.size() > maxBLen) {
       maxBLen = (u32)line.size();
     }
   }
-  in.close();
+  if (!line.empty() || hChars['\r'] ||
+      std::any_of(hChars + 128, hChars + 256, [](bool has) { return has; })) {
+    return false;
+  }
 
   // Number of lines read from input file while compression
-  BlockLine = (u32)(CHUNK_TARGET_SIZE / maxBLen);
+  BlockLine = maxBLen ? (u32)(CHUNK_TARGET_SIZE / maxBLen) : 0;
   if (!BlockLine) {
     BlockLine = 2;
   }
@@ -342,6 +372,7 @@ void Fasta::gather_h_bs(std::string& headers) {
       headers += i;
     }
   }
+  return true;
 }
 
 /**
@@ -349,11 +380,12 @@ void Fasta::gather_h_bs(std::string& headers) {
  */
 void Fasta::decompress() {
   if (!verbose) {
-    std::cerr << bold("[+]") << " Decompressing ...";
+    progress() << bold("[+]") << " Decompressing ...";
   }
   const auto start = now();  // Start timer
 
-  PlaintextStream plaintext;
+  const MemoryBudget budget = memory();
+  PlaintextStream plaintext(stats, budget.plaintext_buffer);
   std::exception_ptr decrypt_error;
   std::thread decrypt_thread([&]() {
     try {
@@ -383,26 +415,32 @@ void Fasta::decompress() {
       throw std::runtime_error("corrupted file.");
     }
 
+    // 128/129: shuffled or not; 130/131: also, wide alphabets in words
     const auto shuffle_flag = plaintext.get();
-    if (!shuffle_flag || (*shuffle_flag != (char)128 && *shuffle_flag != (char)129)) {
+    if (!shuffle_flag || (byte)*shuffle_flag < 128 || (byte)*shuffle_flag > 131) {
       throw std::runtime_error("corrupted file.");
     }
 
-    shuffled = (*shuffle_flag == (char)128);  // Check if file had been shuffled
+    shuffled = ((byte)*shuffle_flag & 1) == 0;  // Check if file had been shuffled
+    const bool in_words = ((byte)*shuffle_flag & 2) != 0;
     if (verbose) {
-      std::cerr << bold("[+]") << " Extracting no. unique characters ...";
+      progress() << bold("[+]") << " Extracting no. unique characters ...";
     }
     if (!plaintext.read_until((char)254, headers)) {
       throw std::runtime_error("corrupted file.");
     }
     if (verbose) {  // Show number of different chars in headers -- Ignore '>'=62
-      std::cerr << "\r" << bold("[+]") << " No. unique characters: headers => " << headers.length()
+      progress() << "\r" << bold("[+]") << " No. unique characters: headers => " << headers.length()
                 << "    \n";
     }
 
     // Header -- Set unpack table and unpack function
     set_unpackTbl_unpackFn(upkStruct, headers);
-    const bool has_small_header = headers.length() <= MAX_C5;
+    if (in_words && headers.length() > MAX_C5) {
+      build_unpack_tbl(upkStruct.hdrUnpack, headers, 1);
+      upkStruct.unpackHdrFP = &EnDecrypto::unpack_8B;
+    }
+    const bool has_small_header = headers.length() <= MAX_C5 || in_words;
 
     auto read_chunk = [&]() -> std::optional<std::string> {
       const auto marker = plaintext.get();
@@ -434,13 +472,13 @@ void Fasta::decompress() {
 
       // Unshuffle
       if (shuffled) {
-        mutxFA.lock();  //--------------------------------------------------
+        mutxShuff.lock();  //-----------------------------------------------
         if (verbose && shuffInProg) {
-          std::cerr << bold("[+]") << " Unshuffling ...";
+          progress() << bold("[+]") << " Unshuffling ...";
           shuffle_timer = now();
         }
         shuffInProg = false;
-        mutxFA.unlock();  //------------------------------------------------
+        mutxShuff.unlock();  //---------------------------------------------
 
         unshuffle(i, decText.size());
       }
@@ -465,12 +503,19 @@ void Fasta::decompress() {
       return content;
     };
 
-    run_ordered_pipeline<std::string>(n_threads, read_chunk, unpack_chunk,
-                                      [](const std::string& output) { std::cout << output; });
+    OutputFile out(out_file, n_threads, out_sink, budget.output_queue);
+    run_ordered_pipeline<std::string>(
+        n_threads, read_chunk, bgzf_output(bgzf, unpack_chunk),
+        [&](std::string output) { out.write(std::move(output)); }, pool,
+        {stats, Stage::plaintext_pull, Stage::unpack}, budget);
+    if (bgzf) {
+      out.write(bgzf_eof());
+    }
+    out.close();
 
     if (verbose && shuffled) {
-      std::cerr << "\r" << bold("[+]") << " Unshuffling done in " << hms(now() - shuffle_timer);
-      std::cerr << bold("[+]") << " Decompressing ...";
+      progress() << "\r" << bold("[+]") << " Unshuffling done in " << hms(now() - shuffle_timer);
+      progress() << bold("[+]") << " Decompressing ...";
     }
   } catch (...) {
     plaintext.fail(std::current_exception());
@@ -483,7 +528,7 @@ void Fasta::decompress() {
   join_decrypt();
 
   const auto finish = now();  // Stop timer
-  std::cerr << "\r" << bold("[+]") << " Decompressing done in " << hms(finish - start);
+  progress() << "\r" << bold("[+]") << " Decompressing done in " << hms(finish - start);
 }
 
 /**
@@ -561,13 +606,13 @@ void Fasta::unpack_hS(const unpackfa_s& upkStruct, byte threadID) {
 
     // Unshuffle
     if (shuffled) {
-      mutxFA.lock();  //----------------------------------------------------
+      mutxShuff.lock();  //-------------------------------------------------
       if (verbose && shuffInProg) {
-        std::cerr << bold("[+]") << " Unshuffling ...";
+        progress() << bold("[+]") << " Unshuffling ...";
         shuffle_timer = now();
       }
       shuffInProg = false;
-      mutxFA.unlock();  //--------------------------------------------------
+      mutxShuff.unlock();  //-----------------------------------------------
 
       unshuffle(i, chunkSize);
     }
@@ -642,13 +687,13 @@ void Fasta::unpack_hL(const unpackfa_s& upkStruct, byte threadID) {
 
     // Unshuffle
     if (shuffled) {
-      mutxFA.lock();  //----------------------------------------------------
+      mutxShuff.lock();  //-------------------------------------------------
       if (verbose && shuffInProg) {
-        std::cerr << bold("[+]") << " Unshuffling ...";
+        progress() << bold("[+]") << " Unshuffling ...";
         shuffle_timer = now();
       }
       shuffInProg = false;
-      mutxFA.unlock();  //--------------------------------------------------
+      mutxShuff.unlock();  //-----------------------------------------------
 
       unshuffle(i, chunkSize);
     }
@@ -36,11 +36,12 @@ struct unpackfa_s {
  */
 class Fasta : public EnDecrypto {
  public:
+  using EnDecrypto::EnDecrypto;
   void compress();
   void decompress();
 
  private:
-  void gather_h_bs(std::string&);
+  bool gather_h_bs(std::string&);
   void set_hashTbl_packFn(packfa_s&, const std::string&);
   void pack(const packfa_s&, byte);
   void set_unpackTbl_unpackFn(unpackfa_s&, const std::string&);
@@ -8,7 +8,11 @@
 
 #include "fastq.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <cstring>
+#include <deque>
 #include <exception>
 #include <format>
 #include <fstream>
@@ -16,17 +20,25 @@
 #include <mutex>
 #include <optional>
 #include <stdexcept>
+#include <string_view>
 #include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "assert.hpp"
+#include "external_sort.hpp"
+#include "gzip.hpp"
+#include "minimizer.hpp"
+#include "numeric.hpp"
 #include "ordered_pipeline.hpp"
+#include "output_file.hpp"
 #include "plaintext_stream.hpp"
+#include "qbin.hpp"
 #include "string.hpp"
 #include "time.hpp"
 using namespace cryfa;
 
-std::mutex mutxFQ; /**< @brief Mutex */
-
 namespace {
 struct FastqRecord {
   std::string header;
@@ -36,22 +48,148 @@ struct FastqRecord {
 
 struct FastqChunk {
   std::vector<FastqRecord> records;
+  std::vector<FastqRecord> mates;  // Paired mode: the mate of each record
+  std::vector<u64> indexes;        // Reordered reads: the original index of each record
+  u64 bytes = 0;                   // Size of the records in the input
+};
+
+constexpr size_t CLUSTER_K = 21;     // k-mer size to cluster reordered reads
+constexpr char OVERLAP = (char)251;  // First byte of a read packed by its overlap
+
+// Long-read mode: a part of a record's field. 'h' header, 's'/'S' sequence,
+// 'p' header on the '+' line, 'q'/'Q' quality scores; capitals end a line
+struct LongPart {
+  char kind;
+  std::string text;
+};
+
+struct LongChunk {
+  std::vector<LongPart> parts;
+  u64 bytes = 0;  // Size of the parts in the input
 };
+
+/**
+ * @brief Read a record, ignoring its '+' line
+ * @param in Input
+ * @param[out] record Record
+ * @return False at the end of the input
+ */
+bool read_record(std::istream& in, FastqRecord& record) {
+  std::string plus;
+  return std::getline(in, record.header) && std::getline(in, record.sequence) &&
+         std::getline(in, plus) && std::getline(in, record.quality);
+}
+
+u64 record_bytes(const FastqRecord& record) {
+  return record.header.size() + record.sequence.size() + record.quality.size() + 5;
+}
+
+/**
+ * @brief Sizes of the common prefix and of the common suffix of two strings,
+ *        not overlapping in either one
+ */
+std::pair<size_t, size_t> common_ends(std::string_view a, std::string_view b) {
+  const size_t shorter = std::min(a.size(), b.size());
+  size_t prefix = 0;
+  while (prefix != shorter && a[prefix] == b[prefix]) {
+    ++prefix;
+  }
+  size_t suffix = 0;
+  while (suffix != shorter - prefix && a[a.size() - 1 - suffix] == b[b.size() - 1 - suffix]) {
+    ++suffix;
+  }
+  return {prefix, suffix};
+}
+
+// Little-endian 64-bit numbers, framing unpacked text
+void put_u64(std::string& out, size_t at, u64 n) {
+  for (size_t i = 0; i != 8; ++i) {
+    out[at + i] = static_cast<char>(n >> (8 * i));
+  }
+}
+
+u64 get_u64(std::string_view in, size_t at) {
+  u64 n = 0;
+  for (size_t i = 8; i--;) {
+    n = n << 8 | static_cast<unsigned char>(in[at + i]);
+  }
+  return n;
+}
+
+// Paired mode: unpacked reads of both mates, as [u64 LE R1 size][R1][R2]
+std::string join_mates(const std::string& first, const std::string& second) {
+  std::string joined(8, '\0');
+  put_u64(joined, 0, first.size());
+  joined.reserve(8 + first.size() + second.size());
+  joined += first;
+  joined += second;
+  return joined;
+}
+
+/**
+ * @brief Least canonical k-mer of a read, which overlapping reads likely share
+ * @return (hash, position * 2 + reverse), or nothing if the read has no k-mer
+ */
+std::optional<std::pair<u64, u64>> least_kmer(std::string_view seq) {
+  std::optional<std::pair<u64, u64>> least;
+  for_each_minimizer<CLUSTER_K, 1>(seq, [&](u64 hash, u64 info) {
+    if (!least || hash < least->first) {
+      least.emplace(hash, info);
+    }
+  });
+  return least;
+}
+
+u64 zigzag(i64 n) { return (static_cast<u64>(n) << 1) ^ static_cast<u64>(n >> 63); }
+i64 unzigzag(u64 n) { return static_cast<i64>(n >> 1) ^ -static_cast<i64>(n & 1); }
+
+std::pair<std::string_view, std::string_view> split_mates(std::string_view joined) {
+  const u64 first_size = get_u64(joined, 0);
+  return {joined.substr(8, first_size), joined.substr(8 + first_size)};
+}
+
+// Header tokens: maximal runs of letters and digits
+size_t token_end(std::string_view header, size_t begin) {
+  while (begin != header.size() && std::isalnum(static_cast<unsigned char>(header[begin]))) {
+    ++begin;
+  }
+  return begin;
+}
+
+/**
+ * @brief Estimated packed bytes per symbol, by the number of symbols
+ */
+double packed_ratio(size_t n_symbols) {
+  if (n_symbols > MAX_C5) {  // 8-byte words
+    return 8.0 / std::floor((std::log2(252.0) + 56) / std::log2((double)n_symbols));
+  } else if (n_symbols >= MIN_C5) {
+    return 2.0 / KEYLEN_C5;
+  } else if (n_symbols >= MIN_C4) {
+    return 1.0 / KEYLEN_C4;
+  } else if (n_symbols >= MIN_C3) {
+    return 1.0 / KEYLEN_C3;
+  } else if (n_symbols == C2) {
+    return 1.0 / KEYLEN_C2;
+  } else if (n_symbols == C1) {
+    return 1.0 / KEYLEN_C1;
+  }
+  return 1.0;
+}
 }  // namespace
 
 /**
  * @brief Check if the third line contains only +
+ * @param name Input file name
  * @return True or false
  */
-bool Fastq::has_just_plus() const {
-  std::ifstream in(in_file);
+bool Fastq::has_just_plus(const std::string& name) const {
+  auto in = open_in(name);
   std::string line;
 
-  IGNORE_THIS_LINE(in);  // Ignore header
-  IGNORE_THIS_LINE(in);  // Ignore seq
-  bool justPlus = !(getline(in, line).good() && line.length() > 1);
+  IGNORE_THIS_LINE(*in);  // Ignore header
+  IGNORE_THIS_LINE(*in);  // Ignore seq
+  bool justPlus = !(getline(*in, line).good() && line.length() > 1);
 
-  in.close();
   return justPlus;
 
   /* If input was std::string, instead of file
@@ -64,55 +202,275 @@ bool Fastq::has_just_plus() const {
 }
 
 /**
- * @brief Compress
+ * @brief Train the header dictionary on the first reads: the tokens of most
+ *        headers, e.g., the instrument and the run, by the bytes they save.
+ *        Kept only if the headers pack smaller with it
+ */
+void Fastq::train_header_dict() {
+  std::vector<std::string> sample;
+  std::vector<std::string> names{in_file};
+  if (!paired_file.empty()) {
+    names.push_back(paired_file);
+  }
+  for (const std::string& name : names) {
+    auto in = open_in(name);
+    u64 sample_bytes = 0;
+    for (FastqRecord record;
+         sample_bytes < HDR_DICT_SAMPLE / names.size() && read_record(*in, record);) {
+      sample_bytes += record_bytes(record);
+      if (std::any_of(record.header.begin(), record.header.end(),
+                      [](char c) { return (byte)c >= 128; })) {
+        return;  // The codes would be ambiguous
+      }
+      sample.push_back(record.header.substr(1));
+    }
+  }
+
+  std::unordered_map<std::string, u64> counts;
+  for (const std::string& header : sample) {
+    for (size_t begin = 0; begin < header.size();) {
+      const size_t end = token_end(header, begin);
+      if (end - begin >= 2) {
+        ++counts[header.substr(begin, end - begin)];
+      }
+      begin = std::max(end, begin + 1);
+    }
+  }
+
+  // Candidates: in at least 1/16 of the headers, by the bytes they save
+  std::vector<std::pair<u64, std::string>> candidates;
+  for (const auto& [token, count] : counts) {
+    if (count >= std::max<u64>(2, sample.size() / 16)) {
+      candidates.emplace_back(count * (token.size() - 1), token);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+  });
+  if (candidates.size() > MAX_HDR_TOKENS) {
+    candidates.resize(MAX_HDR_TOKENS);
+  }
+
+  // Packed size of the sample with the first n candidates
+  auto dict_of = [&](size_t n) {
+    std::vector<std::string> tokens;
+    for (size_t t = 0; t != n; ++t) {
+      tokens.push_back(candidates[t].second);
+    }
+    return tokens;
+  };
+  auto packed_size = [&](size_t n) {
+    set_header_dict(dict_of(n));
+    bool symbols[256] = {};
+    u64 length = 0;
+    for (const std::string& header : sample) {
+      const std::string tokenized = tokenize_header(header);
+      length += tokenized.size();
+      for (char c : tokenized) {
+        symbols[(byte)c] = true;
+      }
+    }
+    return (double)length * packed_ratio((size_t)std::count(symbols, symbols + 256, true));
+  };
+  std::vector<size_t> sizes;
+  for (size_t n = 1; n < candidates.size(); n *= 2) {
+    sizes.push_back(n);
+  }
+  if (!candidates.empty()) {
+    sizes.push_back(candidates.size());
+  }
+  size_t best = 0;
+  double best_size = packed_size(0);
+  for (size_t n : sizes) {
+    if (const double size = packed_size(n); size < best_size) {
+      best = n;
+      best_size = size;
+    }
+  }
+  set_header_dict(dict_of(best));
+}
+
+void Fastq::set_header_dict(std::vector<std::string> tokens) {
+  hdrTokens = std::move(tokens);
+  hdrCodes.clear();
+  for (size_t t = 0; t != hdrTokens.size(); ++t) {
+    hdrCodes.emplace(hdrTokens[t], (char)(128 + t));
+  }
+}
+
+/**
+ * @brief Replace the tokens of a header in the dictionary by their codes
+ */
+std::string Fastq::tokenize_header(std::string_view header) const {
+  if (hdrCodes.empty()) {
+    return std::string(header);
+  }
+  std::string tokenized;
+  tokenized.reserve(header.size());
+  for (size_t begin = 0; begin != header.size();) {
+    const size_t end = token_end(header, begin);
+    if (end == begin) {
+      tokenized += header[begin++];
+      continue;
+    }
+    const auto code = hdrCodes.find(header.substr(begin, end - begin));
+    if (code != hdrCodes.end()) {
+      tokenized += code->second;
+    } else {
+      tokenized.append(header, begin, end - begin);
+    }
+    begin = end;
+  }
+  return tokenized;
+}
+
+/**
+ * @brief Replace the codes of a header by their tokens in the dictionary
+ */
+std::string Fastq::expand_header(const std::string& header) const {
+  if (hdrTokens.empty()) {
+    return header;
+  }
+  std::string expanded;
+  expanded.reserve(header.size() * 2);
+  for (char c : header) {
+    if ((byte)c < 128) {
+      expanded += c;
+    } else if ((byte)c - 128u < hdrTokens.size()) {
+      expanded += hdrTokens[(byte)c - 128];
+    } else {
+      throw std::runtime_error("corrupted file.");
+    }
+  }
+  return expanded;
+}
+
+/**
+ * @brief Compress. In paired mode, the mates in paired_file are read in
+ *        lockstep, and each mate header is stored as a diff against its read's
  */
 void Fastq::compress() {
   if (!verbose) {
-    std::cerr << bold("[+]") << " Compacting ...";
+    progress() << bold("[+]") << " Compacting ...";
   }
   const auto start = now();  // Start timer
   std::string headers, qscores;
   packfq_s pkStruct;  // Collection of inputs to pass to pack...
 
+  // Lossy quality score binning, if asked
+  qbinScheme = qbin.empty() ? QBin::none : qbin_scheme(qbin);
+  qbinTbl = qbin_table(qbinScheme);
+
   if (verbose) {
-    std::cerr << bold("[+]") << " Calculating no. unique characters ...";
+    progress() << bold("[+]") << " Calculating no. unique characters ...";
   }
+  // Dictionary of header tokens, shared by all chunks through the header
+  train_header_dict();
   // Gather different chars and max length in all headers and quality scores
   gather_h_q(headers, qscores);
   // Show number of different chars in headers and qs -- Ignore '@'=64 in hdr
   if (verbose) {
-    std::cerr << "\r" << bold("[+]") << " No. unique characters: headers => " << headers.length()
+    progress() << "\r" << bold("[+]") << " No. unique characters: headers => " << headers.length()
               << ", qscores => " << qscores.length() << "\n";
+    progress() << bold("[+]") << " Header dictionary: " << hdrTokens.size() << " tokens\n";
   }
 
   // Set Hash table and pack function
   set_hashTbl_packFn(pkStruct, headers, qscores);
 
-  const bool plus_is_plain = has_just_plus();
+  // Reference to map the reads on, if asked
+  if (!ref_file.empty() && longReads) {
+    warning("long reads are not mapped to the reference.");
+  } else if (!ref_file.empty()) {
+    if (verbose) {
+      progress() << bold("[+]") << " Loading the reference ...";
+    }
+    const auto ref_start = now();
+    reference = references ? references->load(ref_file, n_threads)
+                           : Reference::load(ref_file, n_threads);
+    if (verbose) {
+      progress() << "\r" << bold("[+]") << " Loading the reference done in "
+                << hms(now() - ref_start);
+    }
+  }
+
+  // Reordering: cluster the reads by their least k-mers, so overlapping reads
+  // share chunks. The sort spills to disk past the run size of the budget
+  if (!reorder.empty() && longReads) {
+    warning("long reads are not reordered.");
+  }
+  const bool reordered = !reorder.empty() && !longReads;
+  const bool keep_order = reordered && (reorder == "keep");
+  ExternalSort sorted(spill_cipher(), memory().sort_run);
+  if (reordered) {
+    if (verbose) {
+      progress() << bold("[+]") << " Reordering reads ...";
+    }
+    const auto sort_start = now();
+    auto in = open_in(in_file);
+    for (FastqRecord record; read_record(*in, record);) {
+      const auto least = least_kmer(record.sequence);
+      sorted.push(least ? least->first : ~0ULL,
+                  std::format("{}\n{}\n{}", record.header, record.sequence, record.quality));
+    }
+    if (verbose) {
+      progress() << "\r" << bold("[+]") << " Reordering done in " << hms(now() - sort_start);
+    }
+  }
+
+  const bool paired = !paired_file.empty();
+  const bool plus_is_plain = has_just_plus(in_file);
+  const bool mate_plus_is_plain = paired && has_just_plus(paired_file);
+  ChunkSizer sizer = chunk_sizer();
 
-  auto read_chunk = [this, in = std::ifstream(in_file)]() mutable -> std::optional<FastqChunk> {
+  auto read_chunk = [in = open_in(in_file), mate_in = paired ? open_in(paired_file) : nullptr,
+                     &sizer]() mutable -> std::optional<FastqChunk> {
+    const u64 chunk_size = sizer.target();
     FastqChunk chunk;
-    std::string plus;
-    u64 chunk_bytes = 0;
 
-    while (chunk_bytes < CHUNK_TARGET_SIZE) {
+    while (chunk.bytes < chunk_size) {
       FastqRecord record;
-      if (!std::getline(in, record.header)) {
-        break;
-      }
-      if (!std::getline(in, record.sequence)) {
+      if (!read_record(*in, record)) {
         break;
       }
-      if (!std::getline(in, plus)) {
-        break;
+      chunk.bytes += record_bytes(record);
+      chunk.records.push_back(std::move(record));
+
+      if (mate_in) {
+        FastqRecord mate;
+        assert_single(!read_record(*mate_in, mate),
+                      "the paired files have different numbers of reads.");
+        chunk.bytes += record_bytes(mate);
+        chunk.mates.push_back(std::move(mate));
       }
-      if (!std::getline(in, record.quality)) {
+    }
+
+    if (chunk.records.empty()) {
+      FastqRecord mate;
+      assert_single(mate_in && read_record(*mate_in, mate),
+                    "the paired files have different numbers of reads.");
+      return std::nullopt;
+    }
+    return chunk;
+  };
+
+  auto read_sorted_chunk = [&sorted, &sizer]() -> std::optional<FastqChunk> {
+    const u64 chunk_size = sizer.target();
+    FastqChunk chunk;
+
+    while (chunk.bytes < chunk_size) {
+      std::optional<ExternalSort::Record> sorted_record = sorted.next();
+      if (!sorted_record) {
         break;
       }
-
-      chunk_bytes +=
-          record.header.size() + record.sequence.size() + plus.size() + record.quality.size() + 4;
+      const std::string& text = sorted_record->data;
+      const size_t seq_begin = text.find('\n') + 1;
+      const size_t qs_begin = text.find('\n', seq_begin) + 1;
+      FastqRecord record{text.substr(0, seq_begin - 1),
+                         text.substr(seq_begin, qs_begin - 1 - seq_begin), text.substr(qs_begin)};
+      chunk.bytes += record_bytes(record);
       chunk.records.push_back(std::move(record));
+      chunk.indexes.push_back(sorted_record->index);
     }
 
     if (chunk.records.empty()) {
@@ -121,62 +479,347 @@ void Fastq::compress() {
     return chunk;
   };
 
-  auto pack_chunk = [this, pkStruct](FastqChunk chunk) {
+  auto pack_chunk = [this, pkStruct, keep_order](FastqChunk chunk) {
     packFP_t packHdr = pkStruct.packHdrFPtr;
     packFP_t packQS = pkStruct.packQSFPtr;
     std::string context;
-    context.reserve(CHUNK_TARGET_SIZE);
-
-    for (const FastqRecord& record : chunk.records) {
-      (this->*packHdr)(context, record.header.substr(1), HdrMap);
+    context.reserve(chunk.bytes);
+
+    for (size_t r = 0; r != chunk.records.size(); ++r) {
+      FastqRecord& record = chunk.records[r];
+      // Reordered reads, keeping the order: original index, as a difference
+      // from the previous record's
+      if (keep_order) {
+        pack_number(context, zigzag((i64)chunk.indexes[r] - (r ? (i64)chunk.indexes[r - 1] : 0)));
+      }
+      bin_qscores(record.quality);
+      const std::string header = tokenize_header(std::string_view(record.header).substr(1));
+      (this->*packHdr)(context, header, HdrMap);
       context += (char)254;
-      pack_seq(context, record.sequence);
+      pack_read_seq(context, record.sequence,
+                    chunk.indexes.empty() || !r ? nullptr : &chunk.records[r - 1].sequence);
       context += (char)254;
       (this->*packQS)(context, record.quality, QsMap);
       context += (char)254;
-    }
 
-    if (!stop_shuffle) {
-      mutxFQ.lock();  //----------------------------------------------------
-      if (verbose && shuffInProg) {
-        std::cerr << bold("[+]") << " Shuffling ...";
-        shuffle_timer = now();
+      if (chunk.mates.empty()) {
+        continue;
       }
-      shuffInProg = false;
-      mutxFQ.unlock();  //--------------------------------------------------
 
-      shuffle(context);
+      // Mate header: nothing if the same, else [prefix],[suffix],[packed middle]
+      FastqRecord& mate = chunk.mates[r];
+      bin_qscores(mate.quality);
+      const std::string mate_header = tokenize_header(std::string_view(mate.header).substr(1));
+      if (mate_header != header) {
+        const auto [prefix, suffix] = common_ends(header, mate_header);
+        context += std::format("{},{},", prefix, suffix);
+        const std::string middle =
+            mate_header.substr(prefix, mate_header.size() - prefix - suffix);
+        if (!middle.empty()) {
+          (this->*packHdr)(context, middle, HdrMap);
+        }
+      }
+      context += (char)254;
+      pack_read_seq(context, mate.sequence, nullptr);
+      context += (char)254;
+      (this->*packQS)(context, mate.quality, QsMap);
+      context += (char)254;
     }
 
-    std::string packed = std::format("{}{}{}", (char)253, context.size(), (char)254);
-    packed += context;
-    return packed;
+    return shuffle_and_frame(std::move(context));
   };
 
-  encrypt_stream([&](const PlaintextSink& emit) {
+  encrypt_stream([&](RecordSink& records) {
     std::string header;
     header.reserve(headers.size() + qscores.size() + 3);
-    header += (char)126;
-    header += (!stop_shuffle ? (char)128 : (char)129);
+    header += (longReads ? (char)123 : paired ? (char)124 : (char)126);
+    // Flags: not shuffled (bit 0), wide alphabets in words (bit 1), binned (bit 2),
+    // mapped on a reference (bit 3), reordered (bit 4), original order kept (bit 5),
+    // header dictionary (bit 6)
+    header += (char)(130 | (stop_shuffle ? 1 : 0) | (qbinScheme != QBin::none ? 4 : 0) |
+                     (reference ? 8 : 0) | (reordered ? 16 : 0) | (keep_order ? 32 : 0) |
+                     (hdrTokens.empty() ? 0 : 64));
+    if (qbinScheme != QBin::none) {
+      header += (char)qbinScheme;
+    }
+    if (reference) {
+      for (size_t i = 0; i != 8; ++i) {
+        header += (char)(reference->fingerprint() >> (8 * i));
+      }
+    }
+    if (!hdrTokens.empty()) {  // Number of tokens, then each ending with 254
+      header += (char)hdrTokens.size();
+      for (const std::string& token : hdrTokens) {
+        header += token;
+        header += (char)254;
+      }
+    }
     header += headers;
     header += (char)254;
     header += qscores;
     header += (plus_is_plain ? (char)253 : '\n');
-    emit(header);
+    if (paired) {
+      header += (mate_plus_is_plain ? (char)253 : '\n');
+    }
+    records.emit(header);
 
-    run_ordered_pipeline<FastqChunk>(n_threads, read_chunk, pack_chunk, emit);
-    emit(std::string(1, (char)252));
+    if (longReads) {
+      compress_long(records, pkStruct, plus_is_plain);
+    } else if (reordered) {
+      records.run_pipeline<FastqChunk>(n_threads, read_sorted_chunk, pack_chunk, &sizer);
+    } else {
+      records.run_pipeline<FastqChunk>(n_threads, read_chunk, pack_chunk, &sizer);
+    }
+    records.emit(std::string(1, (char)252));
 
     if (verbose && !stop_shuffle) {
-      std::cerr << "\r" << bold("[+]") << " Shuffling done in " << hms(now() - shuffle_timer);
-      std::cerr << bold("[+]") << " Compacting ...";
+      progress() << "\r" << bold("[+]") << " Shuffling done in " << hms(now() - shuffle_timer);
+      progress() << bold("[+]") << " Compacting ...";
     }
 
     const auto finish = now();  // Stop timer
-    std::cerr << "\r" << bold("[+]") << " Compacting done in " << hms(finish - start);
+    progress() << "\r" << bold("[+]") << " Compacting done in " << hms(finish - start);
   });
 }
 
+/**
+ * @brief Compress long reads. Headers are kept whole, while sequences and
+ *        quality scores are split in parts, so a read spans as many chunks as
+ *        its size needs, instead of making one oversized chunk
+ * @param records Records of the output
+ * @param pkStruct Pack structure
+ * @param plus_is_plain If the third lines contain only +
+ */
+void Fastq::compress_long(RecordSink& records, const packfq_s& pkStruct, bool plus_is_plain) {
+  auto split_record = [this, plus_is_plain](FastqRecord record, std::deque<LongPart>& parts) {
+    auto split_field = [&](const std::string& field, char kind) {
+      size_t pos = 0;
+      do {
+        const size_t size = std::min<size_t>(LONG_PART_SIZE, field.size() - pos);
+        const bool last = (pos + size == field.size());
+        parts.push_back(LongPart{last ? (char)std::toupper(kind) : kind, field.substr(pos, size)});
+        pos += size;
+      } while (pos != field.size());
+    };
+
+    const std::string header = tokenize_header(std::string_view(record.header).substr(1));
+    parts.push_back(LongPart{'h', header});
+    split_field(record.sequence, 's');
+    if (!plus_is_plain) {
+      parts.push_back(LongPart{'p', header});
+    }
+    split_field(record.quality, 'q');
+  };
+
+  ChunkSizer sizer = chunk_sizer();
+  auto read_chunk = [in = open_in(in_file), parts = std::deque<LongPart>{}, split_record,
+                     &sizer]() mutable -> std::optional<LongChunk> {
+    const u64 chunk_size = sizer.target();
+    LongChunk chunk;
+
+    while (chunk.bytes < chunk_size) {
+      if (parts.empty()) {
+        FastqRecord record;
+        if (!read_record(*in, record)) {
+          break;
+        }
+        split_record(std::move(record), parts);
+      }
+
+      chunk.bytes += parts.front().text.size() + 1;
+      chunk.parts.push_back(std::move(parts.front()));
+      parts.pop_front();
+    }
+
+    if (chunk.parts.empty()) {
+      return std::nullopt;
+    }
+    return chunk;
+  };
+
+  auto pack_chunk = [this, pkStruct](LongChunk chunk) {
+    std::string context;
+    context.reserve(chunk.bytes);
+
+    for (LongPart& part : chunk.parts) {
+      context += part.kind;
+      switch (part.kind) {
+        case 'h':
+        case 'p':
+          (this->*pkStruct.packHdrFPtr)(context, part.text, HdrMap);
+          break;
+        case 's':
+        case 'S':
+          pack_seq(context, part.text);
+          break;
+        default:
+          bin_qscores(part.text);
+          (this->*pkStruct.packQSFPtr)(context, part.text, QsMap);
+      }
+      context += (char)254;
+    }
+
+    return shuffle_and_frame(std::move(context));
+  };
+
+  records.run_pipeline<LongChunk>(n_threads, read_chunk, pack_chunk, &sizer);
+}
+
+/**
+ * @brief Pack a sequence as mapped on the reference, or by its overlap with
+ *        the previous read, if either is shorter, else by its bases
+ * @param[out] packed Packed sequences
+ * @param seq Sequence
+ * @param prev Sequence of the previous reordered read, if any
+ */
+void Fastq::pack_read_seq(std::string& packed, const std::string& seq, const std::string* prev) {
+  if (reference && reference->pack(packed, seq)) {
+    return;
+  }
+  if (!prev || !pack_overlap(packed, seq, *prev)) {
+    pack_seq(packed, seq);
+  }
+}
+
+/**
+ * @brief Pack a reordered read by its overlap with the previous one, if they
+ *        share their least k-mer: [251] [shift * 2 + reverse] [size]
+ *        [No. mismatches] ([gap] [base])... and the bases out of the overlap,
+ *        packed by pack_seq. Numbers are packed by pack_number
+ * @param[out] packed Packed sequences
+ * @param seq Sequence
+ * @param prev Sequence of the previous read
+ * @return False if not packed
+ */
+bool Fastq::pack_overlap(std::string& packed, const std::string& seq, const std::string& prev) {
+  const auto least = least_kmer(seq);
+  const auto prev_least = least_kmer(prev);
+  if (!least || !prev_least || least->first != prev_least->first) {
+    return false;
+  }
+  for (char c : seq) {
+    if ((byte)c >= (byte)Reference::MAPPED) {
+      return false;
+    }
+  }
+
+  // On the reverse strand, the shift is of the reverse complement of the read
+  const i64 size = (i64)seq.size();
+  const bool reverse = ((least->second ^ prev_least->second) & 1) != 0;
+  const i64 at = (i64)(least->second >> 1);
+  const i64 shift = (i64)(prev_least->second >> 1) - (reverse ? size - at - (i64)CLUSTER_K : at);
+
+  std::string overlap(1, OVERLAP), outside;
+  pack_number(overlap, zigzag(shift) * 2 + (reverse ? 1 : 0));
+  pack_number(overlap, seq.size());
+  std::string mismatches;
+  u64 n_mismatches = 0;
+  for (i64 j = 0, next = 0; j != size; ++j) {
+    const i64 p = reverse ? size - 1 - j + shift : j + shift;
+    if (p < 0 || p >= (i64)prev.size()) {
+      outside += seq[j];
+    } else if (seq[j] != (reverse ? complement_base(prev[p]) : prev[p])) {
+      pack_number(mismatches, j - next);
+      mismatches += seq[j];
+      next = j + 1;
+      ++n_mismatches;
+    }
+  }
+  pack_number(overlap, n_mismatches);
+  overlap += mismatches;
+  pack_seq(overlap, outside);
+
+  if (overlap.size() >= (seq.size() + 2) / 3) {  // pack_seq: 3 bases in 1 byte
+    return false;
+  }
+  packed += overlap;
+  return true;
+}
+
+/**
+ * @brief Unpack a read packed by its overlap with the previous one
+ * @param[out] out Sequence
+ * @param i Input string iterator, on OVERLAP. It stops on the next (char)254
+ * @param prev Sequence of the previous read
+ */
+void Fastq::unpack_overlap(std::string& out, std::string::iterator& i, const std::string& prev) {
+  ++i;  // OVERLAP
+  const u64 shift_strand = unpack_number(i);
+  const i64 size = (i64)unpack_number(i);
+  const u64 n_mismatches = unpack_number(i);
+  const bool reverse = (shift_strand & 1) != 0;
+  const i64 shift = unzigzag(shift_strand >> 1);
+  if (size > (i64)LONG_PART_SIZE) {
+    throw std::runtime_error("corrupted file.");
+  }
+
+  std::vector<std::pair<i64, char>> mismatches;
+  for (i64 at = 0; mismatches.size() != n_mismatches; ++at) {
+    at += (i64)unpack_number(i);
+    if (at >= size || *i == (char)254) {
+      throw std::runtime_error("corrupted file.");
+    }
+    mismatches.emplace_back(at, *i++);
+  }
+  std::string outside;
+  unpack_seq(outside, i);
+
+  out.resize((size_t)size);
+  size_t k = 0;
+  for (i64 j = 0; j != size; ++j) {
+    const i64 p = reverse ? size - 1 - j + shift : j + shift;
+    if (p < 0 || p >= (i64)prev.size()) {
+      if (k == outside.size()) {
+        throw std::runtime_error("corrupted file.");
+      }
+      out[j] = outside[k++];
+    } else {
+      out[j] = reverse ? complement_base(prev[p]) : prev[p];
+    }
+  }
+  if (k != outside.size()) {
+    throw std::runtime_error("corrupted file.");
+  }
+  for (const auto& [at, base] : mismatches) {
+    out[at] = base;
+  }
+}
+
+/**
+ * @brief Bin quality scores, if a binning scheme is set
+ * @param[in, out] qscores Quality scores
+ */
+void Fastq::bin_qscores(std::string& qscores) const {
+  if (qbinScheme != QBin::none) {
+    for (char& c : qscores) {
+      c = qbinTbl[(byte)c];
+    }
+  }
+}
+
+/**
+ * @brief Shuffle a packed chunk, and insert its size in the beginning
+ * @param context Packed chunk
+ * @return Chunk to be encrypted
+ */
+std::string Fastq::shuffle_and_frame(std::string context) {
+  if (!stop_shuffle) {
+    mutxShuff.lock();  //---------------------------------------------------
+    if (verbose && shuffInProg) {
+      progress() << bold("[+]") << " Shuffling ...";
+      shuffle_timer = now();
+    }
+    shuffInProg = false;
+    mutxShuff.unlock();  //-------------------------------------------------
+
+    shuffle(context);
+  }
+
+  std::string packed = std::format("{}{}{}", (char)253, context.size(), (char)254);
+  packed += context;
+  return packed;
+}
+
 /**
  * @brief Set hash table and pack function
  * @param[out] pkStruct Pack structure
@@ -189,13 +832,9 @@ void Fastq::set_hashTbl_packFn(packfq_s& pkStruct, const std::string& headers,
   const auto qscoresLen = qscores.length();
 
   // Header
-  if (headersLen > MAX_C5) {  // If len > 39 filter the last 39 ones
-    Hdrs = headers.substr(headersLen - MAX_C5);
-    // ASCII char after the last char in Hdrs -- Always <= (char) 127
-    HdrsX = Hdrs;
-    HdrsX += (char)(Hdrs.back() + 1);
-    build_hash_tbl(HdrMap, HdrsX, KEYLEN_C5);
-    pkStruct.packHdrFPtr = &EnDecrypto::pack_hL_fa_fq;
+  if (headersLen > MAX_C5) {  // If len > 39, mixed-radix words
+    Hdrs = headers;
+    pkStruct.packHdrFPtr = &EnDecrypto::pack_words;
   } else {
     Hdrs = headers;
 
@@ -222,13 +861,9 @@ void Fastq::set_hashTbl_packFn(packfq_s& pkStruct, const std::string& headers,
   }
 
   // Quality score
-  if (qscoresLen > MAX_C5) {  // If len > 39 filter the last 39 ones
-    QSs = qscores.substr(qscoresLen - MAX_C5);
-    // ASCII char after last char in QUALITY_SCORES
-    QSsX = QSs;
-    QSsX += (char)(QSs.back() + 1);
-    build_hash_tbl(QsMap, QSsX, KEYLEN_C5);
-    pkStruct.packQSFPtr = &EnDecrypto::pack_qL_fq;
+  if (qscoresLen > MAX_C5) {  // If len > 39, mixed-radix words
+    QSs = qscores;
+    pkStruct.packQSFPtr = &EnDecrypto::pack_words;
   } else {
     QSs = qscores;
 
@@ -295,13 +930,13 @@ void Fastq::pack(const packfq_s& pkStruct, byte threadID) {
 
     // shuffle
     if (!stop_shuffle) {
-      mutxFQ.lock();  //----------------------------------------------------
+      mutxShuff.lock();  //-------------------------------------------------
       if (verbose && shuffInProg) {
-        std::cerr << bold("[+]") << " Shuffling ...";
+        progress() << bold("[+]") << " Shuffling ...";
         shuffle_timer = now();
       }
       shuffInProg = false;
-      mutxFQ.unlock();  //--------------------------------------------------
+      mutxShuff.unlock();  //-----------------------------------------------
 
       shuffle(context);
     }
@@ -331,39 +966,61 @@ void Fastq::pack(const packfq_s& pkStruct, byte threadID) {
  */
 void Fastq::gather_h_q(std::string& headers, std::string& qscores) {
   u32 maxHLen = 0, maxQLen = 0;  // Max length of headers & quality scores
-  bool hChars[127], qChars[127];
-  std::memset(hChars + 32, false, 95);
+  bool hChars[256] = {}, qChars[127];
+  bool tChars[256] = {};  // Chars of the headers with the dictionary
   std::memset(qChars + 32, false, 95);
 
-  std::ifstream in(in_file);
-  for (std::string line; !in.eof();) {
-    if (getline(in, line).good()) {
-      for (char c : line) {
-        hChars[c] = true;
-      }
-      if (line.size() > maxHLen) {
-        maxHLen = (u32)line.size();
+  // In paired mode, the mates share the tables
+  std::vector<std::string> names{in_file};
+  if (!paired_file.empty()) {
+    names.push_back(paired_file);
+  }
+
+  for (const std::string& name : names) {
+    auto in = open_in(name);
+    for (std::string line; !in->eof();) {
+      if (getline(*in, line).good()) {
+        for (char c : line) {
+          hChars[(byte)c] = true;
+        }
+        if (!hdrCodes.empty()) {
+          for (char c : tokenize_header(line)) {
+            tChars[(byte)c] = true;
+          }
+        }
+        if (line.size() > maxHLen) {
+          maxHLen = (u32)line.size();
+        }
       }
-    }
 
-    IGNORE_THIS_LINE(in);  // Ignore sequence
-    IGNORE_THIS_LINE(in);  // Ignore +
+      IGNORE_THIS_LINE(*in);  // Ignore sequence
+      IGNORE_THIS_LINE(*in);  // Ignore +
 
-    if (getline(in, line).good()) {
-      for (char c : line) {
-        qChars[c] = true;
-      }
-      if (line.size() > maxQLen) {
-        maxQLen = (u32)line.size();
+      if (getline(*in, line).good()) {
+        for (char c : line) {
+          qChars[(byte)qbinTbl[(byte)c]] = true;
+        }
+        if (line.size() > maxQLen) {
+          maxQLen = (u32)line.size();
+        }
       }
     }
   }
-  in.close();
 
   // Number of lines read from input file while compression
   BlockLine = (u32)(4 * (CHUNK_TARGET_SIZE / (maxHLen + 2 * maxQLen)));
   if (!BlockLine) BlockLine = 4;
 
+  // Reads longer than a part would make oversized chunks: split them
+  longReads = paired_file.empty() && (long_reads || maxQLen > LONG_PART_SIZE);
+
+  // Headers past the sample with chars the codes take keep no dictionary
+  if (std::any_of(hChars + 128, hChars + 256, [](bool has) { return has; })) {
+    set_header_dict({});
+  } else if (!hdrTokens.empty()) {
+    std::copy(tChars, tChars + 256, hChars);
+  }
+
   // Gather the characters -- ignore '@'=64 for headers
   for (byte i = 32; i != 64; ++i) {
     if (*(hChars + i)) {
@@ -375,6 +1032,11 @@ void Fastq::gather_h_q(std::string& headers, std::string& qscores) {
       headers += i;
     }
   }
+  for (size_t i = 128; i != 128 + hdrTokens.size(); ++i) {
+    if (hChars[i]) {
+      headers += (char)i;
+    }
+  }
   for (byte i = 32; i != 127; ++i) {
     if (*(qChars + i)) {
       qscores += i;
@@ -387,11 +1049,12 @@ void Fastq::gather_h_q(std::string& headers, std::string& qscores) {
  */
 void Fastq::decompress() {
   if (!verbose) {
-    std::cerr << bold("[+]") << " Decompressing ...";
+    progress() << bold("[+]") << " Decompressing ...";
   }
   const auto start = now();  // Start timer
 
-  PlaintextStream plaintext;
+  const MemoryBudget budget = memory();
+  PlaintextStream plaintext(stats, budget.plaintext_buffer);
   std::exception_ptr decrypt_error;
   std::thread decrypt_thread([&]() {
     try {
@@ -417,18 +1080,84 @@ void Fastq::decompress() {
 
   try {
     const auto file_type = plaintext.get();
-    if (!file_type || *file_type != (char)126) {
+    if (!file_type ||
+        (*file_type != (char)126 && *file_type != (char)124 && *file_type != (char)123)) {
       throw std::runtime_error("corrupted file.");
     }
+    const bool paired = (*file_type == (char)124);  // Reads and their mates
+    longReads = (*file_type == (char)123);          // Fields split in parts
+    if (paired == paired_file.empty()) {
+      assert_dual(paired,
+                  "the input has paired reads; set the output file of the mates with "
+                  "\"--paired\".",
+                  "the input has no paired reads.");
+    }
 
+    // 128 + flags: not shuffled (bit 0), wide alphabets in words (bit 1),
+    // quality scores binned (bit 2) -- then the binning scheme follows,
+    // reads mapped on a reference (bit 3) -- then its fingerprint follows,
+    // reads reordered (bit 4), with their original order kept (bit 5),
+    // header dictionary (bit 6) -- then its tokens follow
     const auto shuffle_flag = plaintext.get();
-    if (!shuffle_flag || (*shuffle_flag != (char)128 && *shuffle_flag != (char)129)) {
+    if (!shuffle_flag || (byte)*shuffle_flag < 128) {
       throw std::runtime_error("corrupted file.");
     }
+    const bool reordered = ((byte)*shuffle_flag & 16) != 0;
+    const bool keep_order = ((byte)*shuffle_flag & 32) != 0;
+    if ((keep_order && !reordered) || (reordered && (paired || longReads))) {
+      throw std::runtime_error("corrupted file.");
+    }
+    if ((byte)*shuffle_flag & 4) {
+      const auto scheme = plaintext.get();
+      if (!scheme || (QBin)*scheme == QBin::none || (byte)*scheme > (byte)QBin::ncbi4) {
+        throw std::runtime_error("corrupted file.");
+      }
+      if (verbose) {
+        progress() << bold("[+]") << " Quality scores binned: " << qbin_name((QBin)*scheme)
+                  << '\n';
+      }
+    }
+
+    if ((byte)*shuffle_flag & 8) {
+      u64 fingerprint = 0;
+      for (size_t b = 0; b != 8; ++b) {
+        const auto next = plaintext.get();
+        if (!next || longReads) {
+          throw std::runtime_error("corrupted file.");
+        }
+        fingerprint |= (u64)(byte)*next << (8 * b);
+      }
+      assert_single(ref_file.empty(),
+                    "the input was compacted against a reference; set it with \"--ref\".");
+      reference = references ? references->load(ref_file, n_threads)
+                             : Reference::load(ref_file, n_threads);
+      assert_single(reference->fingerprint() != fingerprint,
+                    std::format("the reference \"{}\" is not the one the input was compacted "
+                                "against.",
+                                ref_file));
+    }
+
+    if ((byte)*shuffle_flag & 64) {
+      const auto n_tokens = plaintext.get();
+      if (!n_tokens || !*n_tokens || (byte)*n_tokens > MAX_HDR_TOKENS) {
+        throw std::runtime_error("corrupted file.");
+      }
+      std::vector<std::string> tokens((byte)*n_tokens);
+      for (std::string& token : tokens) {
+        if (!plaintext.read_until((char)254, token) || token.empty()) {
+          throw std::runtime_error("corrupted file.");
+        }
+      }
+      set_header_dict(std::move(tokens));
+    }
 
-    shuffled = (*shuffle_flag == (char)128);  // Check if file had been shuffled
+    shuffled = ((byte)*shuffle_flag & 1) == 0;  // Check if file had been shuffled
+    const bool in_words = ((byte)*shuffle_flag & 2) != 0;
+    if (longReads && !in_words) {
+      throw std::runtime_error("corrupted file.");
+    }
     if (verbose) {
-      std::cerr << bold("[+]") << " Extracting no. unique characters ...";
+      progress() << bold("[+]") << " Extracting no. unique characters ...";
     }
     if (!plaintext.read_until((char)254, headers)) {
       throw std::runtime_error("corrupted file.");
@@ -447,15 +1176,71 @@ void Fastq::decompress() {
     }
     // Show number of different chars in headers and qs -- ignore '@'=64
     if (verbose) {
-      std::cerr << "\r" << bold("[+]") << " No. unique characters: headers => " << headers.length()
+      progress() << "\r" << bold("[+]") << " No. unique characters: headers => " << headers.length()
                 << ", qscores => " << qscores.length() << "\n";
     }
     justPlus = (c != '\n');  // If 3rd line is just +
 
+    bool mateJustPlus = true;
+    if (paired) {
+      const auto mate_plus = plaintext.get();
+      if (!mate_plus || (*mate_plus != '\n' && *mate_plus != (char)253)) {
+        throw std::runtime_error("corrupted file.");
+      }
+      mateJustPlus = (*mate_plus != '\n');
+    }
+
     // Header -- Set unpack table and unpack function
     set_unpackTbl_unpackFn(upkStruct, headers, qscores);
-    const bool has_small_header = headers.length() <= MAX_C5;
-    const bool has_small_qscore = qscores.length() <= MAX_C5;
+    if (in_words && headers.length() > MAX_C5) {
+      build_unpack_tbl(upkStruct.hdrUnpack, headers, 1);
+      upkStruct.unpackHdrFPtr = &EnDecrypto::unpack_8B;
+    }
+    if (in_words && qscores.length() > MAX_C5) {
+      build_unpack_tbl(upkStruct.qsUnpack, qscores, 1);
+      upkStruct.unpackQSFPtr = &EnDecrypto::unpack_8B;
+    }
+    const bool has_small_header = headers.length() <= MAX_C5 || in_words;
+    const bool has_small_qscore = qscores.length() <= MAX_C5 || in_words;
+
+    auto unpack_header = [&](std::string& out, std::string::iterator& i) {
+      if (has_small_header) {
+        (this->*upkStruct.unpackHdrFPtr)(out, i, upkStruct.hdrUnpack);
+      } else {
+        unpack_large(out, i, upkStruct.XChar_hdr, upkStruct.hdrUnpack);
+      }
+    };
+    auto unpack_qscore = [&](std::string& out, std::string::iterator& i) {
+      if (has_small_qscore) {
+        (this->*upkStruct.unpackQSFPtr)(out, i, upkStruct.qsUnpack);
+      } else {
+        unpack_large(out, i, upkStruct.XChar_qs, upkStruct.qsUnpack);
+      }
+    };
+    auto unpack_read_seq = [&](std::string& out, std::string::iterator& i,
+                               const std::string& prev) {
+      if (reference && *i == Reference::MAPPED) {
+        reference->unpack(out, i);
+      } else if (reordered && *i == OVERLAP) {
+        unpack_overlap(out, i, prev);
+      } else {
+        unpack_seq(out, i);
+      }
+    };
+    auto unshuffle_chunk = [&](std::string& decText) {
+      if (shuffled) {
+        mutxShuff.lock();  //-----------------------------------------------
+        if (verbose && shuffInProg) {
+          progress() << bold("[+]") << " Unshuffling ...";
+          shuffle_timer = now();
+        }
+        shuffInProg = false;
+        mutxShuff.unlock();  //---------------------------------------------
+
+        auto i = decText.begin();
+        unshuffle(i, decText.size());
+      }
+    };
 
     auto read_chunk = [&]() -> std::optional<std::string> {
       const auto marker = plaintext.get();
@@ -478,66 +1263,220 @@ void Fastq::decompress() {
       return chunk;
     };
 
-    auto unpack_chunk = [this, upkStruct, has_small_header,
-                         has_small_qscore](std::string decText) mutable {
+    auto unpack_chunk = [&](std::string decText) {
       if (decText.empty()) {
         return std::string{};
       }
 
+      unshuffle_chunk(decText);
       auto i = decText.begin();
 
-      // Unshuffle
-      if (shuffled) {
-        mutxFQ.lock();  //--------------------------------------------------
-        if (verbose && shuffInProg) {
-          std::cerr << bold("[+]") << " Unshuffling ...";
-          shuffle_timer = now();
+      auto read_count = [&]() {
+        u64 count = 0;
+        for (; i != decText.end() && *i != ','; ++i) {
+          if (*i < '0' || *i > '9') {
+            throw std::runtime_error("corrupted file.");
+          }
+          count = count * 10 + static_cast<u64>(*i - '0');
         }
-        shuffInProg = false;
-        mutxFQ.unlock();  //------------------------------------------------
-
-        unshuffle(i, decText.size());
-      }
+        if (i == decText.end()) {
+          throw std::runtime_error("corrupted file.");
+        }
+        ++i;  // ,
+        return count;
+      };
 
-      std::string upkHdrOut, upkSeqOut, upkQsOut;
-      std::string content;
+      std::string upkHdrOut, upkSeqOut, upkQsOut, prevSeq;
+      std::string content, mateContent;
       content.reserve(decText.size() * 2);
+      if (paired) {
+        mateContent.reserve(decText.size());
+      }
+      u64 index = 0;
       do {
+        // Original order kept: each record as [u64 LE index][u64 LE size][record]
+        const size_t frame = content.size();
+        if (keep_order) {
+          index += (u64)unzigzag(unpack_number(i));
+          content.append(16, '\0');
+        }
+
         content += '@';
         std::string plusMore;
 
-        if (has_small_header) {
-          (this->*upkStruct.unpackHdrFPtr)(upkHdrOut, i, upkStruct.hdrUnpack);
-        } else {
-          unpack_large(upkHdrOut, i, upkStruct.XChar_hdr, upkStruct.hdrUnpack);
-        }
-        plusMore = upkHdrOut;
-        content += std::format("{}\n", upkHdrOut);
+        unpack_header(upkHdrOut, i);
+        plusMore = expand_header(upkHdrOut);
+        content += std::format("{}\n", plusMore);
         ++i;  // Hdr
 
-        unpack_seq(upkSeqOut, i);
+        unpack_read_seq(upkSeqOut, i, prevSeq);
         content += std::format("{}\n", upkSeqOut);  // Seq
+        if (reordered) {
+          prevSeq = upkSeqOut;
+        }
 
         content += justPlus ? "+\n" : std::format("+{}\n", plusMore);
         ++i;  // +
 
-        if (has_small_qscore) {
-          (this->*upkStruct.unpackQSFPtr)(upkQsOut, i, upkStruct.qsUnpack);
-        } else {
-          unpack_large(upkQsOut, i, upkStruct.XChar_qs, upkStruct.qsUnpack);
-        }
+        unpack_qscore(upkQsOut, i);
         content += std::format("{}\n", upkQsOut);  // Qs
+        if (keep_order) {
+          put_u64(content, frame, index);
+          put_u64(content, frame + 8, content.size() - frame - 16);
+        }
+
+        if (paired) {
+          ++i;  // Qs
+
+          // Mate header: the same, or [prefix],[suffix],[packed middle]
+          std::string mateHdr = upkHdrOut;
+          if (*i != (char)254) {
+            const u64 prefix = read_count();
+            const u64 suffix = read_count();
+            if (prefix + suffix > upkHdrOut.size()) {
+              throw std::runtime_error("corrupted file.");
+            }
+            std::string middle;
+            if (*i != (char)254) {
+              unpack_header(middle, i);
+            }
+            mateHdr = upkHdrOut.substr(0, prefix) + middle +
+                      upkHdrOut.substr(upkHdrOut.size() - suffix);
+          }
+          mateHdr = expand_header(mateHdr);
+          mateContent += std::format("@{}\n", mateHdr);
+          ++i;  // Hdr
+
+          unpack_read_seq(upkSeqOut, i, prevSeq);
+          mateContent += std::format("{}\n", upkSeqOut);  // Seq
+          mateContent += mateJustPlus ? "+\n" : std::format("+{}\n", mateHdr);
+          ++i;  // +
+
+          unpack_qscore(upkQsOut, i);
+          mateContent += std::format("{}\n", upkQsOut);  // Qs
+        }
       } while (++i != decText.end());
 
-      return content;
+      if (paired) {
+        return bgzf ? join_mates(bgzf_compress(content), bgzf_compress(mateContent))
+                    : join_mates(content, mateContent);
+      }
+      return (bgzf && !keep_order) ? bgzf_compress(content) : content;
     };
 
-    run_ordered_pipeline<std::string>(n_threads, read_chunk, unpack_chunk,
-                                      [](const std::string& output) { std::cout << output; });
+    // Long reads: parts of fields, each ending its line if in capitals
+    auto unpack_long_chunk = [&](std::string decText) {
+      unshuffle_chunk(decText);
+
+      std::string part, content;
+      content.reserve(decText.size() * 2);
+      for (auto i = decText.begin(); i != decText.end(); ++i) {
+        const char kind = *i++;
+        switch (kind) {
+          case 'h':
+            unpack_header(part, i);
+            content += std::format("@{}\n", expand_header(part));
+            break;
+          case 's':
+          case 'S':
+            unpack_seq(part, i);
+            content += part;
+            if (kind == 'S') {
+              content += justPlus ? "\n+\n" : "\n";
+            }
+            break;
+          case 'p':
+            unpack_header(part, i);
+            content += std::format("+{}\n", expand_header(part));
+            break;
+          case 'q':
+          case 'Q':
+            unpack_qscore(part, i);
+            content += part;
+            if (kind == 'Q') {
+              content += '\n';
+            }
+            break;
+          default:
+            throw std::runtime_error("corrupted file.");
+        }
+      }
+
+      return bgzf ? bgzf_compress(content) : content;
+    };
+
+    OutputFile out(out_file, n_threads, out_sink, budget.output_queue);
+    std::optional<OutputFile> mate_out;
+    if (paired) {
+      mate_out.emplace(paired_file, n_threads, nullptr, budget.output_queue);
+    }
+    // Original order kept: the records are sorted back, spilling to disk past
+    // the run size of the budget, and written after all are unpacked
+    ExternalSort restored(spill_cipher(), budget.sort_run);
+    auto emit = [&](std::string output) {
+      if (keep_order) {
+        for (size_t at = 0; at != output.size();) {
+          const u64 size = get_u64(output, at + 8);
+          restored.push(get_u64(output, at), output.substr(at + 16, size));
+          at += 16 + size;
+        }
+        return;
+      }
+      if (!paired) {
+        out.write(std::move(output));
+        return;
+      }
+      const auto [first, second] = split_mates(output);
+      out.write(std::string(first));
+      mate_out->write(std::string(second));
+    };
+    const PipelineStats probe{stats, Stage::plaintext_pull, Stage::unpack};
+    if (longReads) {
+      run_ordered_pipeline<std::string>(n_threads, read_chunk, unpack_long_chunk, emit, pool,
+                                        probe, budget);
+    } else {
+      run_ordered_pipeline<std::string>(n_threads, read_chunk, unpack_chunk, emit, pool, probe,
+                                        budget);
+    }
+    if (keep_order) {
+      // The records merged back into chunks, compressed in parallel
+      u64 expected = 0;
+      auto read_restored = [&]() -> std::optional<std::string> {
+        std::string content;
+        while (content.size() < CHUNK_TARGET_SIZE) {
+          auto record = restored.next();
+          if (!record) {
+            break;
+          }
+          if (record->key != expected++) {  // Not a permutation
+            throw std::runtime_error("corrupted file.");
+          }
+          content += record->data;
+        }
+        if (content.empty()) {
+          return std::nullopt;
+        }
+        return content;
+      };
+      run_ordered_pipeline<std::string>(
+          n_threads, read_restored,
+          [&](std::string content) { return bgzf ? bgzf_compress(content) : content; },
+          [&](std::string content) { out.write(std::move(content)); }, pool, {}, budget);
+    }
+    if (bgzf) {
+      out.write(bgzf_eof());
+      if (paired) {
+        mate_out->write(bgzf_eof());
+      }
+    }
+    out.close();
+    if (paired) {
+      mate_out->close();
+    }
 
     if (verbose && shuffled) {
-      std::cerr << "\r" << bold("[+]") << " Unshuffling done in " << hms(now() - shuffle_timer);
-      std::cerr << bold("[+]") << " Decompressing ...";
+      progress() << "\r" << bold("[+]") << " Unshuffling done in " << hms(now() - shuffle_timer);
+      progress() << bold("[+]") << " Decompressing ...";
     }
   } catch (...) {
     plaintext.fail(std::current_exception());
@@ -550,7 +1489,7 @@ void Fastq::decompress() {
   join_decrypt();
 
   const auto finish = now();  // Stop timer
-  std::cerr << "\r" << bold("[+]") << " Decompressing done in " << hms(finish - start);
+  progress() << "\r" << bold("[+]") << " Decompressing done in " << hms(finish - start);
 }
 
 /**
@@ -677,13 +1616,13 @@ void Fastq::unpack_hS_qS(const unpackfq_s& upkStruct, byte threadID) {
 
     // Unshuffle
     if (shuffled) {
-      mutxFQ.lock();  //----------------------------------------------------
+      mutxShuff.lock();  //-------------------------------------------------
       if (verbose && shuffInProg) {
-        std::cerr << bold("[+]") << " Unshuffling ...";
+        progress() << bold("[+]") << " Unshuffling ...";
         shuffle_timer = now();
       }
       shuffInProg = false;
-      mutxFQ.unlock();  //--------------------------------------------------
+      mutxShuff.unlock();  //-----------------------------------------------
 
       unshuffle(i, chunkSize);
     }
@@ -769,13 +1708,13 @@ void Fastq::unpack_hS_qL(const unpackfq_s& upkStruct, byte threadID) {
 
     // Unshuffle
     if (shuffled) {
-      mutxFQ.lock();  //----------------------------------------------------
+      mutxShuff.lock();  //-------------------------------------------------
       if (verbose && shuffInProg) {
-        std::cerr << bold("[+]") << " Unshuffling ...";
+        progress() << bold("[+]") << " Unshuffling ...";
         shuffle_timer = now();
       }
       shuffInProg = false;
-      mutxFQ.unlock();  //--------------------------------------------------
+      mutxShuff.unlock();  //-----------------------------------------------
 
       unshuffle(i, chunkSize);
     }
@@ -861,13 +1800,13 @@ void Fastq::unpack_hL_qS(const unpackfq_s& upkStruct, byte threadID) {
 
     // Unshuffle
     if (shuffled) {
-      mutxFQ.lock();  //----------------------------------------------------
+      mutxShuff.lock();  //-------------------------------------------------
       if (verbose && shuffInProg) {
-        std::cerr << bold("[+]") << " Unshuffling ...";
+        progress() << bold("[+]") << " Unshuffling ...";
         shuffle_timer = now();
       }
       shuffInProg = false;
-      mutxFQ.unlock();  //--------------------------------------------------
+      mutxShuff.unlock();  //-----------------------------------------------
 
       unshuffle(i, chunkSize);
     }
@@ -952,13 +1891,13 @@ void Fastq::unpack_hL_qL(const unpackfq_s& upkStruct, byte threadID) {
 
     // Unshuffle
     if (shuffled) {
-      mutxFQ.lock();  //----------------------------------------------------
+      mutxShuff.lock();  //-------------------------------------------------
       if (verbose && shuffInProg) {
-        std::cerr << bold("[+]") << " Unshuffling ...";
+        progress() << bold("[+]") << " Unshuffling ...";
         shuffle_timer = now();
       }
       shuffInProg = false;
-      mutxFQ.unlock();  //--------------------------------------------------
+      mutxShuff.unlock();  //-----------------------------------------------
 
       unshuffle(i, chunkSize);
     }
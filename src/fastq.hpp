@@ -9,7 +9,16 @@
 #ifndef CRYFA_FASTQ_H
 #define CRYFA_FASTQ_H
 
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
 #include "endecrypto.hpp"
+#include "qbin.hpp"
+#include "reference.hpp"
 #include "security.hpp"
 
 namespace cryfa {
@@ -36,16 +45,33 @@ struct unpackfq_s {
  */
 class Fastq : public EnDecrypto {
  public:
+  using EnDecrypto::EnDecrypto;
   void compress();
   void decompress();
 
  private:
-  bool justPlus = true; /**< @brief If line 3 is just +  @hideinitializer */
+  bool justPlus = true;                 /**< @brief If line 3 is just +  @hideinitializer */
+  bool longReads = false;               /**< @brief Long-read mode  @hideinitializer */
+  QBin qbinScheme = QBin::none;         /**< @brief Quality score binning scheme */
+  std::array<char, 256> qbinTbl{};      /**< @brief Binned quality score of each char */
+  std::shared_ptr<const Reference> reference; /**< @brief Reads are mapped on it, if set */
+  std::vector<std::string> hdrTokens;   /**< @brief Header dictionary, by code - 128 */
+  std::unordered_map<std::string_view, char> hdrCodes; /**< @brief Code of each token */
 
-  auto has_just_plus() const -> bool;
+  auto has_just_plus(const std::string&) const -> bool;
+  void train_header_dict();
+  void set_header_dict(std::vector<std::string>);
+  auto tokenize_header(std::string_view) const -> std::string;
+  auto expand_header(const std::string&) const -> std::string;
   void gather_h_q(std::string&, std::string&);
   void set_hashTbl_packFn(packfq_s&, const std::string&, const std::string&);
   void pack(const packfq_s&, byte);
+  void pack_read_seq(std::string&, const std::string&, const std::string*);
+  auto pack_overlap(std::string&, const std::string&, const std::string&) -> bool;
+  void unpack_overlap(std::string&, std::string::iterator&, const std::string&);
+  void compress_long(RecordSink&, const packfq_s&, bool);
+  auto shuffle_and_frame(std::string) -> std::string;
+  void bin_qscores(std::string&) const;
   void set_unpackTbl_unpackFn(unpackfq_s&, const std::string&, const std::string&);
   void unpack_hS_qS(const unpackfq_s&, byte);
   void unpack_hS_qL(const unpackfq_s&, byte);
@@ -0,0 +1,159 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file gen.cpp
+ * @brief Synthetic FASTQ/FASTA generator, for reproducible performance runs
+ */
+
+#include <cstdlib>
+#include <exception>  // std::exception
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+
+#include "assert.hpp"
+#include "def.hpp"
+#include "numeric.hpp"
+#include "synthetic.hpp"
+using namespace cryfa;
+
+namespace {
+constexpr size_t WRITE_SIZE = 4 << 20;  // Bytes generated between writes
+
+struct Options {
+  ReadShape shape;
+  u64 size = 0;   // Bytes to generate, at least -- 0: by reads
+  u64 reads = 0;  // Reads to generate
+  u64 seed = 1;
+  std::string out_file;  // Empty: standard output
+};
+
+void usage() {
+  std::cerr
+      << "Usage: cryfa-gen (--size MB | --reads N) [--fasta] [--length SPEC] [--header STYLE]\n"
+         "                 [--quality ALPHABET] [--n-rate R] [--lowercase F]\n"
+         "                 [--line-width N] [--seed N] [-o FILE]\n"
+         "\n"
+         "  --size MB           generate at least MB MiB\n"
+         "  --reads N           generate N reads\n"
+         "  --fasta             FASTA instead of FASTQ\n"
+         "  --length SPEC       read lengths: N, MIN:MAX (uniform) or MEAN~SD (normal)\n"
+         "                      (default: 150)\n"
+         "  --header STYLE      illumina, sra, ont or plain (default: illumina)\n"
+         "  --quality ALPHABET  illumina (Phred 2-41), illumina8 or ncbi4 (binned), or\n"
+         "                      full (Phred 2-93) (default: illumina)\n"
+         "  --n-rate R          fraction of N bases (default: 0.001)\n"
+         "  --lowercase F       fraction of bases in soft-masked runs (default: 0)\n"
+         "  --line-width N      FASTA bases per line, 0 for one line (default: 60)\n"
+         "  --seed N            seed; the same options and seed give the same output\n"
+         "                      (default: 1)\n"
+         "  -o FILE             output file (default: standard output)\n";
+}
+
+auto parse(int argc, char* argv[]) -> std::optional<Options> {
+  Options opt;
+  for (int a = 1; a != argc; ++a) {
+    const std::string arg = argv[a];
+    if (arg == "-h" || arg == "--help") {
+      usage();
+      return std::nullopt;
+    }
+    if (arg == "--fasta") {
+      opt.shape.format = 'A';
+      continue;
+    }
+    assert_single(a + 1 == argc, std::format("no value has been set for \"{}\".", arg));
+    const std::string value = argv[++a];
+    auto number = [&]() -> u64 {
+      assert_single(!is_number(value), std::format("\"{}\" needs a number.", arg));
+      return std::stoull(value);
+    };
+    auto fraction = [&]() -> double {
+      size_t end = 0;
+      double f = -1;
+      try {
+        f = std::stod(value, &end);
+      } catch (const std::exception&) {
+      }
+      assert_single(end != value.size() || f < 0 || f > 1,
+                    std::format("\"{}\" needs a fraction between 0 and 1.", arg));
+      return f;
+    };
+    if (arg == "--size") {
+      opt.size = number() << 20;
+    } else if (arg == "--reads") {
+      opt.reads = number();
+    } else if (arg == "--length") {
+      opt.shape.set_length(value);
+    } else if (arg == "--header") {
+      opt.shape.header = value;
+    } else if (arg == "--quality") {
+      opt.shape.quality = value;
+    } else if (arg == "--n-rate") {
+      opt.shape.n_rate = fraction();
+    } else if (arg == "--lowercase") {
+      opt.shape.lowercase = fraction();
+    } else if (arg == "--line-width") {
+      opt.shape.line_width = number();
+    } else if (arg == "--seed") {
+      opt.seed = number();
+    } else if (arg == "-o" || arg == "--output") {
+      opt.out_file = value;
+    } else {
+      error(std::format("\"{}\" is not an option.", arg));
+    }
+  }
+  assert_single(opt.size == 0 && opt.reads == 0, "set the output by \"--size\" or \"--reads\".");
+  return opt;
+}
+}  // namespace
+
+/**
+ * @brief Generate reads
+ * @param argc Number of command line arguments
+ * @param argv Command line arguments
+ * @return SUCCESS or FAILURE
+ */
+int main(int argc, char* argv[]) {
+  try {
+    const std::optional<Options> opt = parse(argc, argv);
+    if (!opt) {
+      return 0;
+    }
+    SyntheticReads reads(opt->shape, opt->seed);
+
+    std::ofstream file;
+    if (!opt->out_file.empty()) {
+      file.open(opt->out_file, std::ios::binary);
+      assert_single(!file, std::format("failed opening \"{}\".", opt->out_file));
+    }
+    std::ostream& out = opt->out_file.empty() ? std::cout : file;
+    std::ios::sync_with_stdio(false);
+
+    std::string buffer;
+    buffer.reserve(WRITE_SIZE * 2);
+    u64 written = 0;
+    for (u64 n = 0; opt->reads ? n != opt->reads : written < opt->size; ++n) {
+      reads.append(buffer);
+      if (buffer.size() >= WRITE_SIZE) {
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        written += buffer.size();
+        buffer.clear();
+      }
+      if (!opt->reads && written + buffer.size() >= opt->size) {
+        break;
+      }
+    }
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    out.flush();
+    assert_single(!out, "failed writing the output.");
+  } catch (std::exception& e) {
+    std::cerr << e.what();
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+}
@@ -11,6 +11,7 @@
 
 #include <format>
 #include <fstream>
+#include <iostream>
 #include <stdexcept>  // std::runtime_error
 
 #include "string.hpp"
@@ -0,0 +1,90 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file chunk_sizer.hpp
+ * @brief Chunk size of a pipeline, adjusted to the measured packing time
+ */
+
+#ifndef CRYFA_CHUNK_SIZER_HPP
+#define CRYFA_CHUNK_SIZER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+#include "../def.hpp"
+
+namespace cryfa {
+
+/**
+ * @brief Input bytes per chunk of a pipeline, adjusted as it runs. Chunks
+ *        grow while packing one takes less than PACK_TIME, as the costs of
+ *        each chunk (its size, ordering, shuffle setup and record) then
+ *        weigh; they shrink while it takes longer, so the workers share the
+ *        work evenly. While the workers mostly find no chunk queued, reading
+ *        bounds the pipeline, and chunks do not grow. The decoder is given
+ *        the size of each chunk, so it does not depend on them
+ */
+class ChunkSizer {
+ public:
+  static constexpr u64 PACK_TIME = 4'000'000;  // Nanoseconds to pack a chunk, aimed at
+  static constexpr u64 STEP = 64 << 10;        // Sizes are multiples of it
+
+  /**
+   * @param min Smallest size, at least STEP
+   * @param max Largest size
+   * @param workers Threads packing; the size changes once per round of them
+   */
+  ChunkSizer(u64 min, u64 max, size_t workers)
+      : min_(std::max(min, STEP)),
+        max_(std::max(max, min_)),
+        round_(std::max<size_t>(workers, 4)),
+        target_(std::clamp(CHUNK_TARGET_SIZE, min_, max_)) {}
+
+  auto target() const -> u64 { return target_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Count a chunk packed
+   * @param bytes Its input bytes
+   * @param ns Time its packing took
+   * @param queued Chunks left queued when its worker took it
+   */
+  void observe(u64 bytes, u64 ns, size_t queued) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bytes_ += bytes;
+    ns_ += ns;
+    starved_ += queued == 0 ? 1 : 0;
+    if (++chunks_ < round_) {
+      return;
+    }
+
+    const u64 current = target();
+    const u64 ideal = ns_ == 0 ? max_ : static_cast<u64>(static_cast<double>(bytes_) *
+                                                         PACK_TIME / static_cast<double>(ns_));
+    u64 next = std::clamp(ideal, current / 2, current * 2);  // A step at a time
+    if (starved_ * 2 > chunks_) {
+      next = std::min(next, current);
+    }
+    next = std::clamp((next + STEP / 2) / STEP * STEP, min_, max_);
+    target_.store(next, std::memory_order_relaxed);
+    bytes_ = ns_ = 0;
+    chunks_ = starved_ = 0;
+  }
+
+ private:
+  const u64 min_;
+  const u64 max_;
+  const size_t round_;
+  std::atomic<u64> target_;
+  std::mutex mutex_;
+  u64 bytes_ = 0;  // Of the chunks of this round
+  u64 ns_ = 0;
+  size_t chunks_ = 0;
+  size_t starved_ = 0;  // Taken with none queued behind
+};
+
+}  // namespace cryfa
+
+#endif  // CRYFA_CHUNK_SIZER_HPP
@@ -0,0 +1,85 @@
+/* SPDX-FileCopyrightText: 2026 Morteza Hosseini */
+/* SPDX-License-Identifier: GPL-3.0-only */
+
+/**
+ * @file cryfa.h
+ * @brief C API of the library
+ *
+ * All types are opaque, and options are set by name, so the ABI stays the
+ * same as options are added. Handles are independent of each other; any
+ * number of them can be used at once, each from one thread at a time.
+ * Errors are kept by the handle: once a call fails, the later ones fail too,
+ * and cryfa_*_error() tells why.
+ */
+
+#ifndef CRYFA_CRYFA_H
+#define CRYFA_CRYFA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CRYFA_OK 0
+#define CRYFA_ERROR (-1)
+
+typedef struct cryfa_pool cryfa_pool;
+typedef struct cryfa_options cryfa_options;
+typedef struct cryfa_encoder cryfa_encoder;
+typedef struct cryfa_decoder cryfa_decoder;
+
+/**
+ * @brief Receives the output, in order, one call at a time, from a thread of
+ *        the library. Returning other than CRYFA_OK stops the job
+ */
+typedef int (*cryfa_sink)(void* user, const char* data, size_t size);
+
+/**
+ * @brief Worker threads, keys derived from the passwords seen, and references
+ *        loaded, to share among encoders and decoders. Free it after all of them
+ */
+cryfa_pool* cryfa_pool_new(unsigned n_threads);
+void cryfa_pool_free(cryfa_pool* pool);
+
+/**
+ * @brief Options, with the defaults of the command line. They are copied by
+ *        cryfa_encoder_new() and cryfa_decoder_new()
+ */
+cryfa_options* cryfa_options_new(void);
+void cryfa_options_free(cryfa_options* options);
+int cryfa_options_set_key(cryfa_options* options, const char* key, size_t size);
+int cryfa_options_set_pool(cryfa_options* options, cryfa_pool* pool);
+
+/**
+ * @brief Set an option by name: "format" (A, Q or n), "threads", "shuffle"
+ *        (0 or 1), "long_reads" (0 or 1), "qbin", "ref", "reorder", "bgzf"
+ *        (0 or 1), "max_memory" or "max_input" (a size, e.g. 512M)
+ * @return CRYFA_ERROR for an unknown name
+ */
+int cryfa_options_set(cryfa_options* options, const char* name, const char* value);
+
+/**
+ * @brief Compaction + encryption. The input pushed is kept until finished;
+ *        past "max_input" bytes, pushing fails
+ */
+cryfa_encoder* cryfa_encoder_new(const cryfa_options* options, cryfa_sink sink, void* user);
+int cryfa_encoder_push(cryfa_encoder* encoder, const char* data, size_t size);
+int cryfa_encoder_finish(cryfa_encoder* encoder);
+const char* cryfa_encoder_error(const cryfa_encoder* encoder);
+void cryfa_encoder_free(cryfa_encoder* encoder);
+
+/**
+ * @brief Decryption + decompaction. A push returns once its input is consumed
+ */
+cryfa_decoder* cryfa_decoder_new(const cryfa_options* options, cryfa_sink sink, void* user);
+int cryfa_decoder_push(cryfa_decoder* decoder, const char* data, size_t size);
+int cryfa_decoder_finish(cryfa_decoder* decoder);
+const char* cryfa_decoder_error(const cryfa_decoder* decoder);
+void cryfa_decoder_free(cryfa_decoder* decoder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CRYFA_CRYFA_H */
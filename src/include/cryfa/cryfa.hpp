@@ -0,0 +1,162 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file cryfa.hpp
+ * @brief Library API: encryption and decryption of buffers in memory
+ *
+ * The output is produced in the format of the cryfa tool, and read by it.
+ * Neither direction writes temporary files. Errors are thrown as
+ * std::runtime_error.
+ */
+
+#ifndef CRYFA_CRYFA_HPP
+#define CRYFA_CRYFA_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace cryfa {
+
+class ThreadPool;
+class KeyCache;
+class ReferenceCache;
+
+/**
+ * @brief Worker threads, keys derived from the passwords seen, and references
+ *        loaded, shared by the jobs given it
+ */
+class Pool {
+ public:
+  explicit Pool(unsigned n_threads);
+  ~Pool();
+  Pool(const Pool&) = delete;
+  auto operator=(const Pool&) -> Pool& = delete;
+
+  auto handle() const -> ThreadPool* { return pool_.get(); }
+  auto keys() const -> KeyCache* { return keys_.get(); }
+  auto references() const -> ReferenceCache* { return references_.get(); }
+
+ private:
+  std::unique_ptr<ThreadPool> pool_;
+  std::unique_ptr<KeyCache> keys_;
+  std::unique_ptr<ReferenceCache> references_;
+};
+
+/**
+ * @brief Options of a job, as those of the command line
+ */
+struct Options {
+  std::string key;           // Password, at least 8 characters
+  char format = '\0';        // Input: 'A' FASTA, 'Q' FASTQ, 'n' other -- '\0': detect
+  unsigned n_threads = 8;    // Number of threads
+  bool shuffle = true;       // Shuffle before encryption
+  bool long_reads = false;   // Long-read FASTQ mode
+  std::string qbin;          // Quality score binning scheme -- empty: none
+  std::string ref_file;      // Reference FASTA to map FASTQ reads on -- empty: none
+  std::string reorder;       // Reorder reads, "keep" or "drop" their order -- empty: no
+  bool bgzf = false;         // BGZF-compressed output on decryption
+  size_t max_memory = 0;     // Bytes the job's buffers may take -- 0: no budget
+  size_t max_input = 0;      // Bytes of input an encoder may keep -- 0: no limit
+  Pool* pool = nullptr;      // Worker threads, keys and references -- null: of its own
+};
+
+/**
+ * @brief Set an option by name: "format" (A, Q or n), "threads", "shuffle"
+ *        (0 or 1), "long_reads" (0 or 1), "qbin", "ref", "reorder", "bgzf"
+ *        (0 or 1), "max_memory" or "max_input" (a size, e.g. 512M)
+ */
+void set_option(Options& options, std::string_view name, std::string_view value);
+
+/**
+ * @brief Receives the output, in order, one call at a time, from a thread of
+ *        the library
+ */
+using Sink = std::function<void(std::span<const char>)>;
+
+/**
+ * @brief Fills a buffer with input; returns the number of bytes, 0 at the end
+ */
+using Pull = std::function<size_t(std::span<char>)>;
+
+/**
+ * @brief Compaction + encryption
+ */
+class Encoder {
+ public:
+  Encoder(Options options, Sink sink);
+  ~Encoder();
+  Encoder(const Encoder&) = delete;
+  auto operator=(const Encoder&) -> Encoder& = delete;
+
+  /**
+   * @brief Add input. It is kept until finish(), as compaction reads the
+   *        whole input more than once; past max_input bytes, it fails
+   */
+  void write(std::span<const char> data);
+
+  /**
+   * @brief Encode the input written, and flush the output to the sink
+   */
+  void finish();
+
+  /**
+   * @brief Encode an input in memory, read in place
+   */
+  static void encode(const Options& options, std::span<const char> data, const Sink& sink);
+
+  /**
+   * @brief Encode an input pulled until its end, which is kept in memory;
+   *        past max_input bytes, it fails
+   */
+  static void encode(const Options& options, const Pull& pull, const Sink& sink);
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/**
+ * @brief Decryption + decompaction. Archives and paired output are read by
+ *        the cryfa tool
+ */
+class Decoder {
+ public:
+  Decoder(Options options, Sink sink);
+  ~Decoder();
+  Decoder(const Decoder&) = delete;
+  auto operator=(const Decoder&) -> Decoder& = delete;
+
+  /**
+   * @brief Add input. Returns once it is consumed; the output is passed to
+   *        the sink as it is decoded, meanwhile
+   */
+  void write(std::span<const char> data);
+
+  /**
+   * @brief End the input, and wait for the rest of the output
+   */
+  void finish();
+
+  /**
+   * @brief Decode an input in memory
+   */
+  static void decode(const Options& options, std::span<const char> data, const Sink& sink);
+
+  /**
+   * @brief Decode an input pulled until its end. It is read once, in order
+   */
+  static void decode(const Options& options, const Pull& pull, const Sink& sink);
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace cryfa
+
+#endif  // CRYFA_CRYFA_HPP
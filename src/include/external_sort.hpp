@@ -0,0 +1,321 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file external_sort.hpp
+ * @brief Sorting records larger than the memory
+ */
+
+#ifndef CRYFA_EXTERNAL_SORT_HPP
+#define CRYFA_EXTERNAL_SORT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "../def.hpp"
+#include "assert.hpp"
+
+namespace cryfa {
+
+/**
+ * @brief Seals the blocks of records an ExternalSort spills, by their run and
+ *        index in it, and whether they end it; and opens them, throwing if
+ *        they do not authenticate
+ */
+struct SpillCipher {
+  std::function<std::string(u64 run, u64 block, std::string_view plain, bool final)> seal;
+  std::function<std::string(u64 run, u64 block, std::string_view sealed, bool final)> open;
+};
+
+/**
+ * @brief Records sorted by a key. Once the buffered records reach the memory
+ *        budget, they are sorted and spilled to a temporary file as a run; the
+ *        runs are merged on reading. Records of the same key keep the order
+ *        they were pushed in. A run is written in sealed blocks, ended by an
+ *        empty final one, so no record reaches the disk in the clear, and a
+ *        run changed or cut short is caught on reading. At most MERGE_FAN_IN
+ *        runs are merged at once: as many runs of one size are merged into a
+ *        larger one as they are spilled, and the last ones before reading, so
+ *        the open files and the memory of merging stay bounded.
+ */
+class ExternalSort {
+ public:
+  struct Record {
+    u64 key;
+    u64 index;  // Order of pushing
+    std::string data;
+  };
+
+  explicit ExternalSort(SpillCipher cipher, u64 max_memory = SORT_RUN_SIZE)
+      : cipher_(std::move(cipher)), max_memory_(max_memory) {}
+
+  ExternalSort(const ExternalSort&) = delete;
+  auto operator=(const ExternalSort&) -> ExternalSort& = delete;
+
+  ~ExternalSort() {
+    for (Run& run : runs_) {
+      remove(run);
+    }
+  }
+
+  void push(u64 key, std::string data) {
+    memory_ += sizeof(Record) + data.size();
+    buffer_.push_back(Record{key, n_pushed_++, std::move(data)});
+    if (memory_ >= max_memory_) {
+      spill();
+    }
+  }
+
+  /**
+   * @brief Next record in order. Call after pushing all records
+   * @return The record, or nothing at the end
+   */
+  auto next() -> std::optional<Record> {
+    if (!merging_) {
+      merging_ = true;
+      std::sort(buffer_.begin(), buffer_.end(), before);
+      if (!runs_.empty()) {  // Merge the runs, and the rest of the records as one more
+        if (!buffer_.empty()) {
+          spill();
+        }
+        while (runs_.size() > MERGE_FAN_IN) {
+          merge_last(MERGE_FAN_IN);
+        }
+        for (size_t r = 0; r != runs_.size(); ++r) {
+          if (read_record(r)) {
+            heads_.push(r);
+          }
+        }
+      }
+    }
+
+    if (runs_.empty()) {
+      if (next_ == buffer_.size()) {
+        return std::nullopt;
+      }
+      return std::move(buffer_[next_++]);
+    }
+
+    if (heads_.empty()) {
+      return std::nullopt;
+    }
+    const size_t r = heads_.top();
+    heads_.pop();
+    Record record = std::move(*runs_[r].head);
+    if (read_record(r)) {
+      heads_.push(r);
+    }
+    return record;
+  }
+
+ private:
+  static constexpr size_t BLOCK_SIZE = IO_BUFFER_SIZE;  // Bytes of records sealed at once
+  static constexpr size_t HEAD_SIZE = 3 * sizeof(u64);  // Key, index and size of a record
+  static constexpr size_t MERGE_FAN_IN = 32;            // Runs merged at once, at most
+
+  struct Run {
+    u64 id = 0;     // Of the run, for sealing; never reused
+    u64 level = 0;  // Merges that made it
+    std::filesystem::path path;
+    std::unique_ptr<FILE, int (*)(FILE*)> file{nullptr, &std::fclose};
+    std::optional<Record> head;  // Next record of the run
+    std::string block;           // Block being written, or opened and read from
+    size_t at = 0;
+    u64 n_blocks = 0;  // Written, or read so far
+  };
+
+  static auto before(const Record& a, const Record& b) -> bool {
+    return a.key < b.key || (a.key == b.key && a.index < b.index);
+  }
+
+  /**
+   * @brief Start a run in a temporary file
+   * @param level Merges making it
+   */
+  auto open_run(u64 level) -> Run {
+    // In the temporary directory, e.g., TMPDIR. Removed while open where allowed
+    std::error_code ec;
+    Run run;
+    run.id = n_runs_++;
+    run.level = level;
+    run.path = std::filesystem::temp_directory_path(ec) /
+               std::format("cryfa-sort-{:016x}", std::mt19937_64{std::random_device{}()}());
+    if (!ec) {
+      run.file.reset(std::fopen(run.path.string().c_str(), "w+b"));
+    }
+    assert_single(!run.file,
+                  "no temporary file can be made for sorting; set TMPDIR to a writable "
+                  "directory.");
+    std::filesystem::remove(run.path, ec);
+    std::setvbuf(run.file.get(), nullptr, _IOFBF, IO_BUFFER_SIZE);
+    return run;
+  }
+
+  // Each block: its sealed size * 2 + final, then it sealed
+  void write_block(Run& run, bool final) {
+    const std::string sealed = cipher_.seal(run.id, run.n_blocks++, run.block, final);
+    const u64 frame = sealed.size() * 2 + (final ? 1 : 0);
+    if (std::fwrite(&frame, sizeof(frame), 1, run.file.get()) != 1 ||
+        std::fwrite(sealed.data(), 1, sealed.size(), run.file.get()) != sealed.size()) {
+      error("failed writing a temporary file for sorting.");
+    }
+    run.block.clear();
+  }
+
+  void write_record(Run& run, const Record& record) {
+    const u64 head[3] = {record.key, record.index, record.data.size()};
+    run.block.append(reinterpret_cast<const char*>(head), HEAD_SIZE);
+    run.block += record.data;
+    if (run.block.size() >= BLOCK_SIZE) {
+      write_block(run, false);
+    }
+  }
+
+  /**
+   * @brief End a run, and make it ready to be read from its beginning
+   */
+  void close_run(Run& run) {
+    if (!run.block.empty()) {
+      write_block(run, false);
+    }
+    write_block(run, true);
+    assert_single(std::fflush(run.file.get()) != 0,
+                  "failed writing a temporary file for sorting.");
+    std::rewind(run.file.get());
+    run.n_blocks = 0;
+    run.at = 0;
+  }
+
+  static void remove(Run& run) {
+    run.file.reset();
+    std::error_code ec;
+    std::filesystem::remove(run.path, ec);
+  }
+
+  /**
+   * @brief Sort the buffered records, and write them to a temporary file;
+   *        then merge the last runs while MERGE_FAN_IN of them are of one level
+   */
+  void spill() {
+    std::sort(buffer_.begin(), buffer_.end(), before);
+    Run run = open_run(0);
+    for (const Record& record : buffer_) {
+      write_record(run, record);
+    }
+    close_run(run);
+    runs_.push_back(std::move(run));
+    std::vector<Record>().swap(buffer_);
+    memory_ = 0;
+
+    while (runs_.size() >= MERGE_FAN_IN &&
+           runs_[runs_.size() - MERGE_FAN_IN].level == runs_.back().level) {
+      merge_last(MERGE_FAN_IN);
+    }
+  }
+
+  /**
+   * @brief Merge the last runs into one
+   * @param count Number of runs
+   */
+  void merge_last(size_t count) {
+    const size_t first = runs_.size() - count;
+    Run merged = open_run(runs_[first].level + 1);
+    std::priority_queue<size_t, std::vector<size_t>, Later> heads{Later{&runs_}};
+    for (size_t r = first; r != runs_.size(); ++r) {
+      if (read_record(r)) {
+        heads.push(r);
+      }
+    }
+    while (!heads.empty()) {
+      const size_t r = heads.top();
+      heads.pop();
+      write_record(merged, *runs_[r].head);
+      if (read_record(r)) {
+        heads.push(r);
+      }
+    }
+    close_run(merged);
+
+    for (size_t r = first; r != runs_.size(); ++r) {
+      remove(runs_[r]);
+    }
+    runs_.erase(runs_.begin() + static_cast<std::ptrdiff_t>(first), runs_.end());
+    runs_.push_back(std::move(merged));
+  }
+
+  /**
+   * @brief Read the next record of a run, opening its next block if needed
+   * @return False at the end of the run
+   */
+  auto read_record(size_t r) -> bool {
+    Run& run = runs_[r];
+    if (run.at == run.block.size()) {
+      u64 frame = 0;
+      assert_single(std::fread(&frame, sizeof(frame), 1, run.file.get()) != 1,
+                    "failed reading a temporary file for sorting.");
+      const bool final = frame & 1;
+      std::string sealed(frame / 2, '\0');
+      assert_single(std::fread(sealed.data(), 1, sealed.size(), run.file.get()) != sealed.size(),
+                    "failed reading a temporary file for sorting.");
+      try {
+        run.block = cipher_.open(run.id, run.n_blocks++, sealed, final);
+      } catch (const std::exception&) {
+        error("a temporary file for sorting has been changed.");
+      }
+      run.at = 0;
+      if (final) {
+        run.head.reset();
+        return false;
+      }
+    }
+
+    u64 head[3];
+    assert_single(run.block.size() - run.at < HEAD_SIZE,
+                  "failed reading a temporary file for sorting.");
+    std::memcpy(head, run.block.data() + run.at, HEAD_SIZE);
+    run.at += HEAD_SIZE;
+    assert_single(run.block.size() - run.at < head[2],
+                  "failed reading a temporary file for sorting.");
+    run.head.emplace(Record{head[0], head[1], run.block.substr(run.at, head[2])});
+    run.at += head[2];
+    return true;
+  }
+
+  // Heap of the runs by their next records, least first
+  struct Later {
+    const std::vector<Run>* runs;
+    auto operator()(size_t a, size_t b) const -> bool {
+      return before(*(*runs)[b].head, *(*runs)[a].head);
+    }
+  };
+
+  SpillCipher cipher_;
+  u64 max_memory_;
+  u64 memory_ = 0;
+  u64 n_pushed_ = 0;
+  u64 n_runs_ = 0;  // Made so far
+  std::vector<Record> buffer_;
+  std::vector<Run> runs_;
+  bool merging_ = false;
+  size_t next_ = 0;
+  std::priority_queue<size_t, std::vector<size_t>, Later> heads_{Later{&runs_}};
+};
+
+}  // namespace cryfa
+
+#endif  // CRYFA_EXTERNAL_SORT_HPP
@@ -0,0 +1,427 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file gzip.hpp
+ * @brief Gzip/BGZF input functions
+ */
+
+#ifndef CRYFA_GZIP_HPP
+#define CRYFA_GZIP_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#ifdef CRYFA_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "../def.hpp"
+#include "assert.hpp"
+#include "ordered_pipeline.hpp"
+
+namespace cryfa {
+
+constexpr size_t BGZF_BLOCK_SIZE = 0xff00;  // Uncompressed bytes per BGZF block
+constexpr size_t BGZF_MAX_BLOCK = 0x10000;  // Maximum size of a BGZF block
+
+/**
+ * @brief Check the gzip magic number at the beginning of a file
+ * @param path Name of the file
+ * @return True if the file is gzip compressed
+ */
+inline bool is_gzip(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  unsigned char magic[2]{};
+  return in.read(reinterpret_cast<char*>(magic), 2) && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+#ifdef CRYFA_HAVE_ZLIB
+/**
+ * @brief Input stream buffer fed by a background inflater. BGZF blocks are
+ *        inflated in parallel through run_ordered_pipeline; other gzip files
+ *        are inflated as a single stream, overlapped with the parsing.
+ */
+class InflateStreambuf : public std::streambuf {
+ public:
+  InflateStreambuf(const std::string& path, size_t n_threads)
+      : path_(path), in_(path, std::ios::binary) {
+    assert_single(!in_.good(), std::format("failed opening \"{}\".", path));
+    const bool bgzf = is_bgzf();
+    producer_ = std::thread([this, bgzf, n_threads]() {
+      try {
+        bgzf ? inflate_bgzf(n_threads) : inflate_gzip();
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+        data_ready_.notify_all();
+      } catch (const Cancelled&) {
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = std::current_exception();
+        done_ = true;
+        data_ready_.notify_all();
+      }
+    });
+  }
+
+  InflateStreambuf(const InflateStreambuf&) = delete;
+  auto operator=(const InflateStreambuf&) -> InflateStreambuf& = delete;
+
+  ~InflateStreambuf() override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cancelled_ = true;
+      space_ready_.notify_all();
+    }
+    if (producer_.joinable()) {
+      producer_.join();
+    }
+  }
+
+ protected:
+  auto underflow() -> int_type override {
+    if (gptr() < egptr()) {
+      return traits_type::to_int_type(*gptr());
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    data_ready_.wait(lock, [&]() { return error_ || !chunks_.empty() || done_; });
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    if (chunks_.empty()) {
+      return traits_type::eof();
+    }
+
+    current_ = std::move(chunks_.front());
+    chunks_.pop_front();
+    buffered_bytes_ -= current_.size();
+    lock.unlock();
+    space_ready_.notify_all();
+
+    setg(current_.data(), current_.data(), current_.data() + current_.size());
+    return traits_type::to_int_type(*gptr());
+  }
+
+ private:
+  struct Cancelled {};
+
+  static constexpr size_t BGZF_HEADER_SIZE = 18;  // Including the BC subfield
+  static constexpr size_t MAX_BUFFERED = CHUNK_TARGET_SIZE * 8;
+
+  static auto le16(const unsigned char* p) -> u32 { return p[0] | (u32)p[1] << 8; }
+  static auto le32(const unsigned char* p) -> u32 { return le16(p) | le16(p + 2) << 16; }
+
+  // BGZF: gzip members with FEXTRA holding the "BC" subfield (total block size)
+  auto is_bgzf() -> bool {
+    unsigned char h[BGZF_HEADER_SIZE]{};
+    const bool found = in_.read(reinterpret_cast<char*>(h), BGZF_HEADER_SIZE) &&
+                       (h[3] & 4) && le16(h + 10) >= 6 && h[12] == 'B' && h[13] == 'C' &&
+                       le16(h + 14) == 2;
+    in_.clear();
+    in_.seekg(0, std::ios::beg);
+    return found;
+  }
+
+  void push(std::string data) {
+    if (data.empty()) {
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_ready_.wait(lock, [&]() {
+      return cancelled_ || buffered_bytes_ + data.size() <= MAX_BUFFERED || buffered_bytes_ == 0;
+    });
+    if (cancelled_) {
+      throw Cancelled{};
+    }
+
+    buffered_bytes_ += data.size();
+    chunks_.push_back(std::move(data));
+    data_ready_.notify_all();
+  }
+
+  void corrupted() const {
+    error(std::format("\"{}\" is not a valid gzip file.", path_));
+  }
+
+  // Read whole BGZF blocks, about CHUNK_TARGET_SIZE compressed bytes at a time
+  auto read_blocks() -> std::optional<std::string> {
+    std::string blocks;
+    unsigned char h[BGZF_HEADER_SIZE];
+    while (blocks.size() < CHUNK_TARGET_SIZE &&
+           in_.read(reinterpret_cast<char*>(h), BGZF_HEADER_SIZE)) {
+      if (h[0] != 0x1f || h[1] != 0x8b || !(h[3] & 4) || h[12] != 'B' || h[13] != 'C') {
+        corrupted();
+      }
+
+      const size_t block_size = le16(h + 16) + 1;
+      if (block_size < BGZF_HEADER_SIZE + 8) {
+        corrupted();
+      }
+      const size_t offset = blocks.size();
+      blocks.resize(offset + block_size);
+      std::memcpy(blocks.data() + offset, h, BGZF_HEADER_SIZE);
+      if (!in_.read(blocks.data() + offset + BGZF_HEADER_SIZE,
+                    static_cast<std::streamsize>(block_size - BGZF_HEADER_SIZE))) {
+        corrupted();
+      }
+    }
+
+    if (blocks.empty()) {
+      return std::nullopt;
+    }
+    return blocks;
+  }
+
+  auto inflate_blocks(const std::string& blocks) const -> std::string {
+    std::string out;
+    auto p = reinterpret_cast<const unsigned char*>(blocks.data());
+    const auto end = p + blocks.size();
+
+    while (p != end) {
+      const size_t extra_size = le16(p + 10);
+      const size_t block_size = le16(p + 16) + 1;
+      const unsigned char* cdata = p + 12 + extra_size;
+      const unsigned char* trailer = p + block_size - 8;
+      if (cdata > trailer) {
+        corrupted();
+      }
+      const u32 crc = le32(trailer);
+      const u32 isize = le32(trailer + 4);
+      if (isize > BGZF_MAX_BLOCK) {  // Inflated, too, a block is at most 64 KiB
+        corrupted();
+      }
+
+      const size_t offset = out.size();
+      out.resize(offset + isize);
+      z_stream zs{};
+      if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+        corrupted();
+      }
+      zs.next_in = const_cast<Bytef*>(cdata);
+      zs.avail_in = static_cast<uInt>(trailer - cdata);
+      zs.next_out = reinterpret_cast<Bytef*>(out.data() + offset);
+      zs.avail_out = isize;
+      const int ret = inflate(&zs, Z_FINISH);
+      inflateEnd(&zs);
+
+      const auto block = reinterpret_cast<const Bytef*>(out.data() + offset);
+      if (ret != Z_STREAM_END || zs.avail_out != 0 || crc32(0, block, isize) != crc) {
+        corrupted();
+      }
+      p += block_size;
+    }
+    return out;
+  }
+
+  void inflate_bgzf(size_t n_threads) {
+    run_ordered_pipeline<std::string>(
+        n_threads, [this]() { return read_blocks(); },
+        [this](std::string blocks) { return inflate_blocks(blocks); },
+        [this](std::string inflated) { push(std::move(inflated)); });
+  }
+
+  // Plain gzip, possibly with concatenated members
+  void inflate_gzip() {
+    z_stream zs{};
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+      corrupted();
+    }
+    std::unique_ptr<z_stream, int (*)(z_streamp)> guard(&zs, inflateEnd);
+
+    std::string input(CHUNK_TARGET_SIZE, '\0');
+    bool output_full = false;   // Inflater may still hold pending output
+    bool member_ended = false;  // The last member read is complete
+    while (true) {
+      if (zs.avail_in == 0 && !output_full) {
+        in_.read(input.data(), static_cast<std::streamsize>(input.size()));
+        zs.avail_in = static_cast<uInt>(in_.gcount());
+        zs.next_in = reinterpret_cast<Bytef*>(input.data());
+        if (zs.avail_in == 0) {
+          break;
+        }
+      }
+
+      std::string out(CHUNK_TARGET_SIZE, '\0');
+      zs.next_out = reinterpret_cast<Bytef*>(out.data());
+      zs.avail_out = static_cast<uInt>(out.size());
+      const int ret = inflate(&zs, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+        corrupted();
+      }
+      output_full = zs.avail_out == 0;
+      out.resize(out.size() - zs.avail_out);
+      push(std::move(out));
+
+      member_ended = ret == Z_STREAM_END;
+      if (member_ended) {
+        inflateReset(&zs);    // Next member, if any
+        output_full = false;  // An ended member holds no more output
+      }
+    }
+
+    if (!member_ended) {
+      corrupted();
+    }
+  }
+
+  const std::string path_;
+  std::ifstream in_;
+  std::thread producer_;
+  std::mutex mutex_;
+  std::condition_variable data_ready_;
+  std::condition_variable space_ready_;
+  std::deque<std::string> chunks_;
+  std::string current_;
+  std::exception_ptr error_;
+  size_t buffered_bytes_ = 0;
+  bool done_ = false;
+  bool cancelled_ = false;
+};
+
+/**
+ * @brief Input stream over a gzip/BGZF file
+ */
+class InflateStream : public std::istream {
+ public:
+  InflateStream(const std::string& path, size_t n_threads)
+      : std::istream(nullptr), buf_(path, n_threads) {
+    rdbuf(&buf_);
+    exceptions(std::ios::badbit);  // Surface inflate errors instead of a silent EOF
+  }
+
+ private:
+  InflateStreambuf buf_;
+};
+#endif
+
+#ifdef CRYFA_HAVE_ZLIB
+/**
+ * @brief Compress into BGZF blocks, each holding up to BGZF_BLOCK_SIZE bytes
+ * @param data Uncompressed data
+ * @return Concatenated BGZF blocks
+ */
+inline std::string bgzf_compress(std::string_view data) {
+  std::string out;
+  out.reserve(data.size() / 2 + 64);
+
+  z_stream zs{};
+  if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK) {
+    error("failed initializing the BGZF compressor.");
+  }
+  std::unique_ptr<z_stream, int (*)(z_streamp)> guard(&zs, deflateEnd);
+
+  auto put16 = [&](size_t offset, u32 v) {
+    out[offset] = static_cast<char>(v & 0xff);
+    out[offset + 1] = static_cast<char>(v >> 8 & 0xff);
+  };
+  auto put32 = [&](size_t offset, u32 v) {
+    put16(offset, v & 0xffff);
+    put16(offset + 2, v >> 16);
+  };
+
+  do {
+    const std::string_view piece = data.substr(0, BGZF_BLOCK_SIZE);
+    data.remove_prefix(piece.size());
+
+    // 18-byte header with the BC subfield, deflated data, CRC32 and ISIZE
+    const size_t offset = out.size();
+    out.append("\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0\0\0", 18);
+    out.resize(offset + 18 + deflateBound(&zs, static_cast<uLong>(piece.size())));
+
+    for (int level : {Z_DEFAULT_COMPRESSION, 0}) {  // Store what doesn't fit
+      deflateReset(&zs);
+      deflateParams(&zs, level, Z_DEFAULT_STRATEGY);
+      zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(piece.data()));
+      zs.avail_in = static_cast<uInt>(piece.size());
+      zs.next_out = reinterpret_cast<Bytef*>(out.data() + offset + 18);
+      zs.avail_out = static_cast<uInt>(out.size() - offset - 18);
+      if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+        error("failed compressing the BGZF output.");
+      }
+      if (18 + zs.total_out + 8 <= BGZF_MAX_BLOCK) {
+        break;
+      }
+    }
+
+    const size_t block_size = 18 + zs.total_out + 8;
+    out.resize(offset + block_size);
+    put16(offset + 16, static_cast<u32>(block_size - 1));
+    put32(offset + block_size - 8,
+          static_cast<u32>(crc32(0, reinterpret_cast<const Bytef*>(piece.data()),
+                                 static_cast<uInt>(piece.size()))));
+    put32(offset + block_size - 4, static_cast<u32>(piece.size()));
+  } while (!data.empty());
+
+  return out;
+}
+#else
+inline std::string bgzf_compress(std::string_view) {
+  error("BGZF output requires cryfa built with zlib.");
+  return {};
+}
+#endif
+
+/**
+ * @brief Empty BGZF block marking the end of the file
+ * @return The end-of-file block
+ */
+inline std::string bgzf_eof() {
+  return std::string(
+      "\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0\x1b\0\x03\0\0\0\0\0\0\0\0\0", 28);
+}
+
+/**
+ * @brief Wrap a chunk function so that its output is optionally BGZF compressed
+ *        by the same worker thread
+ * @param enabled Whether to compress
+ * @param fn Function producing the uncompressed output of a chunk
+ * @return Wrapped function
+ */
+template <typename Fn>
+auto bgzf_output(bool enabled, Fn fn) {
+  return [enabled, fn = std::move(fn)](auto chunk) mutable -> std::string {
+    std::string out = fn(std::move(chunk));
+    return enabled ? bgzf_compress(out) : out;
+  };
+}
+
+/**
+ * @brief Open an input file, inflating it on the fly if it is gzip compressed
+ * @param path Name of the file
+ * @param n_threads Number of threads inflating BGZF blocks
+ * @return Input stream
+ */
+inline std::unique_ptr<std::istream> open_input(const std::string& path, size_t n_threads = 1) {
+  if (!is_gzip(path)) {
+    return std::make_unique<std::ifstream>(path);
+  }
+
+#ifdef CRYFA_HAVE_ZLIB
+  return std::make_unique<InflateStream>(path, n_threads);
+#else
+  (void)n_threads;
+  error(std::format("\"{}\" is gzip compressed, but cryfa was built without zlib.", path));
+  return nullptr;
+#endif
+}
+
+}  // namespace cryfa
+
+#endif  // CRYFA_GZIP_HPP
@@ -0,0 +1,212 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file input_source.hpp
+ * @brief Input from memory or from a pull function, instead of a file
+ */
+
+#ifndef CRYFA_INPUT_SOURCE_HPP
+#define CRYFA_INPUT_SOURCE_HPP
+
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "../def.hpp"
+#include "assert.hpp"
+
+namespace cryfa {
+
+/**
+ * @brief Input of a job that is not a file. Input in memory is read in place,
+ *        as many times as asked. Pulled input is read once: what is pulled
+ *        before a second stream is opened is kept and replayed to it, e.g.,
+ *        for peeking at the first record
+ */
+class InputSource {
+ public:
+  /** @brief Fill a buffer; return the number of bytes, 0 at the end */
+  using Pull = std::function<size_t(char*, size_t)>;
+
+  explicit InputSource(std::string_view data) : data_(data) {}
+  explicit InputSource(Pull pull) : pulled_(std::make_shared<Pulled>(std::move(pull))) {}
+
+  /**
+   * @brief Stream of the input from its beginning
+   */
+  auto open() -> std::unique_ptr<std::istream> {
+    if (!pulled_) {
+      return std::make_unique<Stream<ViewBuffer>>(data_);
+    }
+    assert_single(pulled_->fresh,
+                  "the input is streamed; it can only be read once from its beginning.");
+    ++pulled_->opened;
+    return std::make_unique<Stream<PullBuffer>>(pulled_);
+  }
+
+  /**
+   * @brief Size of the input, if known before reading it
+   */
+  auto size() const -> std::optional<u64> {
+    return pulled_ ? std::nullopt : std::optional<u64>(data_.size());
+  }
+
+ private:
+  struct Pulled {
+    explicit Pulled(Pull p) : pull(std::move(p)) {}
+    Pull pull;
+    std::string kept;    // Pulled while the first stream is the only one
+    size_t opened = 0;   // Streams opened
+    bool fresh = false;  // Pulled past the kept bytes by a later stream
+  };
+
+  template <typename Buffer>
+  class Stream : public std::istream {
+   public:
+    template <typename Arg>
+    explicit Stream(Arg&& arg) : std::istream(nullptr), buffer_(std::forward<Arg>(arg)) {
+      rdbuf(&buffer_);
+    }
+
+   private:
+    Buffer buffer_;
+  };
+
+  class ViewBuffer : public std::streambuf {
+   public:
+    explicit ViewBuffer(std::string_view data) {
+      char* begin = const_cast<char*>(data.data());
+      setg(begin, begin, begin + data.size());
+    }
+
+   protected:
+    auto seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) -> pos_type
+        override {
+      const off_type base = (dir == std::ios_base::beg)   ? 0
+                            : (dir == std::ios_base::cur) ? gptr() - eback()
+                                                          : egptr() - eback();
+      return seekpos(pos_type(base + off), std::ios_base::in);
+    }
+
+    auto seekpos(pos_type pos, std::ios_base::openmode) -> pos_type override {
+      if (pos < 0 || pos > egptr() - eback()) {
+        return pos_type(off_type(-1));
+      }
+      setg(eback(), eback() + pos, egptr());
+      return pos;
+    }
+  };
+
+  class PullBuffer : public std::streambuf {
+   public:
+    explicit PullBuffer(std::shared_ptr<Pulled> pulled) : pulled_(std::move(pulled)) {}
+
+   protected:
+    auto underflow() -> int_type override {
+      Pulled& p = *pulled_;
+      const size_t at = pos_ + static_cast<size_t>(gptr() - eback());  // Next byte
+      char* begin = nullptr;
+      size_t n = 0;
+      if (at < p.kept.size()) {  // Replay
+        begin = p.kept.data() + at;
+        n = p.kept.size() - at;
+      } else if (p.opened == 1) {  // Keep
+        p.kept.resize(at + CHUNK_TARGET_SIZE);
+        n = p.pull(p.kept.data() + at, CHUNK_TARGET_SIZE);
+        p.kept.resize(at + n);
+        begin = p.kept.data() + at;
+      } else {
+        p.fresh = true;
+        buffer_.resize(CHUNK_TARGET_SIZE);
+        n = p.pull(buffer_.data(), buffer_.size());
+        begin = buffer_.data();
+      }
+
+      pos_ = at;
+      if (n == 0) {
+        setg(nullptr, nullptr, nullptr);
+        return traits_type::eof();
+      }
+      setg(begin, begin, begin + n);
+      return traits_type::to_int_type(*gptr());
+    }
+
+    // Only back to a kept position, before anything past it is pulled
+    auto seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) -> pos_type
+        override {
+      if (dir != std::ios_base::beg) {
+        return pos_type(off_type(-1));
+      }
+      return seekpos(pos_type(off), std::ios_base::in);
+    }
+
+    auto seekpos(pos_type pos, std::ios_base::openmode) -> pos_type override {
+      const Pulled& p = *pulled_;
+      if (pos < 0 || p.fresh || static_cast<size_t>(pos) > p.kept.size()) {
+        return pos_type(off_type(-1));
+      }
+      pos_ = static_cast<size_t>(pos);
+      setg(nullptr, nullptr, nullptr);
+      return pos;
+    }
+
+   private:
+    std::shared_ptr<Pulled> pulled_;
+    std::string buffer_;
+    size_t pos_ = 0;  // Position of the get area in the input
+  };
+
+  std::string_view data_;
+  std::shared_ptr<Pulled> pulled_;
+};
+
+/**
+ * @brief Format of an input: FASTQ 'Q', FASTA 'A' or other 'n'
+ * @param open Open the input from its beginning
+ * @return A character
+ */
+template <typename Open>
+char input_format(Open&& open) {
+  char c;
+  auto in = open();
+
+  // Skip leading blank lines or spaces
+  while (in->peek() == '\n' || in->peek() == ' ') {
+    in->get(c);
+  }
+
+  // Fastq
+  while (in->peek() == '@') {
+    IGNORE_THIS_LINE(*in);
+  }
+  while (in->get(c) && c != '\n') {
+  }
+
+  if (in->peek() == '+') {
+    return 'Q';
+  }  // Fastq
+
+  // Fasta or Not Fasta/Fastq
+  in = open();  // Return to beginning of the input
+  while (in->peek() != '>' && in->peek() != EOF) {
+    IGNORE_THIS_LINE(*in);
+  }
+
+  if (in->peek() == '>') {
+    return 'A';
+  }  // Fasta
+  else {
+    return 'n';
+  }  // Not Fasta/Fastq
+}
+
+}  // namespace cryfa
+
+#endif  // CRYFA_INPUT_SOURCE_HPP
@@ -0,0 +1,101 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file memory_budget.hpp
+ * @brief Sizes of the chunks, windows, buffers and caches of a job, derived
+ *        from the memory it may use
+ */
+
+#ifndef CRYFA_MEMORY_BUDGET_HPP
+#define CRYFA_MEMORY_BUDGET_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <format>
+#include <string>
+
+#include "../def.hpp"
+#include "assert.hpp"
+
+namespace cryfa {
+
+constexpr u64 MIN_MEMORY = 16ULL << 20;               // Smallest budget
+constexpr u64 MIN_CHUNK_SIZE = 64 << 10;               // Chunks shrink to this, at most
+constexpr u64 MAX_CHUNK_SIZE = 4 * CHUNK_TARGET_SIZE;  // Chunks grow to this, at most
+// Bytes live per byte of a chunk in flight, at most: the chunk, its packed,
+// shuffled or sealed copies, and the positions of unshuffling, 8 per byte
+constexpr u64 CHUNK_COST = 12;
+
+/**
+ * @brief Parse a size: bytes, or KiB, MiB, GiB or TiB with the suffix K, M,
+ *        G or T
+ */
+inline auto parse_size(const std::string& s) -> u64 {
+  const size_t digits =
+      std::find_if(s.begin(), s.end(), [](char c) { return !std::isdigit(c); }) - s.begin();
+  std::string suffix = s.substr(digits);
+  if (suffix.size() == 3 && (suffix.ends_with("iB") || suffix.ends_with("ib"))) {
+    suffix.resize(1);
+  } else if (suffix.size() == 2 && (suffix.back() == 'B' || suffix.back() == 'b')) {
+    suffix.resize(1);
+  }
+  const std::string units = "KMGT";
+  const size_t unit =
+      suffix.empty() ? 0 : units.find(static_cast<char>(std::toupper(suffix.front()))) + 1;
+  assert_single(digits == 0 || digits > 15 || suffix.size() > 1 ||
+                    (unit == 0 && !suffix.empty()),
+                std::format("\"{}\" is not a size; use bytes, or a number with K, M, G or T.", s));
+  return std::stoull(s.substr(0, digits)) << (10 * unit);
+}
+
+/**
+ * @brief Memory of a job's pipelines. The defaults are those without a
+ *        budget; a budget scales them down, never up
+ */
+struct MemoryBudget {
+  u64 max_chunk_size = MAX_CHUNK_SIZE;  // Input bytes per chunk encoded, at most
+  size_t window = 0;                    // Chunks in flight in a pipeline -- 0: 2 per worker
+  u64 window_bytes = 0;                 // Their bytes -- 0: no limit; a lone chunk passes
+  size_t plaintext_buffer = std::max<size_t>(CHUNK_TARGET_SIZE * 4, IO_BUFFER_SIZE * 4);
+  size_t output_queue = CHUNK_TARGET_SIZE * 8;   // Bytes queued for the output writers
+  u64 unshuffle_cache = 128 * CHUNK_TARGET_SIZE;  // Bytes of cached unshuffle positions
+  u64 sort_run = SORT_RUN_SIZE;  // Bytes of records a sort keeps before spilling a run
+
+  /**
+   * @brief Split a budget: a half for the chunks in flight of the two
+   *        pipelines that run at once on decryption, an eighth each for the
+   *        plaintext stream, the output queue, the unshuffle cache and the
+   *        records a sort keeps before spilling, e.g., for reordering. The
+   *        merging of the spilled runs, the readers, dictionaries and the
+   *        allocator take what is left
+   * @param max_memory Bytes -- 0: no budget
+   * @param workers Threads of each pipeline
+   */
+  static auto of(u64 max_memory, size_t workers) -> MemoryBudget {
+    MemoryBudget b;
+    if (max_memory == 0) {
+      return b;
+    }
+    assert_single(max_memory < MIN_MEMORY,
+                  std::format("the memory budget must be at least {} MiB.", MIN_MEMORY >> 20));
+    workers = std::max<size_t>(1, workers);
+    const u64 eighth = max_memory / 8;
+
+    b.window_bytes = max_memory / 4 / CHUNK_COST;
+    b.max_chunk_size = std::clamp<u64>(b.window_bytes / (2 * workers), MIN_CHUNK_SIZE,
+                                       MAX_CHUNK_SIZE);
+    b.window = static_cast<size_t>(
+        std::clamp<u64>(b.window_bytes / b.max_chunk_size, 1, 2 * static_cast<u64>(workers)));
+    b.plaintext_buffer = static_cast<size_t>(std::min<u64>(b.plaintext_buffer, eighth));
+    b.output_queue = static_cast<size_t>(std::min<u64>(b.output_queue, eighth));
+    b.unshuffle_cache = std::min(b.unshuffle_cache, eighth);
+    b.sort_run = std::min(b.sort_run, eighth);
+    return b;
+  }
+};
+
+}  // namespace cryfa
+
+#endif  // CRYFA_MEMORY_BUDGET_HPP
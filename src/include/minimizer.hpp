@@ -0,0 +1,131 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file minimizer.hpp
+ * @brief Minimizers of DNA sequences
+ */
+
+#ifndef CRYFA_MINIMIZER_HPP
+#define CRYFA_MINIMIZER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+#include "../def.hpp"
+
+namespace cryfa {
+
+/**
+ * @brief Complement of a base; 'N' for all but A/C/G/T
+ */
+inline auto complement_base(char base) -> char {
+  switch (base) {
+    case 'A':
+      return 'T';
+    case 'C':
+      return 'G';
+    case 'G':
+      return 'C';
+    case 'T':
+      return 'A';
+    default:
+      return 'N';
+  }
+}
+
+/**
+ * @brief Invertible hash of a k-mer, so minimizers are not biased to poly-A
+ */
+inline auto mix_kmer(u64 key, u64 mask) -> u64 {
+  key = (~key + (key << 21)) & mask;
+  key = key ^ key >> 24;
+  key = ((key + (key << 3)) + (key << 8)) & mask;
+  key = key ^ key >> 14;
+  key = ((key + (key << 2)) + (key << 4)) & mask;
+  key = key ^ key >> 28;
+  key = (key + (key << 31)) & mask;
+  return key;
+}
+
+/**
+ * @brief Call fn(hash, position * 2 + reverse) for each minimizer of the
+ *        canonical A/C/G/T k-mers, over a sliding window of W k-mers.
+ *        reverse is set if the k-mer is the reverse complement of its canonical
+ * @tparam K k-mer size, odd, so a k-mer is never its own reverse complement
+ * @tparam W Number of k-mers in a window
+ */
+template <size_t K, size_t W, typename Fn>
+void for_each_minimizer(std::string_view seq, Fn&& fn) {
+  constexpr u64 mask = (1ULL << (2 * K)) - 1;
+  struct Entry {
+    u64 hash;
+    u64 info;
+  };
+  std::array<Entry, W> ring{};  // Last W k-mers
+  size_t slot = W - 1;          // Slot of the last k-mer in the ring
+  size_t best = 0;              // Slot of the minimum in the ring
+  u64 forward = 0, reverse = 0;
+  size_t n_valid = 0;
+  u64 last = ~0ULL;
+  for (size_t i = 0; i != seq.size(); ++i) {
+    u64 code = 0;
+    switch (seq[i]) {
+      case 'A':
+      case 'a':
+        code = 0;
+        break;
+      case 'C':
+      case 'c':
+        code = 1;
+        break;
+      case 'G':
+      case 'g':
+        code = 2;
+        break;
+      case 'T':
+      case 't':
+        code = 3;
+        break;
+      default:  // Restart the k-mers
+        n_valid = 0;
+        slot = W - 1;
+        continue;
+    }
+    forward = (forward << 2 | code) & mask;
+    reverse = reverse >> 2 | (3 - code) << (2 * K - 2);
+    if (++n_valid < K) {
+      continue;
+    }
+
+    const size_t n_kmers = n_valid - K + 1;
+    slot = (slot == W - 1) ? 0 : slot + 1;
+    ring[slot] = Entry{mix_kmer(std::min(forward, reverse), mask),
+                       (i + 1 - K) * 2 + (reverse < forward ? 1 : 0)};
+    if (n_kmers == 1 || ring[slot].hash < ring[best].hash) {
+      best = slot;
+    } else if (slot == best) {  // The minimum left the window: the oldest least one
+      best = (slot == W - 1) ? 0 : slot + 1;
+      for (size_t k = best + 1; k != W; ++k) {
+        if (ring[k].hash < ring[best].hash) {
+          best = k;
+        }
+      }
+      for (size_t k = 0; k <= slot; ++k) {
+        if (ring[k].hash < ring[best].hash) {
+          best = k;
+        }
+      }
+    }
+    if (n_kmers >= W && ring[best].info != last) {
+      last = ring[best].info;
+      fn(ring[best].hash, last);
+    }
+  }
+}
+
+}  // namespace cryfa
+
+#endif  // CRYFA_MINIMIZER_HPP
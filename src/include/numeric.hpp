@@ -12,6 +12,8 @@
 #include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 
 #include "assert.hpp"
 #include "string.hpp"
@@ -66,4 +68,43 @@ inline bool is_number(const std::string& s) {
   return std::find_if(s.begin(), s.end(), [](char c) { return !std::isdigit(c); }) == s.end();
 }
 
+/**
+ * @brief Append a number in base 125. Digits but the last are offset by 125,
+ *        so no byte reaches 250, and markers from 250 up stay unambiguous
+ * @param[out] out Output
+ * @param n Number
+ */
+inline void pack_number(std::string& out, unsigned long long n) {
+  char digits[10];
+  size_t n_digits = 0;
+  do {
+    digits[n_digits++] = static_cast<char>(n % 125);
+    n /= 125;
+  } while (n);
+  while (n_digits > 1) {
+    out += static_cast<char>(125 + digits[--n_digits]);
+  }
+  out += digits[0];
+}
+
+/**
+ * @brief Read a number packed by pack_number
+ * @param i Input string iterator. It stops after the number
+ * @return Number
+ */
+inline unsigned long long unpack_number(std::string::iterator& i) {
+  unsigned long long n = 0;
+  for (size_t n_digits = 0; n_digits != 10; ++n_digits) {
+    const auto digit = static_cast<unsigned char>(*i++);
+    if (digit < 125) {
+      return n * 125 + digit;
+    }
+    if (digit >= 250) {
+      break;
+    }
+    n = n * 125 + (digit - 125);
+  }
+  throw std::runtime_error("corrupted file.");
+}
+
 #endif  // CRYFA_NUMERIC_HPP
@@ -10,6 +10,7 @@
 #define CRYFA_ORDERED_PIPELINE_HPP
 
 #include <algorithm>
+#include <chrono>
 #include <condition_variable>
 #include <cstddef>
 #include <deque>
@@ -19,35 +20,72 @@
 #include <optional>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "../def.hpp"
+#include "chunk_sizer.hpp"
+#include "memory_budget.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
 
 namespace cryfa {
 
+// Input bytes of a chunk, for the stats of reading it and the memory budget
+template <typename Chunk>
+auto chunk_bytes(const Chunk& chunk) -> u64 {
+  if constexpr (requires { chunk.size(); }) {
+    return chunk.size();
+  } else if constexpr (requires { chunk.bytes; }) {
+    return chunk.bytes;
+  } else if constexpr (requires { chunk.sealed.size(); }) {
+    return chunk.sealed.size();
+  } else {
+    return 0;
+  }
+}
+
+/**
+ * @brief Read chunks, pack them in parallel and emit them in order. The
+ *        reader waits while the window of chunks read but not emitted is
+ *        full, in chunks or in bytes of the budget; a chunk larger than the
+ *        bytes is let in alone. Given a sizer, each chunk packed is counted
+ *        to it, with the chunks left queued behind it
+ */
 template <typename Chunk, typename ReadChunk, typename PackChunk, typename Emit>
 void run_ordered_pipeline(size_t worker_count, ReadChunk&& read_chunk, PackChunk&& pack_chunk,
-                          Emit&& emit) {
+                          Emit&& emit, ThreadPool* pool = nullptr,
+                          const PipelineStats& probe = {}, const MemoryBudget& budget = {},
+                          ChunkSizer* sizer = nullptr) {
   worker_count = std::max<size_t>(1, worker_count);
 
   struct WorkItem {
     u64 index = 0;
+    u64 bytes = 0;
     Chunk chunk;
   };
+  struct Result {
+    std::string packed;
+    u64 bytes = 0;  // Of the chunk read
+  };
 
-  const size_t max_in_flight = std::max<size_t>(1, worker_count * 2);
+  const size_t max_in_flight =
+      budget.window ? budget.window : std::max<size_t>(1, worker_count * 2);
   std::mutex mutex;
   std::condition_variable work_ready;
   std::condition_variable space_ready;
   std::condition_variable result_ready;
   std::deque<WorkItem> work_queue;
-  std::map<u64, std::string> results;
+  std::map<u64, Result> results;
+  std::map<u64, Stats::time_point> packed_at;  // Traced: when each result was done
+  const bool tracing = probe.stats && probe.stats->tracing();
   std::exception_ptr error;
   bool reader_done = false;
   u64 chunks_read = 0;
   u64 next_to_write = 0;
   size_t in_flight = 0;
+  u64 bytes_in_flight = 0;
 
   auto set_error = [&](std::exception_ptr ptr) {
     std::lock_guard<std::mutex> lock(mutex);
@@ -60,18 +98,105 @@ void run_ordered_pipeline(size_t worker_count, ReadChunk&& read_chunk, PackChunk
     result_ready.notify_all();
   };
 
+  // Chunk functions may also take the chunk's index in the stream
+  auto pack_item = [&](WorkItem& item, size_t queued) -> std::string {
+    const auto start = probe.stats || sizer ? now() : Stats::time_point{};
+    std::string packed;
+    if constexpr (std::is_invocable_v<PackChunk&, Chunk, u64>) {
+      packed = pack_chunk(std::move(item.chunk), item.index);
+    } else {
+      packed = pack_chunk(std::move(item.chunk));
+    }
+    if (probe.stats) {
+      probe.stats->busy(probe.work, start, packed.size(), item.index);
+    }
+    if (sizer) {
+      const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now() - start);
+      sizer->observe(item.bytes, static_cast<u64>(ns.count()), queued);
+    }
+    return packed;
+  };
+
+  // Under the lock
+  auto add_result = [&](const WorkItem& item, std::string packed) {
+    results.emplace(item.index, Result{std::move(packed), item.bytes});
+    if (tracing) {
+      packed_at.emplace(item.index, now());
+    }
+    result_ready.notify_all();
+  };
+
+  // With a pool, each chunk read is one task of packing a queued item
+  std::condition_variable task_done;
+  size_t tasks_pending = 0;
+  auto run_task = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!error && !work_queue.empty()) {
+      WorkItem item = std::move(work_queue.front());
+      work_queue.pop_front();
+      const size_t queued = work_queue.size();
+      lock.unlock();
+
+      std::string packed;
+      std::exception_ptr task_error;
+      try {
+        packed = pack_item(item, queued);
+      } catch (...) {
+        task_error = std::current_exception();
+      }
+      if (task_error) {
+        set_error(task_error);
+      }
+
+      lock.lock();
+      if (!task_error) {
+        add_result(item, std::move(packed));
+      }
+    }
+    --tasks_pending;
+    task_done.notify_all();
+  };
+
   std::thread reader([&]() {
     try {
-      while (std::optional<Chunk> chunk = read_chunk()) {
-        std::unique_lock<std::mutex> lock(mutex);
-        space_ready.wait(lock, [&]() { return error || in_flight < max_in_flight; });
-        if (error) {
-          return;
+      for (u64 index = 0;; ++index) {
+        auto start = probe.stats ? now() : Stats::time_point{};
+        std::optional<Chunk> chunk = read_chunk();
+        if (!chunk) {
+          break;
         }
+        const u64 bytes = chunk_bytes(*chunk);
+        if (probe.stats) {
+          probe.stats->busy(probe.read, start, bytes, index);
+          start = now();
+        }
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          space_ready.wait(lock, [&]() {
+            return error || in_flight == 0 ||
+                   (in_flight < max_in_flight &&
+                    (!budget.window_bytes || bytes_in_flight + bytes <= budget.window_bytes));
+          });
+          if (error) {
+            return;
+          }
 
-        work_queue.push_back(WorkItem{chunks_read++, std::move(*chunk)});
-        ++in_flight;
-        work_ready.notify_one();
+          work_queue.push_back(WorkItem{chunks_read++, bytes, std::move(*chunk)});
+          ++in_flight;
+          bytes_in_flight += bytes;
+          if (probe.stats) {
+            probe.stats->blocked(probe.read, start, index);
+            probe.stats->queue(probe.read, in_flight, max_in_flight);
+          }
+          if (pool) {
+            ++tasks_pending;
+          } else {
+            work_ready.notify_one();
+          }
+        }
+        if (pool) {
+          pool->submit(run_task);
+        }
       }
 
       std::lock_guard<std::mutex> lock(mutex);
@@ -84,37 +209,43 @@ void run_ordered_pipeline(size_t worker_count, ReadChunk&& read_chunk, PackChunk
   });
 
   std::vector<std::thread> workers;
-  workers.reserve(worker_count);
-  for (size_t i = 0; i != worker_count; ++i) {
-    workers.emplace_back([&]() {
-      try {
-        while (true) {
-          WorkItem item;
-          {
-            std::unique_lock<std::mutex> lock(mutex);
-            work_ready.wait(lock, [&]() { return error || !work_queue.empty() || reader_done; });
-            if (error || (work_queue.empty() && reader_done)) {
-              return;
+  if (!pool) {
+    workers.reserve(worker_count);
+    for (size_t i = 0; i != worker_count; ++i) {
+      workers.emplace_back([&]() {
+        try {
+          while (true) {
+            WorkItem item;
+            size_t queued = 0;
+            {
+              std::unique_lock<std::mutex> lock(mutex);
+              work_ready.wait(lock,
+                              [&]() { return error || !work_queue.empty() || reader_done; });
+              if (error || (work_queue.empty() && reader_done)) {
+                return;
+              }
+              item = std::move(work_queue.front());
+              work_queue.pop_front();
+              queued = work_queue.size();
             }
-            item = std::move(work_queue.front());
-            work_queue.pop_front();
-          }
 
-          std::string packed = pack_chunk(std::move(item.chunk));
+            std::string packed = pack_item(item, queued);
 
-          std::lock_guard<std::mutex> lock(mutex);
-          results.emplace(item.index, std::move(packed));
-          result_ready.notify_all();
+            std::lock_guard<std::mutex> lock(mutex);
+            add_result(item, std::move(packed));
+          }
+        } catch (...) {
+          set_error(std::current_exception());
         }
-      } catch (...) {
-        set_error(std::current_exception());
-      }
-    });
+      });
+    }
   }
 
   try {
     while (true) {
       std::string packed;
+      const u64 index = next_to_write;  // Only the emitter changes it
+      auto start = probe.stats ? now() : Stats::time_point{};
       {
         std::unique_lock<std::mutex> lock(mutex);
         result_ready.wait(lock, [&]() {
@@ -130,14 +261,28 @@ void run_ordered_pipeline(size_t worker_count, ReadChunk&& read_chunk, PackChunk
         }
 
         auto result = results.find(next_to_write);
-        packed = std::move(result->second);
+        packed = std::move(result->second.packed);
+        bytes_in_flight -= result->second.bytes;
         results.erase(result);
+        if (tracing) {
+          auto done = packed_at.find(next_to_write);
+          probe.stats->order(probe.emit, done->second, next_to_write);
+          packed_at.erase(done);
+        }
         --in_flight;
         ++next_to_write;
         space_ready.notify_one();
       }
 
-      emit(packed);
+      if (probe.stats) {
+        probe.stats->blocked(probe.emit, start, index);
+        start = now();
+      }
+      const size_t size = packed.size();
+      emit(std::move(packed));
+      if (probe.stats) {
+        probe.stats->busy(probe.emit, start, size, index);
+      }
     }
   } catch (...) {
     set_error(std::current_exception());
@@ -151,6 +296,10 @@ void run_ordered_pipeline(size_t worker_count, ReadChunk&& read_chunk, PackChunk
       worker.join();
     }
   }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    task_done.wait(lock, [&]() { return tasks_pending == 0; });
+  }
 
   if (error) {
     std::rethrow_exception(error);
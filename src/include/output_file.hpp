@@ -0,0 +1,534 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file output_file.hpp
+ * @brief Output file functions
+ */
+
+#ifndef CRYFA_OUTPUT_FILE_HPP
+#define CRYFA_OUTPUT_FILE_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "../def.hpp"
+#include "assert.hpp"
+
+namespace cryfa {
+
+/**
+ * @brief Ordered output. Chunks are handed over in order by a single thread.
+ *        - File name given: each chunk gets its offset from the running total
+ *          and is written with pwrite by a pool of writer threads into a
+ *          preallocated file.
+ *        - No file name: a dedicated writer thread drains the queue into the
+ *          standard output with writev, or with vmsplice when it is a pipe.
+ *        - Sink given: a dedicated writer thread hands the chunks to it, in
+ *          order, instead of writing them to a file.
+ *        Small chunks are first gathered in page-aligned staging buffers.
+ */
+class OutputFile {
+ public:
+  using Sink = std::function<void(std::string_view)>;
+
+  explicit OutputFile(const std::string& path = "", size_t n_writers = 1, Sink sink = nullptr,
+                      size_t max_queued = CHUNK_TARGET_SIZE * 8)
+      : max_queued_(max_queued), sink_(std::move(sink)) {
+#ifdef _WIN32
+    (void)n_writers;
+    if (!sink_ && !path.empty()) {
+      file_.open(path, std::ios::binary | std::ios::trunc);
+      assert_single(!file_.good(), std::format("failed opening \"{}\".", path));
+    }
+#else
+    if (sink_) {
+      positional_ = false;
+      n_writers = 1;
+    } else if (path.empty()) {
+      std::cout.flush();
+      fd_ = STDOUT_FILENO;
+      positional_ = false;
+      n_writers = 1;
+#ifdef __linux__
+      struct stat st{};
+      if (::fstat(fd_, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        splice_ = pipe_capacity() != 0;
+      }
+#endif
+    } else {
+      fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      assert_single(fd_ < 0, std::format("failed opening \"{}\".", path));
+      positional_ = true;
+      n_writers = std::max<size_t>(1, n_writers);
+    }
+
+    writers_.reserve(n_writers);
+    for (size_t i = 0; i != n_writers; ++i) {
+      writers_.emplace_back([this]() { positional_ ? positional_loop() : stream_loop(); });
+    }
+#endif
+  }
+
+  OutputFile(const OutputFile&) = delete;
+  auto operator=(const OutputFile&) -> OutputFile& = delete;
+
+  ~OutputFile() {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  void write(std::string data) {
+    if (data.empty()) {
+      return;
+    }
+
+#ifdef _WIN32
+    if (sink_) {
+      sink_(data);
+    } else {
+      auto& out = file_.is_open() ? static_cast<std::ostream&>(file_) : std::cout;
+      out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+    cursor_ += data.size();
+#else
+    // Gather small chunks; hand over large ones as they are
+    if (data.size() < OUTPUT_BUFFER_SIZE / 2) {
+      if (staging_.buffer && staging_.size + data.size() > OUTPUT_BUFFER_SIZE) {
+        flush_staging();
+      }
+      if (!staging_.buffer) {
+        staging_ = take_buffer();
+      }
+      std::memcpy(staging_.buffer.get() + staging_.size, data.data(), data.size());
+      staging_.size += data.size();
+      return;
+    }
+
+    flush_staging();
+    Job job;
+    job.data = std::move(data);
+    submit(std::move(job));
+#endif
+  }
+
+  void close() {
+    if (closed_) {
+      return;
+    }
+    closed_ = true;
+
+#ifdef _WIN32
+    if (file_.is_open()) {
+      file_.close();
+    } else if (!sink_) {
+      std::cout.flush();
+    }
+#else
+    if (!error_) {
+      flush_staging();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+      job_ready_.notify_all();
+    }
+    for (auto& writer : writers_) {
+      if (writer.joinable()) {
+        writer.join();
+      }
+    }
+
+    if (positional_) {
+      // Drop the preallocated tail beyond the last written byte
+      const bool truncated = ::ftruncate(fd_, static_cast<off_t>(cursor_)) == 0;
+      const bool fd_closed = ::close(fd_) == 0;
+      if (error_) {
+        std::rethrow_exception(error_);
+      }
+      assert_single(!truncated || !fd_closed, "failed writing the output file.");
+    } else {
+      drain_pipe();
+      if (error_) {
+        std::rethrow_exception(error_);
+      }
+    }
+#endif
+  }
+
+  /**
+   * @brief Number of bytes written so far, including those being gathered
+   */
+  auto size() const -> u64 {
+#ifdef _WIN32
+    return cursor_;
+#else
+    return cursor_ + staging_.size;
+#endif
+  }
+
+ private:
+  static constexpr size_t PAGE_ALIGN = 4096;
+  static constexpr size_t MAX_IOV = 64;
+
+  struct AlignedDelete {
+    void operator()(char* p) const { ::operator delete[](p, std::align_val_t{PAGE_ALIGN}); }
+  };
+  using AlignedPtr = std::unique_ptr<char[], AlignedDelete>;
+
+  struct Job {
+    u64 offset = 0;
+    std::string data;   // Chunk handed over as it is
+    AlignedPtr buffer;  // Staging buffer with gathered small chunks
+    size_t size = 0;    // Used bytes of the staging buffer
+
+    auto view() const -> std::string_view {
+      return buffer ? std::string_view(buffer.get(), size) : std::string_view(data);
+    }
+  };
+
+#ifndef _WIN32
+  auto take_buffer() -> Job {
+    Job job;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!spare_buffers_.empty()) {
+        job.buffer = std::move(spare_buffers_.back());
+        spare_buffers_.pop_back();
+      }
+    }
+    if (!job.buffer) {
+      job.buffer = AlignedPtr(
+          static_cast<char*>(::operator new[](OUTPUT_BUFFER_SIZE, std::align_val_t{PAGE_ALIGN})));
+    }
+    return job;
+  }
+
+  void recycle(Job& job) {
+    if (!job.buffer) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (spare_buffers_.size() < MAX_IOV) {
+      spare_buffers_.push_back(std::move(job.buffer));
+    }
+  }
+
+  void flush_staging() {
+    if (staging_.buffer && staging_.size != 0) {
+      submit(std::move(staging_));
+    }
+    staging_ = Job{};
+  }
+
+  void submit(Job job) {
+    const size_t size = job.view().size();
+    job.offset = cursor_;
+    cursor_ += size;
+    if (positional_) {
+      preallocate(cursor_);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_ready_.wait(lock, [&]() {
+      return error_ || queued_bytes_ + size <= max_queued_ || queued_bytes_ == 0;
+    });
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+
+    queued_bytes_ += size;
+    jobs_.push_back(std::move(job));
+    job_ready_.notify_one();
+  }
+
+  void preallocate(u64 end) {
+#ifdef __linux__
+    if (!preallocate_ || end <= reserved_) {
+      return;
+    }
+
+    const u64 grow = std::max<u64>(FALLOC_SIZE, end - reserved_);
+    if (::fallocate(fd_, 0, static_cast<off_t>(reserved_), static_cast<off_t>(grow)) == 0) {
+      reserved_ += grow;
+    } else {
+      preallocate_ = false;  // Not supported by the file system
+    }
+#else
+    (void)end;
+#endif
+  }
+
+  void set_error(std::exception_ptr ptr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_) {
+      error_ = ptr;
+    }
+    job_ready_.notify_all();
+    space_ready_.notify_all();
+  }
+
+  void positional_loop() {
+    try {
+      while (true) {
+        Job job;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          job_ready_.wait(lock, [&]() { return error_ || !jobs_.empty() || done_; });
+          if (error_ || (jobs_.empty() && done_)) {
+            return;
+          }
+          job = std::move(jobs_.front());
+          jobs_.pop_front();
+        }
+
+        const std::string_view data = job.view();
+        size_t done = 0;
+        while (done != data.size()) {
+          const ssize_t written = ::pwrite(fd_, data.data() + done, data.size() - done,
+                                           static_cast<off_t>(job.offset + done));
+          if (written < 0) {
+            if (errno == EINTR) {
+              continue;
+            }
+            error(std::format("failed writing the output file: {}", std::strerror(errno)));
+          }
+          done += static_cast<size_t>(written);
+        }
+
+        recycle(job);
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_bytes_ -= data.size();
+        space_ready_.notify_all();
+      }
+    } catch (...) {
+      set_error(std::current_exception());
+    }
+  }
+
+  void stream_loop() {
+    try {
+      std::vector<Job> batch;
+      std::vector<iovec> iov;
+      while (true) {
+        size_t batch_bytes = 0;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          job_ready_.wait(lock, [&]() { return error_ || !jobs_.empty() || done_; });
+          if (error_ || (jobs_.empty() && done_)) {
+            return;
+          }
+          while (!jobs_.empty() && batch.size() != MAX_IOV) {
+            batch_bytes += jobs_.front().view().size();
+            batch.push_back(std::move(jobs_.front()));
+            jobs_.pop_front();
+          }
+        }
+
+        size_t spliced = 0;
+        if (sink_) {
+          for (const Job& job : batch) {
+            sink_(job.view());
+          }
+        } else {
+          spliced = splice_ ? splice_count(batch, pipe_capacity()) : 0;
+          iov.clear();
+          for (const Job& job : batch) {
+            const std::string_view data = job.view();
+            iov.push_back(iovec{const_cast<char*>(data.data()), data.size()});
+          }
+          write_vector(std::span(iov).first(spliced), true);
+          write_vector(std::span(iov).subspan(spliced), false);
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          queued_bytes_ -= batch_bytes;
+          space_ready_.notify_all();
+        }
+        retire(batch, spliced);
+        batch.clear();
+      }
+    } catch (...) {
+      set_error(std::current_exception());
+    }
+  }
+
+  // Capacity of the output pipe now; its reader may change it at any time
+  auto pipe_capacity() const -> u64 {
+#ifdef __linux__
+    const int size = ::fcntl(fd_, F_GETPIPE_SZ);
+    return size > 0 ? static_cast<u64>(size) : 0;
+#else
+    return 0;
+#endif
+  }
+
+  // Jobs of a batch to splice: those followed by at least a pipe's capacity
+  // of the batch, which is copied after them. Once the batch is written, the
+  // pipe holds none of their pages, so they are reused at once
+  static auto splice_count(const std::vector<Job>& batch, u64 capacity) -> size_t {
+    if (capacity == 0) {
+      return 0;
+    }
+    u64 following = 0;
+    size_t count = batch.size();
+    while (count != 0 && following < capacity) {
+      following += batch[--count].view().size();
+    }
+    return following < capacity ? 0 : count;
+  }
+
+  void write_vector(std::span<iovec> iov, bool splice) {
+    size_t first = 0;
+    while (first != iov.size()) {
+      const int count = static_cast<int>(iov.size() - first);
+      ssize_t written = -1;
+#ifdef __linux__
+      if (splice && splice_) {
+        written = ::vmsplice(fd_, iov.data() + first, static_cast<unsigned long>(count), 0);
+        if (written < 0 && errno != EINTR && errno != EAGAIN && errno != EPIPE) {
+          splice_ = false;  // Fall back to copying writes
+          continue;
+        }
+      } else
+#endif
+      {
+        written = ::writev(fd_, iov.data() + first, count);
+      }
+
+      if (written < 0) {
+        if (errno == EAGAIN) {  // Non-blocking output, e.g., inherited: wait for room
+          pollfd ready{fd_, POLLOUT, 0};
+          ::poll(&ready, 1, -1);
+          continue;
+        }
+        if (errno == EINTR) {
+          continue;
+        }
+        error(std::format("failed writing the output: {}", std::strerror(errno)));
+      }
+
+      // Skip what has been written, including partially written vectors
+      auto remaining = static_cast<size_t>(written);
+      while (first != iov.size() && remaining >= iov[first].iov_len) {
+        remaining -= iov[first].iov_len;
+        ++first;
+      }
+      if (remaining != 0) {
+        iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + remaining;
+        iov[first].iov_len -= remaining;
+      }
+    }
+  }
+
+  // Pages handed to the pipe by vmsplice are still read from our memory, so a
+  // spliced buffer is reused only once a pipe's capacity of later bytes has
+  // been written. The capacity is read again here, as the reader may have
+  // enlarged the pipe; then a buffer is kept until enough bytes follow it.
+  void retire(std::vector<Job>& batch, size_t spliced) {
+    const u64 capacity = spliced != 0 || !retained_.empty() ? pipe_capacity() : 0;
+    const u64 end = batch.empty() ? 0 : batch.back().offset + batch.back().view().size();
+    while (!retained_.empty() && end - retained_.front().first >= capacity) {
+      recycle(retained_.front().second);
+      retained_.pop_front();
+    }
+    for (size_t i = 0; i != batch.size(); ++i) {
+      const u64 job_end = batch[i].offset + batch[i].view().size();
+      if (i < spliced && end - job_end < capacity) {
+        retained_.emplace_back(job_end, std::move(batch[i]));
+      } else {
+        recycle(batch[i]);
+      }
+    }
+  }
+
+  void release_retained() {
+    for (auto& [end, job] : retained_) {
+      recycle(job);
+    }
+    retained_.clear();
+  }
+
+  // Buffers are retained past the last batch only if the reader enlarged the
+  // pipe while they were spliced. Wait until the bytes left in the pipe all
+  // follow them, or the reader is gone. A full pipe wakes its writer as it is
+  // read; one with room has no such event, so it is polled
+  void drain_pipe() {
+#ifdef __linux__
+    if (retained_.empty()) {
+      return;
+    }
+
+    const u64 following = cursor_ - retained_.back().first;
+    while (true) {
+      int unread = 0;
+      if (::ioctl(fd_, FIONREAD, &unread) != 0 || static_cast<u64>(unread) <= following) {
+        break;
+      }
+      const bool full = static_cast<u64>(unread) >= pipe_capacity();
+      pollfd pfd{fd_, static_cast<short>(full ? POLLOUT : 0), 0};
+      if (::poll(&pfd, 1, full ? -1 : 1) > 0 && (pfd.revents & (POLLERR | POLLHUP))) {
+        break;
+      }
+    }
+    release_retained();
+#endif
+  }
+#endif
+
+  const size_t max_queued_;
+  Sink sink_;
+  int fd_ = -1;
+  bool positional_ = false;
+  bool splice_ = false;
+  std::ofstream file_;
+  std::vector<std::thread> writers_;
+  std::mutex mutex_;
+  std::condition_variable job_ready_;
+  std::condition_variable space_ready_;
+  std::deque<Job> jobs_;
+  std::vector<AlignedPtr> spare_buffers_;
+  std::deque<std::pair<u64, Job>> retained_;
+  Job staging_;
+  std::exception_ptr error_;
+  size_t queued_bytes_ = 0;
+  u64 cursor_ = 0;
+  u64 reserved_ = 0;
+  bool preallocate_ = true;
+  bool done_ = false;
+  bool closed_ = false;
+};
+
+}  // namespace cryfa
+
+#endif  // CRYFA_OUTPUT_FILE_HPP
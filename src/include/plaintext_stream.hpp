@@ -20,20 +20,27 @@
 #include <string_view>
 
 #include "../def.hpp"
+#include "stats.hpp"
 
 namespace cryfa {
 
 class PlaintextStream {
  public:
-  explicit PlaintextStream(size_t max_buffered = std::max<size_t>(CHUNK_TARGET_SIZE * 4,
+  /**
+   * @param stats Counters of pushing and pulling, or null
+   * @param max_buffered Bytes kept before push() waits
+   */
+  explicit PlaintextStream(Stats* stats = nullptr,
+                           size_t max_buffered = std::max<size_t>(CHUNK_TARGET_SIZE * 4,
                                                                   IO_BUFFER_SIZE * 4))
-      : max_buffered_(max_buffered) {}
+      : stats_(stats), max_buffered_(max_buffered) {}
 
   void push(std::string_view plaintext) {
     if (plaintext.empty()) {
       return;
     }
 
+    auto start = stats_ ? now() : Stats::time_point{};
     std::unique_lock<std::mutex> lock(mutex_);
     space_ready_.wait(lock, [&]() {
       return error_ || buffered_bytes_ + plaintext.size() <= max_buffered_ || buffered_bytes_ == 0;
@@ -41,10 +48,18 @@ class PlaintextStream {
     if (error_) {
       std::rethrow_exception(error_);
     }
+    if (stats_) {
+      stats_->blocked(Stage::plaintext_push, start);
+      start = now();
+    }
 
     chunks_.emplace_back(plaintext);
     buffered_bytes_ += plaintext.size();
     data_ready_.notify_all();
+    if (stats_) {
+      stats_->queue(Stage::plaintext_push, buffered_bytes_, max_buffered_);
+      stats_->busy(Stage::plaintext_push, start, plaintext.size());
+    }
   }
 
   void close() {
@@ -65,7 +80,7 @@ class PlaintextStream {
 
   auto get() -> std::optional<char> {
     std::unique_lock<std::mutex> lock(mutex_);
-    data_ready_.wait(lock, [&]() { return error_ || !chunks_.empty() || done_; });
+    wait_for_data(lock);
     if (error_) {
       std::rethrow_exception(error_);
     }
@@ -94,7 +109,7 @@ class PlaintextStream {
     size_t remaining = size;
     while (remaining != 0) {
       std::unique_lock<std::mutex> lock(mutex_);
-      data_ready_.wait(lock, [&]() { return error_ || !chunks_.empty() || done_; });
+      wait_for_data(lock);
       if (error_) {
         std::rethrow_exception(error_);
       }
@@ -122,6 +137,19 @@ class PlaintextStream {
   }
 
  private:
+  // Wait for plaintext; only actual waits are timed, as get() is per byte
+  void wait_for_data(std::unique_lock<std::mutex>& lock) {
+    auto ready = [&]() { return error_ || !chunks_.empty() || done_; };
+    if (ready()) {
+      return;
+    }
+    const auto start = stats_ ? now() : Stats::time_point{};
+    data_ready_.wait(lock, ready);
+    if (stats_) {
+      stats_->blocked(Stage::plaintext_pull, start);
+    }
+  }
+
   auto pop_front(std::unique_lock<std::mutex>& lock) -> char {
     std::string& front = chunks_.front();
     const char c = front[front_offset_++];
@@ -137,6 +165,7 @@ class PlaintextStream {
     return c;
   }
 
+  Stats* const stats_;
   const size_t max_buffered_;
   std::mutex mutex_;
   std::condition_variable data_ready_;
@@ -0,0 +1,95 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file qbin.hpp
+ * @brief Lossy quality score binning
+ */
+
+#ifndef CRYFA_QBIN_HPP
+#define CRYFA_QBIN_HPP
+
+#include <array>
+#include <format>
+#include <iterator>
+#include <string>
+
+#include "../def.hpp"
+#include "assert.hpp"
+
+namespace cryfa {
+
+/**
+ * @brief Quality score binning schemes. The values are stored in the header
+ */
+enum class QBin : byte {
+  none = 0,
+  illumina8 = 1,  // Illumina 8-level
+  ncbi4 = 2       // NCBI 4-level
+};
+
+/**
+ * @brief Binning scheme by its name
+ * @param name "illumina8" or "ncbi4"
+ * @return Scheme
+ */
+inline QBin qbin_scheme(const std::string& name) {
+  if (name == "illumina8") {
+    return QBin::illumina8;
+  } else if (name == "ncbi4") {
+    return QBin::ncbi4;
+  }
+  error(std::format("\"{}\" is not a quality score binning scheme; use \"illumina8\" or "
+                    "\"ncbi4\".",
+                    name));
+  return QBin::none;
+}
+
+inline std::string qbin_name(QBin scheme) {
+  switch (scheme) {
+    case QBin::illumina8:
+      return "illumina8";
+    case QBin::ncbi4:
+      return "ncbi4";
+    default:
+      return "none";
+  }
+}
+
+/**
+ * @brief Binned Phred+33 quality score of each character
+ * @param scheme Binning scheme
+ * @return Lookup table
+ */
+inline std::array<char, 256> qbin_table(QBin scheme) {
+  // Upper bound (exclusive) and representative of each bin, in Phred scores
+  struct Bin {
+    int below;
+    int value;
+  };
+  static constexpr Bin ILLUMINA8[] = {{3, 2},   {10, 6},  {20, 15}, {25, 22},
+                                      {30, 27}, {35, 33}, {40, 37}, {256, 40}};
+  static constexpr Bin NCBI4[] = {{3, 2}, {20, 12}, {30, 25}, {256, 35}};
+
+  std::array<char, 256> table{};
+  for (int c = 0; c != 256; ++c) {
+    table[c] = static_cast<char>(c);
+  }
+  if (scheme == QBin::none) {
+    return table;
+  }
+
+  const auto* bins = (scheme == QBin::illumina8) ? std::begin(ILLUMINA8) : std::begin(NCBI4);
+  for (int c = '!'; c <= '~'; ++c) {
+    const Bin* bin = bins;
+    while (c - '!' >= bin->below) {
+      ++bin;
+    }
+    table[c] = static_cast<char>('!' + bin->value);
+  }
+  return table;
+}
+
+}  // namespace cryfa
+
+#endif  // CRYFA_QBIN_HPP
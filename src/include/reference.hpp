@@ -0,0 +1,404 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file reference.hpp
+ * @brief Reference-based compaction of read sequences
+ */
+
+#ifndef CRYFA_REFERENCE_HPP
+#define CRYFA_REFERENCE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../def.hpp"
+#include "assert.hpp"
+#include "gzip.hpp"
+#include "minimizer.hpp"
+#include "numeric.hpp"
+
+namespace cryfa {
+
+/**
+ * @brief Reference sequences, with a minimizer index to map reads on them.
+ *        A read matching the reference is stored as its position, strand and
+ *        mismatches, instead of its bases:
+ *        [250] [position * 2 + reverse] [length] ([gap] [base])...
+ *        Numbers are packed by pack_number, so no byte reaches 250. The
+ *        sequences and the index are cached in "<reference>.cryfa-idx", and
+ *        rebuilt when the reference changes.
+ */
+class Reference {
+ public:
+  static constexpr char MAPPED = (char)250;  // First byte of a mapped read
+
+  /**
+   * @brief Reference of a FASTA file
+   * @param path FASTA file, possibly gzip compressed
+   * @param n_threads Number of threads building the index
+   * @return Reference
+   */
+  static auto load(const std::string& path, size_t n_threads = 1)
+      -> std::shared_ptr<const Reference> {
+    return std::shared_ptr<const Reference>(new Reference(path, n_threads));
+  }
+
+  /**
+   * @brief If the file it was loaded from is unchanged, by size and time
+   */
+  auto current(const std::string& path) const -> bool {
+    const auto [size, time] = stamp(path);
+    return size == ref_size_ && time == ref_time_;
+  }
+
+  Reference(const Reference&) = delete;
+  auto operator=(const Reference&) -> Reference& = delete;
+
+  /**
+   * @brief Hash of the sequences, to check that decryption uses the same ones
+   */
+  auto fingerprint() const -> u64 { return fingerprint_; }
+
+  /**
+   * @brief Map a read, and pack it if that is shorter than packing its bases
+   * @param[out] packed Packed reads
+   * @param read Sequence of the read
+   * @return False if the read is not packed
+   */
+  auto pack(std::string& packed, std::string_view read) const -> bool {
+    if (read.size() < K + W - 1 || seeds_.empty()) {
+      return false;
+    }
+    for (char c : read) {
+      if ((byte)c >= (byte)MAPPED) {
+        return false;
+      }
+    }
+
+    // Diagonals (position * 2 + reverse) hit by the minimizers. A seed in the
+    // other orientation than the read's k-mer puts the read on the reverse strand
+    const u64 size = read.size();
+    std::vector<u64> hits;
+    for_each_minimizer<K, W>(read, [&](u64 hash, u64 info) {
+      const u64 bucket = hash >> shift_;
+      const auto [first, last] = std::equal_range(
+          seeds_.begin() + static_cast<ptrdiff_t>(buckets_[bucket]),
+          seeds_.begin() + static_cast<ptrdiff_t>(buckets_[bucket + 1]), Seed{hash, 0},
+          [](const Seed& a, const Seed& b) { return a.hash < b.hash; });
+      if (last - first > MAX_OCCURRENCES) {
+        return;
+      }
+      const u64 at = info >> 1;
+      for (auto seed = first; seed != last; ++seed) {
+        const u64 pos = seed->info >> 1;
+        if (((seed->info ^ info) & 1) == 0) {
+          if (pos >= at && pos - at + size <= seq_.size()) {
+            hits.push_back((pos - at) * 2);
+          }
+        } else if (pos + at + K >= size && pos + at + K <= seq_.size()) {
+          hits.push_back((pos + at + K - size) * 2 + 1);
+        }
+      }
+    });
+    if (hits.empty()) {
+      return false;
+    }
+
+    // Try the diagonals with the most hits
+    std::sort(hits.begin(), hits.end());
+    std::vector<std::pair<u64, u64>> votes;  // (No. hits, diagonal)
+    for (auto hit = hits.begin(); hit != hits.end();) {
+      const auto next = std::upper_bound(hit, hits.end(), *hit);
+      votes.emplace_back(static_cast<u64>(next - hit), *hit);
+      hit = next;
+    }
+    const size_t n_tries = std::min<size_t>(MAX_TRIES, votes.size());
+    std::partial_sort(votes.begin(), votes.begin() + n_tries, votes.end(),
+                      [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    u64 best = 0;
+    size_t best_mismatches = read.size() / 6 + 1;  // More would not pay off
+    for (size_t t = 0; t != n_tries; ++t) {
+      const u64 where = votes[t].second;
+      size_t mismatches = 0;
+      for (size_t j = 0; j != read.size() && mismatches != best_mismatches; ++j) {
+        mismatches += (read[j] != expected(where, read.size(), j));
+      }
+      if (mismatches < best_mismatches) {
+        best = where;
+        best_mismatches = mismatches;
+      }
+    }
+    if (best_mismatches > read.size() / 6) {
+      return false;
+    }
+
+    std::string mapped(1, MAPPED);
+    pack_number(mapped, best);
+    pack_number(mapped, read.size());
+    for (size_t j = 0, next = 0; j != read.size(); ++j) {
+      if (read[j] != expected(best, read.size(), j)) {
+        pack_number(mapped, j - next);
+        mapped += read[j];
+        next = j + 1;
+      }
+    }
+    if (mapped.size() >= (read.size() + 2) / 3) {  // pack_seq: 3 bases in 1 byte
+      return false;
+    }
+    packed += mapped;
+    return true;
+  }
+
+  /**
+   * @brief Unpack a mapped read
+   * @param[out] out Sequence of the read
+   * @param i Input string iterator, on MAPPED. It stops on the next (char)254
+   */
+  void unpack(std::string& out, std::string::iterator& i) const {
+    ++i;  // MAPPED
+    const u64 where = unpack_number(i);
+    const u64 size = unpack_number(i);
+    if ((where >> 1) > seq_.size() || size > seq_.size() - (where >> 1)) {
+      throw std::runtime_error("corrupted file.");
+    }
+    out.resize(size);
+    for (size_t j = 0; j != size; ++j) {
+      out[j] = expected(where, size, j);
+    }
+
+    for (u64 at = 0; *i != (char)254;) {
+      at += unpack_number(i);
+      if (at >= size || *i == (char)254) {
+        throw std::runtime_error("corrupted file.");
+      }
+      out[at++] = *i++;
+    }
+  }
+
+ private:
+  static constexpr size_t K = 21;                   // k-mer size
+  static constexpr size_t W = 11;                   // Minimizer of W consecutive k-mers
+  static constexpr ptrdiff_t MAX_OCCURRENCES = 64;  // Ignore more repetitive seeds
+  static constexpr size_t MAX_TRIES = 4;            // Diagonals verified per read
+
+  struct Seed {
+    u64 hash;
+    u64 info;  // Position * 2 + (k-mer is the reverse complement of its canonical one)
+  };
+
+  // Size and modification time of a file -- 0s if it is missing
+  static auto stamp(const std::string& path) -> std::pair<u64, u64> {
+    std::error_code size_ec;
+    std::error_code time_ec;
+    const u64 size = std::filesystem::file_size(path, size_ec);
+    const auto time = std::filesystem::last_write_time(path, time_ec);
+    if (size_ec || time_ec) {
+      return {0, 0};
+    }
+    return {size, static_cast<u64>(time.time_since_epoch().count())};
+  }
+
+  explicit Reference(const std::string& path, size_t n_threads) {
+    const auto [ref_size, ref_time] = stamp(path);
+    ref_size_ = ref_size;
+    ref_time_ = ref_time;
+    const std::string cache = path + ".cryfa-idx";
+    if (!read_cache(cache, ref_size, ref_time)) {
+      read_fasta(path, n_threads);
+      build_index(n_threads);
+      fingerprint_ = 0xcbf29ce484222325ULL;  // FNV-1a
+      for (char c : seq_) {
+        fingerprint_ = (fingerprint_ ^ (byte)c) * 0x100000001b3ULL;
+      }
+      write_cache(cache, ref_size, ref_time);
+    }
+
+    // Buckets of the seeds by the top bits of their hashes, about 8 seeds each
+    size_t bits = 1;
+    while (bits != 30 && (8ULL << bits) < seeds_.size()) {
+      ++bits;
+    }
+    shift_ = 2 * K - bits;
+    buckets_.assign((1ULL << bits) + 1, 0);
+    for (const Seed& seed : seeds_) {
+      ++buckets_[(seed.hash >> shift_) + 1];
+    }
+    for (size_t b = 1; b != buckets_.size(); ++b) {
+      buckets_[b] += buckets_[b - 1];
+    }
+  }
+
+  /**
+   * @brief Read the sequences of a FASTA file, in capitals and back to back
+   */
+  void read_fasta(const std::string& path, size_t n_threads) {
+    auto in = open_input(path, n_threads);
+    for (std::string line; std::getline(*in, line);) {
+      if (line.empty() || line[0] == '>') {
+        continue;
+      }
+      if (line.back() == '\r') {
+        line.pop_back();
+      }
+      for (char& c : line) {
+        c = (char)std::toupper((byte)c);
+      }
+      seq_ += line;
+    }
+    assert_single(seq_.empty(), std::format("the reference \"{}\" has no sequences.", path));
+  }
+
+  /**
+   * @brief Find the minimizers of the sequences, in parts, each by a thread
+   */
+  void build_index(size_t n_threads) {
+    n_threads = std::max<size_t>(1, std::min<size_t>(n_threads, seq_.size() >> 20));
+    const size_t part = seq_.size() / n_threads + 1;
+    std::vector<std::vector<Seed>> found(n_threads);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t != n_threads; ++t) {
+      workers.emplace_back([&, t]() {
+        const size_t begin = std::min(seq_.size(), t * part);
+        const size_t end = std::min(seq_.size(), begin + part + K + W - 2);
+        const std::string_view range = std::string_view(seq_).substr(begin, end - begin);
+        found[t].reserve(2 * range.size() / (W + 1));
+        for_each_minimizer<K, W>(range, [&](u64 hash, u64 info) {
+          found[t].push_back(Seed{hash, info + 2 * begin});
+        });
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+
+    for (auto& seeds : found) {
+      seeds_.insert(seeds_.end(), seeds.begin(), seeds.end());
+      std::vector<Seed>().swap(seeds);
+    }
+    std::sort(seeds_.begin(), seeds_.end(), [](const Seed& a, const Seed& b) {
+      return a.hash < b.hash || (a.hash == b.hash && a.info < b.info);
+    });
+    // The parts overlap by a window
+    seeds_.erase(std::unique(seeds_.begin(), seeds_.end(),
+                             [](const Seed& a, const Seed& b) {
+                               return a.hash == b.hash && a.info == b.info;
+                             }),
+                 seeds_.end());
+  }
+
+  auto read_cache(const std::string& cache, u64 ref_size, u64 ref_time) -> bool {
+    std::error_code ec;
+    const u64 cache_size = std::filesystem::file_size(cache, ec);
+    std::ifstream in(cache, std::ios::binary);
+    std::array<u64, 8> head{};
+    if (ec || !in.read(reinterpret_cast<char*>(head.data()), sizeof(head)) ||
+        head[0] != CACHE_MAGIC || head[1] != K || head[2] != W || head[3] != ref_size ||
+        head[4] != ref_time || head[7] > cache_size / sizeof(Seed) ||
+        sizeof(head) + head[6] + head[7] * sizeof(Seed) != cache_size) {
+      return false;
+    }
+    fingerprint_ = head[5];
+    seq_.resize(head[6]);
+    seeds_.resize(head[7]);
+    in.read(seq_.data(), static_cast<std::streamsize>(seq_.size()));
+    in.read(reinterpret_cast<char*>(seeds_.data()),
+            static_cast<std::streamsize>(seeds_.size() * sizeof(Seed)));
+    if (!in || seq_.empty()) {
+      seq_.clear();
+      seeds_.clear();
+      return false;
+    }
+    return true;
+  }
+
+  void write_cache(const std::string& cache, u64 ref_size, u64 ref_time) const {
+    const std::string temp = cache + ".tmp";
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    const std::array<u64, 8> head{CACHE_MAGIC, K,           W,           ref_size,
+                                  ref_time,    fingerprint_, seq_.size(), seeds_.size()};
+    out.write(reinterpret_cast<const char*>(head.data()), sizeof(head));
+    out.write(seq_.data(), static_cast<std::streamsize>(seq_.size()));
+    out.write(reinterpret_cast<const char*>(seeds_.data()),
+              static_cast<std::streamsize>(seeds_.size() * sizeof(Seed)));
+    out.close();
+
+    std::error_code ec;
+    if (out) {
+      std::filesystem::rename(temp, cache, ec);
+    }
+    if (!out || ec) {
+      std::filesystem::remove(temp, ec);
+      warning(std::format("the reference index cannot be cached in \"{}\".", cache));
+    }
+  }
+
+  /**
+   * @brief Base of the reference expected at a position of a read
+   * @param where Position of the read * 2 + reverse
+   * @param size Size of the read
+   * @param j Position in the read
+   */
+  auto expected(u64 where, u64 size, u64 j) const -> char {
+    const u64 pos = where >> 1;
+    return (where & 1) ? complement_base(seq_[pos + size - 1 - j]) : seq_[pos + j];
+  }
+
+  static constexpr u64 CACHE_MAGIC = 0x5844494146595243ULL;  // "CRYFAIDX"
+
+  std::string seq_;           // Sequences, back to back
+  std::vector<Seed> seeds_;   // Minimizers, sorted by hash
+  std::vector<u64> buckets_;  // First seed of each bucket
+  size_t shift_ = 0;          // Hash bits below the bucket
+  u64 fingerprint_ = 0;
+  u64 ref_size_ = 0;  // Of the file loaded
+  u64 ref_time_ = 0;
+};
+
+/**
+ * @brief References loaded by earlier jobs, shared by the jobs given the
+ *        cache. A reference whose file has changed, by size or time, since
+ *        it was loaded is loaded again; jobs still using the old one keep it
+ */
+class ReferenceCache {
+ public:
+  auto load(const std::string& path, size_t n_threads) -> std::shared_ptr<const Reference> {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto found = loaded_.find(path);
+    if (found != loaded_.end() && found->second->current(path)) {
+      return found->second;
+    }
+    if (found == loaded_.end() && loaded_.size() >= MAX_REFERENCES) {
+      loaded_.clear();
+    }
+    std::shared_ptr<const Reference> reference = Reference::load(path, n_threads);
+    loaded_[path] = reference;
+    return reference;
+  }
+
+ private:
+  static constexpr size_t MAX_REFERENCES = 8;  // Forgets all past it
+
+  std::mutex mutex_;
+  std::map<std::string, std::shared_ptr<const Reference>> loaded_;
+};
+
+}  // namespace cryfa
+
+#endif  // CRYFA_REFERENCE_HPP
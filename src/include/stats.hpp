@@ -0,0 +1,307 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file stats.hpp
+ * @brief Per-stage counters and trace of a job
+ */
+
+#ifndef CRYFA_STATS_HPP
+#define CRYFA_STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "../def.hpp"
+#include "assert.hpp"
+#include "time.hpp"
+
+namespace cryfa {
+
+/**
+ * @brief Stages of the pipelines. Shuffling and sealing are parts of packing,
+ *        and unshuffling of unpacking; their time is counted in both
+ */
+enum class Stage : size_t {
+  read,            // Reading input chunks, or encrypted records
+  pack,            // Compacting chunks
+  shuffle,         // Shuffling packed chunks
+  seal,            // AES-GCM encryption of records
+  open,            // AES-GCM decryption of records
+  plaintext_push,  // Decrypted plaintext, passed to unpacking
+  plaintext_pull,  // Plaintext read by unpacking, blocked while decryption lags
+  unpack,          // Decompacting chunks
+  unshuffle,       // Unshuffling chunks
+  emit,            // Writing the output, in order
+  none
+};
+
+constexpr std::array<std::string_view, static_cast<size_t>(Stage::none)> STAGE_NAMES = {
+    "read",           "pack",   "shuffle",   "seal", "open", "plaintext_push",
+    "plaintext_pull", "unpack", "unshuffle", "emit"};
+
+using time_point = decltype(now());
+
+constexpr u64 NO_CHUNK = ~0ULL;  // Span not of one chunk of a pipeline
+
+/**
+ * @brief Peak resident set size of the process, in bytes -- 0: unknown
+ */
+inline auto peak_rss() -> u64 {
+#ifdef _WIN32
+  return 0;
+#else
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return static_cast<u64>(usage.ru_maxrss);  // Bytes
+#else
+  return static_cast<u64>(usage.ru_maxrss) * 1024;  // KiB
+#endif
+#endif
+}
+
+/**
+ * @brief Spans of the stages on each thread, in the Chrome trace event
+ *        format, which chrome://tracing and Perfetto show
+ */
+class Trace {
+ public:
+  enum class Kind {
+    busy,     // Stage working on a chunk
+    blocked,  // Stage waiting for its input or for room in its queue
+    order     // Chunk done, waiting for the emitter to reach it
+  };
+
+  void add(Kind kind, Stage stage, time_point start, time_point end, u64 chunk) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto [thread, added] =
+        threads_.try_emplace(std::this_thread::get_id(), static_cast<u32>(threads_.size() + 1));
+    events_.push_back(Event{kind, stage, thread->second, ns(start), ns(end), chunk});
+  }
+
+  auto json() const -> std::string {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string out = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char* separator = "\n";
+    for (u64 id = 0; id != events_.size(); ++id) {
+      const Event& e = events_[id];
+      const std::string_view stage = STAGE_NAMES[static_cast<size_t>(e.stage)];
+      std::string args = e.chunk == NO_CHUNK ? "{}" : std::format("{{\"chunk\": {}}}", e.chunk);
+      if (e.kind == Kind::order) {  // Async: the chunk is on no thread meanwhile
+        for (const auto& [phase, ts] : {std::pair{'b', e.start}, std::pair{'e', e.end}}) {
+          out += std::format(
+              "{}{{\"name\": \"order\", \"cat\": \"{}\", \"ph\": \"{}\", \"id\": {}, "
+              "\"ts\": {:.3f}, \"pid\": 1, \"tid\": {}, \"args\": {}}}",
+              separator, stage, phase, id, us(ts), e.thread, args);
+          separator = ",\n";
+        }
+        continue;
+      }
+      out += std::format(
+          "{}{{\"name\": \"{}{}\", \"cat\": \"{}\", \"ph\": \"X\", \"ts\": {:.3f}, "
+          "\"dur\": {:.3f}, \"pid\": 1, \"tid\": {}, \"args\": {}}}",
+          separator, stage, e.kind == Kind::blocked ? " (blocked)" : "",
+          e.kind == Kind::blocked ? "blocked" : "busy", us(e.start), us(e.end - e.start), e.thread,
+          args);
+      separator = ",\n";
+    }
+    return out + "\n]}\n";
+  }
+
+  void write(const std::string& path) const {
+    std::ofstream out(path);
+    out << json();
+    assert_single(!out.good(), std::format("failed writing \"{}\".", path));
+  }
+
+ private:
+  struct Event {
+    Kind kind;
+    Stage stage;
+    u32 thread;  // Number of the thread, by its first span
+    u64 start;   // Nanoseconds since the trace began
+    u64 end;
+    u64 chunk;
+  };
+
+  auto ns(time_point t) const -> u64 {
+    return t < start_ ? 0
+                      : static_cast<u64>(
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(t - start_)
+                                .count());
+  }
+
+  static auto us(u64 ns) -> double { return static_cast<double>(ns) / 1e3; }
+
+  mutable std::mutex mutex_;
+  std::vector<Event> events_;
+  std::unordered_map<std::thread::id, u32> threads_;
+  const time_point start_ = now();
+};
+
+/**
+ * @brief Bytes, chunks, busy and blocked time, and queue occupancy of each
+ *        stage of a job. Threads of the stages add to them at once. With a
+ *        trace, each busy and blocked span is added to it, too
+ */
+class Stats {
+ public:
+  using time_point = cryfa::time_point;
+
+  explicit Stats(Trace* trace = nullptr) : trace_(trace) {}
+
+  /**
+   * @brief Count a chunk done by a stage, busy since a time
+   * @param chunk Index of the chunk in its pipeline, for the trace
+   */
+  void busy(Stage stage, time_point since, u64 bytes, u64 chunk = NO_CHUNK) {
+    if (stage == Stage::none) {
+      return;
+    }
+    const time_point end = now();
+    Counters& c = at(stage);
+    c.bytes += bytes;
+    ++c.chunks;
+    c.busy_ns += ns_between(since, end);
+    if (trace_) {
+      trace_->add(Trace::Kind::busy, stage, since, end, chunk);
+    }
+  }
+
+  /**
+   * @brief Count the time a stage waited, since a time
+   */
+  void blocked(Stage stage, time_point since, u64 chunk = NO_CHUNK) {
+    if (stage == Stage::none) {
+      return;
+    }
+    const time_point end = now();
+    at(stage).blocked_ns += ns_between(since, end);
+    if (trace_) {
+      trace_->add(Trace::Kind::blocked, stage, since, end, chunk);
+    }
+  }
+
+  /**
+   * @brief Trace the time a chunk done since a time waited to be emitted
+   */
+  void order(Stage stage, time_point since, u64 chunk) {
+    if (trace_ && stage != Stage::none) {
+      trace_->add(Trace::Kind::order, stage, since, now(), chunk);
+    }
+  }
+
+  auto tracing() const -> bool { return trace_ != nullptr; }
+
+  /**
+   * @brief Sample the queue a stage feeds
+   * @param used Occupied
+   * @param capacity Size of the queue
+   */
+  void queue(Stage stage, u64 used, u64 capacity) {
+    if (stage == Stage::none) {
+      return;
+    }
+    Counters& c = at(stage);
+    c.queue_sum += used;
+    ++c.queue_samples;
+    for (u64 max = c.queue_max; used > max && !c.queue_max.compare_exchange_weak(max, used);) {
+    }
+    c.queue_capacity = capacity;
+  }
+
+  /**
+   * @brief Counters as JSON: the peak RSS of the process so far, and each
+   *        stage with its bytes, chunks, busy and blocked seconds, throughput
+   *        over its busy time, and queue
+   */
+  auto json() const -> std::string {
+    std::string out = std::format(
+        "{{\n  \"wall_seconds\": {:.6f},\n  \"peak_rss_bytes\": {},\n  \"stages\": {{",
+        seconds(ns_between(start_, now())), peak_rss());
+    const char* separator = "\n";
+    for (size_t s = 0; s != STAGE_NAMES.size(); ++s) {
+      const Counters& c = stages_[s];
+      if (c.chunks == 0 && c.blocked_ns == 0) {
+        continue;  // Not in this job
+      }
+      const double busy = seconds(c.busy_ns);
+      out += std::format(
+          "{}    \"{}\": {{\"bytes\": {}, \"chunks\": {}, \"busy_seconds\": {:.6f}, "
+          "\"blocked_seconds\": {:.6f}, \"mb_per_busy_second\": {:.3f}",
+          separator, STAGE_NAMES[s], c.bytes.load(), c.chunks.load(), busy,
+          seconds(c.blocked_ns), busy > 0 ? c.bytes / busy / 1e6 : 0.0);
+      if (c.queue_samples != 0) {
+        out += std::format(", \"queue\": {{\"mean\": {:.3f}, \"max\": {}, \"capacity\": {}}}",
+                           static_cast<double>(c.queue_sum) / c.queue_samples,
+                           c.queue_max.load(), c.queue_capacity.load());
+      }
+      out += "}";
+      separator = ",\n";
+    }
+    return out + "\n  }\n}\n";
+  }
+
+  void write(const std::string& path) const {
+    std::ofstream out(path);
+    out << json();
+    assert_single(!out.good(), std::format("failed writing \"{}\".", path));
+  }
+
+ private:
+  struct Counters {
+    std::atomic<u64> bytes{0};
+    std::atomic<u64> chunks{0};
+    std::atomic<u64> busy_ns{0};
+    std::atomic<u64> blocked_ns{0};
+    std::atomic<u64> queue_sum{0};
+    std::atomic<u64> queue_samples{0};
+    std::atomic<u64> queue_max{0};
+    std::atomic<u64> queue_capacity{0};
+  };
+
+  auto at(Stage stage) -> Counters& { return stages_[static_cast<size_t>(stage)]; }
+
+  static auto ns_between(time_point start, time_point end) -> u64 {
+    return static_cast<u64>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+  }
+
+  static auto seconds(u64 ns) -> double { return static_cast<double>(ns) / 1e9; }
+
+  std::array<Counters, STAGE_NAMES.size()> stages_;
+  Trace* const trace_;
+  const time_point start_ = now();
+};
+
+/**
+ * @brief Stages a pipeline counts, and traces, its reader, workers and
+ *        emitter in
+ */
+struct PipelineStats {
+  Stats* stats = nullptr;
+  Stage read = Stage::read;
+  Stage work = Stage::pack;
+  Stage emit = Stage::emit;
+};
+
+}  // namespace cryfa
+
+#endif  // CRYFA_STATS_HPP
@@ -0,0 +1,336 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file synthetic.hpp
+ * @brief Synthetic data, for benchmarks and reproducible performance runs
+ */
+
+#ifndef CRYFA_SYNTHETIC_HPP
+#define CRYFA_SYNTHETIC_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <format>
+#include <numbers>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "../def.hpp"
+#include "assert.hpp"
+#include "qbin.hpp"
+
+namespace cryfa {
+
+/**
+ * @brief Random text, the same for the same seed on every platform: only the
+ *        raw output of mt19937_64 is used, not the distributions of the
+ *        standard library, which differ between implementations
+ */
+class Synthetic {
+ public:
+  explicit Synthetic(u64 seed = 1) : rng_(seed) {}
+
+  /**
+   * @brief Uniform integer in [0, n)
+   */
+  auto below(u64 n) -> u64 { return rng_() % n; }
+
+  auto word() -> u64 { return rng_(); }
+
+  /**
+   * @brief Uniform real in (0, 1]
+   */
+  auto uniform() -> double {
+    return static_cast<double>((rng_() >> 11) + 1) / static_cast<double>(1ULL << 53);
+  }
+
+  /**
+   * @brief Number of trials before an event of a probability happens
+   */
+  auto gap(double p) -> u64 {
+    if (p <= 0) {
+      return ~0ULL;
+    }
+    if (p >= 1) {
+      return 0;
+    }
+    const double trials = std::floor(std::log(uniform()) / std::log1p(-p));
+    return trials >= 1e18 ? ~0ULL : static_cast<u64>(trials);
+  }
+
+  /**
+   * @brief Normally distributed real, by the Box-Muller transform
+   */
+  auto normal(double mean, double sd) -> double {
+    return mean + sd * std::sqrt(-2 * std::log(uniform())) *
+                      std::cos(2 * std::numbers::pi * uniform());
+  }
+
+  /**
+   * @brief Random bits, fewer than 64, taken from one word of the generator
+   *        at a time
+   */
+  auto bits(unsigned n) -> u64 {
+    if (n_bits_ < n) {
+      bits_ = rng_();
+      n_bits_ = 64;
+    }
+    const u64 out = bits_ & ((1ULL << n) - 1);
+    bits_ >>= n;
+    n_bits_ -= n;
+    return out;
+  }
+
+  /**
+   * @brief Whether an event of a probability happens
+   */
+  auto chance(double p) -> bool {
+    return p > 0 && static_cast<double>(rng_() >> 11) < p * static_cast<double>(1ULL << 53);
+  }
+
+  /**
+   * @brief Bases A, C, G and T, with N at a rate
+   */
+  auto bases(size_t size, double n_rate = 0) -> std::string {
+    std::string out(size, 'N');
+    for (char& c : out) {
+      if (!chance(n_rate)) {
+        c = "ACGT"[below(4)];
+      }
+    }
+    return out;
+  }
+
+  /**
+   * @brief Symbols of an alphabet, uniformly
+   */
+  auto symbols(size_t size, std::string_view alphabet) -> std::string {
+    std::string out(size, '\0');
+    for (char& c : out) {
+      c = alphabet[below(alphabet.size())];
+    }
+    return out;
+  }
+
+ private:
+  std::mt19937_64 rng_;
+  u64 bits_ = 0;
+  unsigned n_bits_ = 0;
+};
+
+/**
+ * @brief Shape of synthetic reads
+ */
+struct ReadShape {
+  char format = 'Q';                 // 'Q' FASTQ, 'A' FASTA
+  u64 min_length = 150;              // Uniform lengths in [min, max], if no sd
+  u64 max_length = 150;              //
+  double mean_length = 0;            // Normal lengths, if sd > 0
+  double sd_length = 0;              //
+  std::string header = "illumina";   // illumina, sra, ont or plain
+  std::string quality = "illumina";  // illumina, illumina8, ncbi4 or full
+  double n_rate = 0.001;             // Fraction of bases that are N
+  double lowercase = 0;              // Fraction of bases in soft-masked, lowercase runs
+  size_t line_width = 60;            // FASTA: bases per line -- 0: one line
+
+  /**
+   * @brief Set the lengths from "N", "MIN:MAX" (uniform) or "MEAN~SD" (normal)
+   */
+  void set_length(const std::string& spec) {
+    const auto number = [&](const std::string& s) -> double {
+      size_t end = 0;
+      double value = 0;
+      try {
+        value = std::stod(s, &end);
+      } catch (const std::exception&) {
+      }
+      assert_single(s.empty() || end != s.size() || value < 0,
+                    std::format("\"{}\" is not a read length; use N, MIN:MAX or MEAN~SD.", spec));
+      return value;
+    };
+    mean_length = sd_length = 0;
+    if (const size_t sep = spec.find('~'); sep != std::string::npos) {
+      mean_length = number(spec.substr(0, sep));
+      sd_length = number(spec.substr(sep + 1));
+      assert_single(mean_length < 1, "the mean read length must be at least 1.");
+    } else if (const size_t sep = spec.find(':'); sep != std::string::npos) {
+      min_length = static_cast<u64>(number(spec.substr(0, sep)));
+      max_length = static_cast<u64>(number(spec.substr(sep + 1)));
+    } else {
+      min_length = max_length = static_cast<u64>(number(spec));
+    }
+    assert_single(sd_length == 0 && (min_length == 0 || max_length < min_length),
+                  std::format("\"{}\" is not a range of read lengths.", spec));
+  }
+};
+
+/**
+ * @brief Reads of a shape, one record at a time. The same seed gives the
+ *        same reads
+ */
+class SyntheticReads {
+ public:
+  explicit SyntheticReads(ReadShape shape, u64 seed = 1)
+      : shape_(std::move(shape)), rng_(seed), bins_(qbin_table(QBin::none)) {
+    assert_single(shape_.format != 'Q' && shape_.format != 'A',
+                  "the format of synthetic reads is FASTQ or FASTA.");
+    assert_single(shape_.header != "illumina" && shape_.header != "sra" &&
+                      shape_.header != "ont" && shape_.header != "plain",
+                  std::format("\"{}\" is not a header style; use illumina, sra, ont or plain.",
+                              shape_.header));
+    if (shape_.quality == "illumina8" || shape_.quality == "ncbi4") {
+      bins_ = qbin_table(qbin_scheme(shape_.quality));
+      max_quality_ = 41;
+    } else if (shape_.quality == "illumina") {
+      max_quality_ = 41;
+    } else if (shape_.quality == "full") {
+      max_quality_ = 93;
+    } else {
+      error(std::format("\"{}\" is not a quality alphabet; use illumina, illumina8, ncbi4 or "
+                        "full.",
+                        shape_.quality));
+    }
+    next_n_ = rng_.gap(shape_.n_rate);
+    next_mask_ = rng_.gap(mask_start_rate());
+  }
+
+  /**
+   * @brief Append the next record
+   */
+  void append(std::string& out) {
+    ++n_reads_;
+    const u64 length = next_length();
+    append_header(out, length);
+
+    const size_t seq = out.size();
+    append_bases(out, length);
+    if (shape_.format == 'A') {
+      wrap_lines(out, seq);
+      return;
+    }
+    out += "\n+\n";
+    append_qualities(out, seq, length);
+    out += '\n';
+  }
+
+  /**
+   * @brief Append records until the output has at least a size
+   */
+  void fill(std::string& out, size_t size) {
+    while (out.size() < size) {
+      append(out);
+    }
+  }
+
+ private:
+  static constexpr double MASK_RUN = 200;  // Mean length of soft-masked runs
+
+  auto mask_start_rate() const -> double {
+    const double f = shape_.lowercase;
+    return f <= 0 ? 0 : f >= 1 ? 1 : f / (MASK_RUN * (1 - f));
+  }
+
+  auto next_length() -> u64 {
+    if (shape_.sd_length > 0) {
+      return static_cast<u64>(
+          std::max(1.0, std::round(rng_.normal(shape_.mean_length, shape_.sd_length))));
+    }
+    return shape_.min_length + rng_.below(shape_.max_length - shape_.min_length + 1);
+  }
+
+  void append_header(std::string& out, u64 length) {
+    out += shape_.format == 'Q' ? '@' : '>';
+    const u64 n = n_reads_;
+    if (shape_.header == "illumina") {
+      const u64 x = 1000 + rng_.below(30000);
+      const u64 y = 1000 + rng_.below(30000);
+      out += std::format("SYN01:42:HSYNTHXX:{}:{}:{}:{} 1:N:0:ACGTACGT", 1 + n / 4000000,
+                         1101 + (n / 4000) % 100, x, y);
+    } else if (shape_.header == "sra") {
+      out += std::format("SRR0000001.{} {} length={}", n, n, length);
+    } else if (shape_.header == "ont") {
+      const u64 a = rng_.word();
+      const u64 b = rng_.word();
+      out += std::format(
+          "{:08x}-{:04x}-{:04x}-{:04x}-{:012x} runid=0123456789abcdef read={} ch={} "
+          "start_time=2026-01-01T00:00:00Z",
+          a >> 32, (a >> 16) & 0xFFFF, a & 0xFFFF, b >> 48, b & 0xFFFFFFFFFFFFULL, n,
+          1 + rng_.below(512));
+    } else {
+      out += std::format("read{}", n);
+    }
+    out += '\n';
+  }
+
+  void append_bases(std::string& out, u64 length) {
+    for (u64 i = 0; i != length; ++i) {
+      char base = "ACGT"[rng_.bits(2)];
+      if (next_n_ == 0) {
+        base = 'N';
+        next_n_ = rng_.gap(shape_.n_rate);
+      } else if (next_n_ != ~0ULL) {
+        --next_n_;
+      }
+
+      if (masked_ == 0) {
+        if (next_mask_ == 0) {
+          masked_ = 1 + rng_.gap(1 / MASK_RUN);
+          next_mask_ = rng_.gap(mask_start_rate());  // Counted after the run
+        } else if (next_mask_ != ~0ULL) {
+          --next_mask_;
+        }
+      }
+      if (masked_ != 0) {
+        base = static_cast<char>(base + ('a' - 'A'));
+        --masked_;
+      }
+      out += base;
+    }
+  }
+
+  // Qualities drift along the read, and fall towards its end; N bases get the lowest
+  void append_qualities(std::string& out, size_t seq, u64 length) {
+    int q = static_cast<int>(max_quality_) - static_cast<int>(rng_.bits(3));
+    for (u64 i = 0; i != length; ++i) {
+      q += static_cast<int>(rng_.bits(3)) - 3 - (i * 8 > length * 7 ? 1 : 0);
+      q = std::clamp(q, 2, static_cast<int>(max_quality_));
+      const char base = out[seq + i];
+      const int phred = (base == 'N' || base == 'n') ? 2 : q;
+      out += bins_[static_cast<byte>('!' + phred)];
+    }
+  }
+
+  void wrap_lines(std::string& out, size_t seq) {
+    const size_t width = shape_.line_width;
+    if (width != 0 && out.size() - seq > width) {
+      std::string wrapped;
+      wrapped.reserve(out.size() - seq + (out.size() - seq) / width);
+      for (size_t pos = seq; pos < out.size(); pos += width) {
+        wrapped.append(out, pos, width);
+        wrapped += '\n';
+      }
+      out.resize(seq);
+      out += wrapped;
+    } else {
+      out += '\n';
+    }
+  }
+
+  ReadShape shape_;
+  Synthetic rng_;
+  std::array<char, 256> bins_;  // Binned quality score of each
+  u64 max_quality_ = 41;        // Phred
+  u64 n_reads_ = 0;
+  u64 next_n_;                  // Bases before the next N
+  u64 next_mask_;               // Bases before the next soft-masked run
+  u64 masked_ = 0;              // Bases left in the current soft-masked run
+};
+
+}  // namespace cryfa
+
+#endif  // CRYFA_SYNTHETIC_HPP
@@ -0,0 +1,88 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file thread_pool.hpp
+ * @brief Thread pool shared by the pipelines
+ */
+
+#ifndef CRYFA_THREAD_POOL_HPP
+#define CRYFA_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cryfa {
+
+/**
+ * @brief Fixed set of worker threads running submitted tasks in FIFO order.
+ *        Tasks must not wait on other tasks.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t n_threads) {
+    n_threads = std::max<size_t>(1, n_threads);
+    workers_.reserve(n_threads);
+    for (size_t i = 0; i != n_threads; ++i) {
+      workers_.emplace_back([this]() { work(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  auto operator=(const ThreadPool&) -> ThreadPool& = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+      task_ready_.notify_all();
+    }
+    for (auto& worker : workers_) {
+      if (worker.joinable()) {
+        worker.join();
+      }
+    }
+  }
+
+  void submit(std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+    task_ready_.notify_one();
+  }
+
+  auto size() const -> size_t { return workers_.size(); }
+
+ private:
+  void work() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        task_ready_.wait(lock, [&]() { return done_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable task_ready_;
+  std::deque<std::function<void()>> tasks_;
+  bool done_ = false;
+};
+
+}  // namespace cryfa
+
+#endif  // CRYFA_THREAD_POOL_HPP
@@ -0,0 +1,346 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file library.cpp
+ * @brief Library API
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include "assert.hpp"
+#include "cryfa/cryfa.hpp"
+#include "endecrypto.hpp"
+#include "fasta.hpp"
+#include "fastq.hpp"
+#include "file.hpp"
+#include "input_source.hpp"
+#include "memory_budget.hpp"
+#include "numeric.hpp"
+#include "qbin.hpp"
+#include "thread_pool.hpp"
+
+namespace cryfa {
+
+namespace {
+const std::string INPUT_NAME = "<input>";  // In place of the input file name
+
+/**
+ * @brief Parameters of a job, checked as the command line is
+ * @param options Options
+ * @return Parameters
+ */
+Param to_param(const Options& options) {
+  assert_single(options.key.size() < 8, "the password size must be at least 8.");
+  assert_single(options.n_threads == 0 || options.n_threads > 255,
+                "the number of threads must be from 1 to 255.");
+  assert_single(options.format != '\0' && options.format != 'A' && options.format != 'Q' &&
+                    options.format != 'n',
+                "the format must be 'A' (FASTA), 'Q' (FASTQ) or 'n' (other).");
+  if (!options.qbin.empty()) {
+    qbin_scheme(options.qbin);  // Check the name
+  }
+  if (!options.ref_file.empty()) {
+    check_file(options.ref_file);
+  }
+  assert_single(!options.reorder.empty() && options.reorder != "keep" && options.reorder != "drop",
+                std::format("\"{}\" is not a reordering mode; use \"keep\" or \"drop\".",
+                            options.reorder));
+#ifndef CRYFA_HAVE_ZLIB
+  assert_single(options.bgzf, "BGZF output requires cryfa built with zlib.");
+#endif
+
+  Param par;
+  par.quiet = true;
+  par.in_file = INPUT_NAME;
+  par.key = options.key;
+  par.n_threads = static_cast<byte>(options.n_threads);
+  par.stop_shuffle = !options.shuffle;
+  par.long_reads = options.long_reads;
+  par.qbin = options.qbin;
+  par.ref_file = options.ref_file;
+  par.reorder = options.reorder;
+  par.bgzf = options.bgzf;
+  par.max_memory = options.max_memory;
+  par.format = options.format;
+  par.pool = options.pool ? options.pool->handle() : nullptr;
+  par.keys = options.pool ? options.pool->keys() : nullptr;
+  par.references = options.pool ? options.pool->references() : nullptr;
+  return par;
+}
+
+/**
+ * @brief Fail if an encoder would keep more than max_input bytes of input
+ * @param options Options
+ * @param size Bytes of input
+ */
+void check_input_size(const Options& options, u64 size) {
+  assert_single(options.max_input != 0 && size > options.max_input,
+                std::format("the input is larger than {} bytes, the most it may be "
+                            "(\"max_input\").",
+                            options.max_input));
+}
+
+OutputFile::Sink to_sink(const Sink& sink) {
+  return [&sink](std::string_view data) { sink(std::span<const char>(data.data(), data.size())); };
+}
+
+void encode_source(const Options& options, const std::shared_ptr<InputSource>& source,
+                   const Sink& sink) {
+  Param par = to_param(options);
+  if (par.format == '\0') {
+    par.format = input_format([&]() { return source->open(); });
+  }
+  assert_single(!par.qbin.empty() && par.format != 'Q',
+                "quality score binning applies to FASTQ files.");
+  assert_single(!par.ref_file.empty() && par.format != 'Q',
+                "reference-based compaction applies to FASTQ files.");
+  assert_single(!par.ref_file.empty() && par.long_reads,
+                "long reads are not mapped to the reference; drop \"ref_file\" or "
+                "\"long_reads\".");
+  assert_single(!par.reorder.empty() && par.format != 'Q', "reordering applies to FASTQ files.");
+  assert_single(!par.reorder.empty() && par.long_reads,
+                "reordering cannot be combined with long-read mode.");
+
+  if (par.format == 'A') {
+    Fasta fa(par);
+    fa.set_streams(source, to_sink(sink));
+    fa.compress();
+  } else if (par.format == 'Q') {
+    Fastq fq(par);
+    fq.set_streams(source, to_sink(sink));
+    fq.compress();
+  } else {
+    EnDecrypto crypt(par);
+    crypt.set_streams(source, to_sink(sink));
+    crypt.shuffle_file();
+  }
+}
+
+void decode_source(const Options& options, const std::shared_ptr<InputSource>& source,
+                   const Sink& sink) {
+  const Param par = to_param(options);
+  EnDecrypto crypt(par);
+  crypt.set_streams(source, to_sink(sink));
+  // A streamed input is checked only once, when peeking at its first record
+  if (source->size()) {
+    assert_single(crypt.is_archive(), "archives are read by the cryfa tool.");
+  }
+
+  switch (crypt.peek_decrypted_type()) {
+    case (char)127: {
+      Fasta fa(par);
+      fa.set_streams(source, to_sink(sink));
+      fa.decompress();
+      break;
+    }
+    case (char)126:
+    case (char)123: {  // Long reads
+      Fastq fq(par);
+      fq.set_streams(source, to_sink(sink));
+      fq.decompress();
+      break;
+    }
+    case (char)124:
+      error("paired reads are written to two files by the cryfa tool.");
+      break;
+    case (char)125:
+      crypt.unshuffle_file();
+      break;
+    default:
+      error("corrupted file.");
+  }
+}
+
+/**
+ * @brief Value of a 0/1 option
+ */
+bool flag(std::string_view value) {
+  assert_single(value != "0" && value != "1", "the value must be 0 or 1.");
+  return value == "1";
+}
+
+InputSource::Pull to_pull(const Pull& pull) {
+  return [&pull](char* buffer, size_t size) { return pull(std::span<char>(buffer, size)); };
+}
+}  // namespace
+
+Pool::Pool(unsigned n_threads)
+    : pool_(std::make_unique<ThreadPool>(n_threads)),
+      keys_(std::make_unique<KeyCache>()),
+      references_(std::make_unique<ReferenceCache>()) {}
+
+Pool::~Pool() = default;
+
+void set_option(Options& options, std::string_view name, std::string_view value) {
+  if (name == "format") {
+    assert_single(value.size() != 1, "the format must be A, Q or n.");
+    options.format = value.front();
+  } else if (name == "threads") {
+    assert_single(!is_number(std::string(value)) || value.size() > 3,
+                  "the number of threads must be from 1 to 255.");
+    options.n_threads = static_cast<unsigned>(std::stoul(std::string(value)));
+  } else if (name == "shuffle") {
+    options.shuffle = flag(value);
+  } else if (name == "long_reads") {
+    options.long_reads = flag(value);
+  } else if (name == "qbin") {
+    options.qbin = value;
+  } else if (name == "ref") {
+    options.ref_file = value;
+  } else if (name == "reorder") {
+    options.reorder = value;
+  } else if (name == "bgzf") {
+    options.bgzf = flag(value);
+  } else if (name == "max_memory") {
+    options.max_memory = parse_size(std::string(value));
+    MemoryBudget::of(options.max_memory, 1);  // Check the size
+  } else if (name == "max_input") {
+    options.max_input = parse_size(std::string(value));
+  } else {
+    error(std::format("\"{}\" is not an option.", name));
+  }
+}
+
+struct Encoder::Impl {
+  Options options;
+  Sink sink;
+  std::string data;  // Input written
+  bool finished = false;
+};
+
+Encoder::Encoder(Options options, Sink sink)
+    : impl_(std::make_unique<Impl>(Impl{std::move(options), std::move(sink), {}, false})) {
+  to_param(impl_->options);  // Check the options
+}
+
+Encoder::~Encoder() = default;
+
+void Encoder::write(std::span<const char> data) {
+  assert_single(impl_->finished, "the encoder is finished.");
+  check_input_size(impl_->options, impl_->data.size() + data.size());
+  impl_->data.append(data.data(), data.size());
+}
+
+void Encoder::finish() {
+  assert_single(impl_->finished, "the encoder is finished.");
+  impl_->finished = true;
+  const std::string data = std::move(impl_->data);
+  encode(impl_->options, data, impl_->sink);
+}
+
+void Encoder::encode(const Options& options, std::span<const char> data, const Sink& sink) {
+  encode_source(options,
+                std::make_shared<InputSource>(std::string_view(data.data(), data.size())), sink);
+}
+
+void Encoder::encode(const Options& options, const Pull& pull, const Sink& sink) {
+  std::string data;
+  for (size_t n = 1; n != 0;) {
+    const size_t size = data.size();
+    data.resize(size + CHUNK_TARGET_SIZE);
+    n = pull(std::span<char>(data.data() + size, CHUNK_TARGET_SIZE));
+    data.resize(size + n);
+    check_input_size(options, data.size());
+  }
+  encode(options, data, sink);
+}
+
+/**
+ * @brief Input written is handed over to a thread decoding it, which pulls it
+ */
+struct Decoder::Impl {
+  Options options;
+  Sink sink;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::span<const char> pending;  // Written, not yet pulled
+  bool ended = false;             // No more input
+  bool done = false;              // Decoding has returned
+  std::exception_ptr failure;
+  std::thread worker;
+
+  auto pull(std::span<char> buffer) -> size_t {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&]() { return !pending.empty() || ended; });
+    const size_t n = std::min(buffer.size(), pending.size());
+    std::copy_n(pending.begin(), n, buffer.begin());
+    pending = pending.subspan(n);
+    if (pending.empty()) {
+      changed.notify_all();
+    }
+    return n;
+  }
+
+  void end() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ended = true;
+    }
+    changed.notify_all();
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+};
+
+Decoder::Decoder(Options options, Sink sink) : impl_(std::make_unique<Impl>()) {
+  to_param(options);  // Check the options
+  impl_->options = std::move(options);
+  impl_->sink = std::move(sink);
+  impl_->worker = std::thread([impl = impl_.get()]() {
+    try {
+      decode(impl->options, [impl](std::span<char> buffer) { return impl->pull(buffer); },
+             impl->sink);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(impl->mutex);
+      impl->failure = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->done = true;
+    impl->changed.notify_all();
+  });
+}
+
+Decoder::~Decoder() { impl_->end(); }
+
+void Decoder::write(std::span<const char> data) {
+  std::unique_lock<std::mutex> lock(impl_->mutex);
+  assert_single(impl_->ended, "the decoder is finished.");
+  impl_->pending = data;
+  impl_->changed.notify_all();
+  impl_->changed.wait(lock, [&]() { return impl_->pending.empty() || impl_->done; });
+  impl_->pending = {};
+  if (impl_->failure) {
+    std::rethrow_exception(impl_->failure);
+  }
+}
+
+void Decoder::finish() {
+  assert_single(impl_->ended, "the decoder is finished.");
+  impl_->end();
+  if (impl_->failure) {
+    std::rethrow_exception(impl_->failure);
+  }
+}
+
+void Decoder::decode(const Options& options, std::span<const char> data, const Sink& sink) {
+  decode_source(options,
+                std::make_shared<InputSource>(std::string_view(data.data(), data.size())), sink);
+}
+
+void Decoder::decode(const Options& options, const Pull& pull, const Sink& sink) {
+  decode_source(options, std::make_shared<InputSource>(to_pull(pull)), sink);
+}
+
+}  // namespace cryfa
@@ -0,0 +1,170 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file library_c.cpp
+ * @brief C API of the library
+ */
+
+#include <exception>
+#include <memory>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "assert.hpp"
+#include "cryfa/cryfa.h"
+#include "cryfa/cryfa.hpp"
+
+struct cryfa_pool {
+  explicit cryfa_pool(unsigned n_threads) : pool(n_threads) {}
+  cryfa::Pool pool;
+};
+
+struct cryfa_options {
+  cryfa::Options options;
+};
+
+namespace {
+/**
+ * @brief Encoder or decoder, and the first error of its calls
+ */
+template <typename Coder>
+struct Handle {
+  std::unique_ptr<Coder> coder;
+  std::string error;  // Empty: no error
+};
+
+/**
+ * @brief Run a call on a handle; no exception crosses the C API
+ * @return CRYFA_OK, or CRYFA_ERROR with the error kept by the handle
+ */
+template <typename Coder, typename Call>
+int guarded(Handle<Coder>* handle, Call&& call) {
+  if (!handle) {
+    return CRYFA_ERROR;
+  }
+  if (!handle->error.empty()) {
+    return CRYFA_ERROR;
+  }
+  try {
+    call(*handle->coder);
+    return CRYFA_OK;
+  } catch (const std::exception& e) {
+    handle->error = e.what();
+  } catch (...) {
+    handle->error = "unknown error.";
+  }
+  return CRYFA_ERROR;
+}
+
+template <typename H, typename Coder>
+H* new_handle(const cryfa_options* options, cryfa_sink sink, void* user) {
+  H* handle = new (std::nothrow) H;
+  if (!handle) {
+    return nullptr;
+  }
+  try {
+    assert_single(!options || !sink, "the options and the sink must be set.");
+    handle->coder = std::make_unique<Coder>(
+        options->options, [sink, user](std::span<const char> data) {
+          assert_single(sink(user, data.data(), data.size()) != CRYFA_OK, "the sink failed.");
+        });
+  } catch (const std::exception& e) {
+    handle->error = e.what();
+  } catch (...) {
+    handle->error = "unknown error.";
+  }
+  return handle;
+}
+}  // namespace
+
+struct cryfa_encoder : Handle<cryfa::Encoder> {};
+struct cryfa_decoder : Handle<cryfa::Decoder> {};
+
+extern "C" {
+
+cryfa_pool* cryfa_pool_new(unsigned n_threads) {
+  try {
+    return new cryfa_pool(n_threads);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void cryfa_pool_free(cryfa_pool* pool) { delete pool; }
+
+cryfa_options* cryfa_options_new(void) { return new (std::nothrow) cryfa_options; }
+
+void cryfa_options_free(cryfa_options* options) { delete options; }
+
+int cryfa_options_set_key(cryfa_options* options, const char* key, size_t size) {
+  if (!options || (!key && size != 0)) {
+    return CRYFA_ERROR;
+  }
+  try {
+    options->options.key.assign(key ? key : "", size);
+    return CRYFA_OK;
+  } catch (...) {
+    return CRYFA_ERROR;
+  }
+}
+
+int cryfa_options_set_pool(cryfa_options* options, cryfa_pool* pool) {
+  if (!options) {
+    return CRYFA_ERROR;
+  }
+  options->options.pool = pool ? &pool->pool : nullptr;
+  return CRYFA_OK;
+}
+
+int cryfa_options_set(cryfa_options* options, const char* name, const char* value) {
+  if (!options || !name || !value) {
+    return CRYFA_ERROR;
+  }
+  try {
+    cryfa::set_option(options->options, name, value);
+    return CRYFA_OK;
+  } catch (...) {
+    return CRYFA_ERROR;
+  }
+}
+
+cryfa_encoder* cryfa_encoder_new(const cryfa_options* options, cryfa_sink sink, void* user) {
+  return new_handle<cryfa_encoder, cryfa::Encoder>(options, sink, user);
+}
+
+int cryfa_encoder_push(cryfa_encoder* encoder, const char* data, size_t size) {
+  return guarded(encoder, [&](cryfa::Encoder& e) { e.write(std::span<const char>(data, size)); });
+}
+
+int cryfa_encoder_finish(cryfa_encoder* encoder) {
+  return guarded(encoder, [](cryfa::Encoder& e) { e.finish(); });
+}
+
+const char* cryfa_encoder_error(const cryfa_encoder* encoder) {
+  return encoder && !encoder->error.empty() ? encoder->error.c_str() : nullptr;
+}
+
+void cryfa_encoder_free(cryfa_encoder* encoder) { delete encoder; }
+
+cryfa_decoder* cryfa_decoder_new(const cryfa_options* options, cryfa_sink sink, void* user) {
+  return new_handle<cryfa_decoder, cryfa::Decoder>(options, sink, user);
+}
+
+int cryfa_decoder_push(cryfa_decoder* decoder, const char* data, size_t size) {
+  return guarded(decoder, [&](cryfa::Decoder& d) { d.write(std::span<const char>(data, size)); });
+}
+
+int cryfa_decoder_finish(cryfa_decoder* decoder) {
+  return guarded(decoder, [](cryfa::Decoder& d) { d.finish(); });
+}
+
+const char* cryfa_decoder_error(const cryfa_decoder* decoder) {
+  return decoder && !decoder->error.empty() ? decoder->error.c_str() : nullptr;
+}
+
+void cryfa_decoder_free(cryfa_decoder* decoder) { delete decoder; }
+
+}  // extern "C"
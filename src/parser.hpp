@@ -12,10 +12,17 @@
 #include <algorithm>
 #include <format>
 #include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "def.hpp"
 #include "file.hpp"
+#include "gzip.hpp"
+#include "input_source.hpp"
+#include "memory_budget.hpp"
 #include "numeric.hpp"
+#include "qbin.hpp"
 #include "string.hpp"
 
 namespace cryfa {
@@ -42,51 +49,82 @@ inline void check_pass(const std::string& fname) {
 }
 
 /**
- * @brief Check input file format (FASTA/FASTQ/other)
+ * @brief Check input file format (FASTA/FASTQ/other). Gzip input is checked
+ *        on its inflated content
  * @param inFileName The file name
+ * @param n_threads Number of threads inflating the input
  * @return A character
  */
-inline char frmt(const std::string& inFileName) {
-  wchar_t c;
-  std::wifstream in(inFileName);
-  assert_single(!in.good(), std::format("failed opening \"{}\".", inFileName));
+inline char frmt(const std::string& inFileName, size_t n_threads = 1) {
+  return input_format([&]() {
+    auto in = open_input(inFileName, n_threads);
+    assert_single(!in->good(), std::format("failed opening \"{}\".", inFileName));
+    return in;
+  });
+}
 
-  // Skip leading blank lines or spaces
-  while (in.peek() == '\n' || in.peek() == ' ') {
-    in.get(c);
-  }
+/**
+ * @brief Read the list of files of batch or archive mode. Each line has an
+ *        input file, optionally followed by a tab and its output file, or its
+ *        name in the archive. Empty lines and lines starting with '#' are
+ *        skipped
+ * @param listFileName The list file name
+ * @param action 'c' for compress+encrypt, 'd' for decrypt+decompress or 'a'
+ *               for archive
+ * @return Pairs of input and output file names
+ */
+inline std::vector<std::pair<std::string, std::string>> batch_list(
+    const std::string& listFileName, char action) {
+  std::ifstream in(listFileName);
+  assert_single(!in.good(), std::format("failed opening \"{}\".", listFileName));
 
-  // Fastq
-  while (in.peek() == '@') {
-    IGNORE_THIS_LINE(in);
-  }
-  byte nTabs = 0;
-  while (in.get(c) && c != '\n') {
-    if (c == '\t') {
-      ++nTabs;
+  const std::string ext = ".cryfa";
+  std::vector<std::pair<std::string, std::string>> files;
+  for (std::string line; std::getline(in, line);) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty() || line.front() == '#') {
+      continue;
     }
-  }
 
-  if (in.peek() == '+') {
-    in.close();
-    return 'Q';
-  }  // Fastq
+    const auto tab = line.find('\t');
+    std::string inFile = line.substr(0, tab);
+    std::string outFile = (tab == std::string::npos) ? "" : line.substr(tab + 1);
+    if (outFile.empty()) {
+      // Default: add ".cryfa" on encryption, and remove it on decryption. In
+      // an archive, the file name without its directory
+      if (action == 'a') {
+        outFile = file_name(inFile);
+      } else if (action == 'c') {
+        outFile = inFile + ext;
+      } else if (inFile.size() > ext.size() && inFile.ends_with(ext)) {
+        outFile = inFile.substr(0, inFile.size() - ext.size());
+      } else {
+        outFile = inFile + ".out";
+      }
+    }
 
-  // Fasta or Not Fasta/Fastq
-  in.clear();
-  in.seekg(0, std::ios::beg);  // Return to beginning of the file
-  while (in.peek() != '>' && in.peek() != EOF) {
-    IGNORE_THIS_LINE(in);
+    check_file(inFile);
+    assert_single(action != 'a' && outFile == inFile,
+                  std::format("the output file of \"{}\" must differ from it.", inFile));
+    files.emplace_back(std::move(inFile), std::move(outFile));
   }
 
-  if (in.peek() == '>') {
-    in.close();
-    return 'A';
-  }  // Fasta
-  else {
-    in.close();
-    return 'n';
-  }  // Not Fasta/Fastq
+  assert_single(files.empty(), std::format("no input file is listed in \"{}\".", listFileName));
+  return files;
+}
+
+/**
+ * @brief Check if a name can be a member of an archive, and be extracted to
+ *        the current directory
+ * @param name Member name
+ * @return True or false
+ */
+inline bool valid_member_name(const std::string& name) {
+  return !name.empty() && name != "." && name != ".." &&
+         name.find_first_of(std::string("/\\\0", 3)) == std::string::npos &&
+         name.find((char)254) == std::string::npos;
 }
 
 /**
@@ -140,6 +178,15 @@ inline void show_help() {
                    opt_space)
             << '\n'
             << '\n'
+            << init_space << bold("-o") << " [" << underline("OUT_FILE") << "],  "
+            << bold("--output") << " [" << underline("OUT_FILE") << "] \n"
+            << opt_space << "output file name -- default: standard output \n"
+            << wrap_text(
+                   "Writing to a file lets the workers store their chunks in parallel at their "
+                   "final offsets, instead of passing everything through the standard output.",
+                   opt_space)
+            << '\n'
+            << '\n'
             << init_space << bold("-s") << ",  " << bold("--stop_shuffle") << '\n'
             << opt_space << "stop shuffling the input \n"
             << '\n'
@@ -150,6 +197,137 @@ inline void show_help() {
             << init_space << bold("-v") << ",  " << bold("--verbose") << '\n'
             << opt_space << "verbose mode (more information) \n"
             << '\n'
+            << init_space << bold("--batch") << '\n'
+            << opt_space << "process the files listed in IN_FILE \n"
+            << wrap_text(
+                   "Each line of IN_FILE has an input file, optionally followed by a tab and its "
+                   "output file; by default, \".cryfa\" is appended on encryption and removed on "
+                   "decryption. All files share the key and one pool of worker threads.",
+                   opt_space)
+            << '\n'
+            << '\n'
+            << init_space << bold("--paired") << " [" << underline("FILE") << "] \n"
+            << opt_space << "FASTQ mates of the reads in IN_FILE \n"
+            << wrap_text(
+                   "The reads and their mates (R1 and R2) are read in lockstep and compacted "
+                   "into one output, where each mate header is stored as a difference from its "
+                   "read's header. On decryption, FILE is the output file of the mates.",
+                   opt_space)
+            << '\n'
+            << '\n'
+            << init_space << bold("--long") << '\n'
+            << opt_space << "long-read FASTQ mode \n"
+            << wrap_text(
+                   "Splits sequences and quality scores across chunks, so very long reads keep "
+                   "all threads busy. Chosen automatically for reads longer than 256 KB.",
+                   opt_space)
+            << '\n'
+            << '\n'
+            << init_space << bold("--qbin") << " [" << underline("SCHEME") << "] \n"
+            << opt_space << "lossy binning of FASTQ quality scores \n"
+            << wrap_text(
+                   "SCHEME is \"illumina8\" (Illumina 8-level) or \"ncbi4\" (NCBI 4-level). "
+                   "Fewer quality score symbols pack into fewer bytes. The scheme is recorded in "
+                   "the output, and decryption needs no option.",
+                   opt_space)
+            << '\n'
+            << '\n'
+            << init_space << bold("--ref") << " [" << underline("FILE") << "] \n"
+            << opt_space << "reference FASTA to map FASTQ reads on \n"
+            << wrap_text(
+                   "Reads matching the reference are stored as their position, strand and "
+                   "mismatches. Its index is cached in \"FILE.cryfa-idx\". Decryption needs the "
+                   "same reference.",
+                   opt_space)
+            << '\n'
+            << '\n'
+            << init_space << bold("--reorder") << " [" << underline("MODE") << "] \n"
+            << opt_space << "cluster similar FASTQ reads before compaction \n"
+            << wrap_text(
+                   "Reads are sorted by their minimizers, on disk if they exceed the memory, so "
+                   "overlapping reads share chunks. MODE is \"keep\", storing the original "
+                   "order to restore it on decryption, or \"drop\", leaving the reads in the "
+                   "new order.",
+                   opt_space)
+            << '\n'
+            << '\n'
+            << init_space << bold("--archive") << '\n'
+            << opt_space << "encrypt the files listed in IN_FILE into one archive \n"
+            << wrap_text(
+                   "Each line of IN_FILE has an input file, optionally followed by a tab and its "
+                   "name in the archive; by default, the file name. Each member is compacted as "
+                   "FASTA, FASTQ or other data, and the directory of members is encrypted, too. "
+                   "On decryption, archives are detected, and all members are extracted to "
+                   "files named after them.",
+                   opt_space)
+            << '\n'
+            << '\n'
+            << init_space << bold("--list") << '\n'
+            << opt_space << "list the members of an archive, on decryption \n"
+            << '\n'
+            << init_space << bold("--extract") << " [" << underline("NAME") << "] \n"
+            << opt_space << "extract only the member NAME of an archive, on decryption \n"
+            << '\n'
+            << init_space << bold("--bgzf") << '\n'
+            << opt_space << "BGZF-compressed output on decryption \n"
+            << wrap_text(
+                   "The output is compressed in blocks by the worker threads, and can be read "
+                   "by gzip, or indexed and read by samtools/htslib tools.",
+                   opt_space)
+            << '\n'
+            << '\n'
+            << init_space << bold("--max-memory") << " [" << underline("SIZE") << "] \n"
+            << opt_space << "keep the buffers of the job within SIZE, e.g. 512M or 2G \n"
+            << wrap_text(
+                   "Chunks in flight, their size, and the plaintext, output and unshuffling "
+                   "buffers are scaled down to the budget; stages wait for memory instead of "
+                   "exceeding it. At least 16M.",
+                   opt_space)
+            << '\n'
+            << '\n'
+            << init_space << bold("--stats") << " [" << underline("FILE") << "] \n"
+            << opt_space << "write the counters of the stages of the job to FILE, as JSON \n"
+            << wrap_text(
+                   "For reading, packing, shuffling, encryption, decryption, unpacking and "
+                   "writing: bytes, chunks, busy and blocked seconds, and the occupancy of the "
+                   "queue each feeds, and the peak RSS; to see which stage bounds a job.",
+                   opt_space)
+            << '\n'
+            << '\n'
+            << init_space << bold("--trace") << " [" << underline("FILE") << "] \n"
+            << opt_space << "write the spans of the stages on each thread to FILE \n"
+            << wrap_text(
+                   "Each chunk's reading, packing, encryption, waiting for its turn and writing, "
+                   "in the Chrome trace event format, to open in chrome://tracing or Perfetto.",
+                   opt_space)
+            << '\n'
+            << '\n'
+            << init_space << bold("--serve") << " [" << underline("SOCKET") << "] \n"
+            << opt_space << "run as a daemon, taking jobs on a Unix domain socket \n"
+            << wrap_text(
+                   "Each connection sends \"encrypt KEY_FILE\" or \"decrypt KEY_FILE\", "
+                   "optionally followed by NAME=VALUE options, on one line, then its input. All "
+                   "jobs share one pool of worker threads, and the keys derived from their "
+                   "passwords. See the README for the protocol.",
+                   opt_space)
+            << '\n'
+            << '\n'
+            << init_space << bold("--max-input") << " [" << underline("SIZE") << "] \n"
+            << opt_space << "limit the input of each job of the daemon to SIZE \n"
+            << wrap_text(
+                   "An encryption job keeps its whole input in memory; one sending more fails "
+                   "with an error as its status. 1G by default.",
+                   opt_space)
+            << '\n'
+            << '\n'
+            << init_space << bold("--max-total-input") << " [" << underline("SIZE") << "] \n"
+            << opt_space << "limit the input the daemon's jobs keep, together, to SIZE \n"
+            << wrap_text(
+                   "A job taking the input kept past it fails, as with --max-input. 4G by "
+                   "default.",
+                   opt_space)
+            << '\n'
+            << '\n'
             << init_space << bold("-h") << ",  " << bold("--help") << '\n'
             << opt_space << "usage guide \n"
             << '\n'
@@ -159,13 +337,6 @@ inline void show_help() {
             << bold("AUTHORS") << '\n'
             << "      Morteza Hosseini   seyedmorteza.hosseini@manchester.ac.uk\n"
             << "      Diogo Pratas       pratas@ua.pt \n"
-            << '\n'
-            << bold("Warning:") << ' '
-            << wrap_text(
-                   "the maximum file size supported is 64 GB. For larger files, you can split "
-                   "them, e.g. by \"split\" command, and encrypt each chunk. After the decryption, "
-                   "you can concatenate the chunks, e.g. by \"cat\" command.",
-                   "", 62)
             << std::endl;
 
   throw EXIT_SUCCESS;
@@ -184,7 +355,8 @@ inline void show_version() {
  * @param par An object to hold parameters
  * @param argc Number of command line options
  * @param argv Array of command line options
- * @return Operation mode: 'c' for compress+encrypt or 'd' for decrypt+decompress
+ * @return Operation mode: 'c' for compress+encrypt, 'd' for decrypt+decompress or
+ *         's' for serving
  */
 char parse(Param& par, int argc, char** argv) {
   if (argc < 2) show_help();
@@ -206,16 +378,31 @@ char parse(Param& par, int argc, char** argv) {
     show_version();
   }
 
-  // Check file size for > 64 GB
-  if (file_size(par.in_file) > (1ull << 36)) {
-    const std::string message = std::format(
-        "Size of \"{}\" is larger than 64 GB. You can split it, e.g. by \"split\" command, and "
-        "encrypt each chunk. After the decryption, you can concatenate the chunks, e.g. by \"cat\" "
-        "command.",
-        file_name(par.in_file));
-    error(message);
+  // Daemon: each job brings its own key and options
+  if (exist(vArgs.begin(), vArgs.end(), "--serve")) {
+    const auto serve = std::find(vArgs.begin(), vArgs.end(), "--serve");
+    assert_single(serve + 1 == vArgs.end() || (*(serve + 1))[0] == '-',
+                  "no socket has been set.");
+    par.in_file = *(serve + 1);
+    par.max_input = SERVE_MAX_INPUT;
+    par.max_total_input = SERVE_MAX_TOTAL_INPUT;
+    for (auto i = vArgs.begin(); i != vArgs.end(); ++i) {
+      if ((*i == "-t" || *i == "--thread") && i + 1 != vArgs.end() && is_number(*(i + 1))) {
+        par.n_threads = static_cast<byte>(stoi(*++i));
+      } else if (*i == "--max-input") {
+        assert_single(i + 1 == vArgs.end(), "no input limit has been set.");
+        par.max_input = parse_size(*++i);
+      } else if (*i == "--max-total-input") {
+        assert_single(i + 1 == vArgs.end(), "no input limit has been set.");
+        par.max_total_input = parse_size(*++i);
+      }
+    }
+    return 's';
   }
 
+  // Check the input file
+  check_file(par.in_file);
+
   // key -- MANDATORY
   assert_single(
       !exist(vArgs.begin(), vArgs.end(), "-k") && !exist(vArgs.begin(), vArgs.end(), "--key"),
@@ -231,19 +418,97 @@ char parse(Param& par, int argc, char** argv) {
     }
   }
 
-  // verbose, thread
+  // verbose, thread, output, bgzf, batch, archive, paired
   for (auto i = vArgs.begin(); i != vArgs.end(); ++i) {
     if (*i == "-v" || *i == "--verbose") {
       par.verbose = true;
+    } else if (*i == "--batch") {
+      par.batch = true;
+    } else if (*i == "--archive") {
+      par.archive = true;
+    } else if (*i == "--paired") {
+      assert_single(i + 1 == vArgs.end() - 1 || i + 1 == vArgs.end() || (*(i + 1))[0] == '-',
+                    "no mate file has been set.");
+      par.paired_file = *++i;
+      assert_single(par.paired_file == par.in_file, "the mate file must differ from the input.");
+    } else if (*i == "--qbin") {
+      assert_single(i + 1 == vArgs.end() - 1 || i + 1 == vArgs.end(),
+                    "no quality score binning scheme has been set.");
+      par.qbin = *++i;
+      qbin_scheme(par.qbin);  // Check the name
+    } else if (*i == "--ref") {
+      assert_single(i + 1 == vArgs.end() - 1 || i + 1 == vArgs.end() || (*(i + 1))[0] == '-',
+                    "no reference file has been set.");
+      par.ref_file = *++i;
+      check_file(par.ref_file);
+    } else if (*i == "--reorder") {
+      assert_single(i + 1 == vArgs.end() - 1 || i + 1 == vArgs.end(),
+                    "no reordering mode has been set.");
+      par.reorder = *++i;
+      assert_single(par.reorder != "keep" && par.reorder != "drop",
+                    std::format("\"{}\" is not a reordering mode; use \"keep\" or \"drop\".",
+                                par.reorder));
+    } else if (*i == "--long") {
+      par.long_reads = true;
+    } else if (*i == "--list") {
+      par.list_members = true;
+    } else if (*i == "--extract") {
+      assert_single(i + 1 == vArgs.end() - 1 || i + 1 == vArgs.end(),
+                    "no archive member has been set.");
+      par.extract = *++i;
+    } else if (*i == "--bgzf") {
+#ifndef CRYFA_HAVE_ZLIB
+      error("BGZF output requires cryfa built with zlib.");
+#endif
+      par.bgzf = true;
+    } else if (*i == "--max-memory") {
+      assert_single(i + 1 == vArgs.end() - 1 || i + 1 == vArgs.end(),
+                    "no memory budget has been set.");
+      par.max_memory = parse_size(*++i);
+      MemoryBudget::of(par.max_memory, par.n_threads);  // Check the size
+    } else if (*i == "--stats") {
+      assert_single(i + 1 == vArgs.end() - 1 || i + 1 == vArgs.end() || (*(i + 1))[0] == '-',
+                    "no stats file has been set.");
+      par.stats_file = *++i;
+      assert_single(par.stats_file == par.in_file, "the stats file must differ from the input.");
+    } else if (*i == "--trace") {
+      assert_single(i + 1 == vArgs.end() - 1 || i + 1 == vArgs.end() || (*(i + 1))[0] == '-',
+                    "no trace file has been set.");
+      par.trace_file = *++i;
+      assert_single(par.trace_file == par.in_file, "the trace file must differ from the input.");
     } else if ((*i == "-t" || *i == "--thread") && i + 1 != vArgs.end() && (*(i + 1))[0] != '-' &&
-               is_number(*(i + 1)))
+               is_number(*(i + 1))) {
       par.n_threads = static_cast<byte>(stoi(*++i));
+    } else if (*i == "-o" || *i == "--output") {
+      assert_single(i + 1 == vArgs.end() - 1 || i + 1 == vArgs.end() || (*(i + 1))[0] == '-',
+                    "no output file has been set.");
+      par.out_file = *++i;
+      assert_single(par.out_file == par.in_file, "the output file must differ from the input.");
+    }
   }
 
+  assert_single(par.batch && !par.out_file.empty(),
+                "in batch mode, the output files are set in the list of files.");
+  assert_single(par.batch && par.archive, "batch and archive modes cannot be combined.");
+  assert_single(!par.paired_file.empty() && (par.batch || par.archive),
+                "paired mode cannot be combined with batch or archive modes.");
+
   // Decrypt+decompress
   if (exist(vArgs.begin(), vArgs.end(), "-d") || exist(vArgs.begin(), vArgs.end(), "--dec")) {
+    assert_single(par.archive, "archives are detected on decryption; drop \"--archive\".");
+    assert_single(par.list_members && !par.extract.empty(),
+                  "\"--list\" and \"--extract\" cannot be combined.");
+    assert_single(!par.qbin.empty(),
+                  "\"--qbin\" is used on encryption; decryption reads the scheme from the file.");
+    assert_single(!par.reorder.empty(),
+                  "\"--reorder\" is used on encryption; decryption restores the order if it "
+                  "was kept.");
+    assert_single(!par.paired_file.empty() && par.paired_file == par.out_file,
+                  "the output files of the reads and of their mates must differ.");
     return 'd';
   }
+  assert_single(par.list_members || !par.extract.empty(),
+                "\"--list\" and \"--extract\" are used on decryption.");
 
   // stop_shuffle, frmt
   for (auto i = vArgs.begin(); i != vArgs.end(); ++i) {
@@ -254,7 +519,26 @@ char parse(Param& par, int argc, char** argv) {
     }
   }
   if (!exist(vArgs.begin(), vArgs.end(), "-f") && !exist(vArgs.begin(), vArgs.end(), "--force")) {
-    par.format = frmt(par.in_file);  // Not standard input file
+    // In batch and archive modes, the format is checked for each file
+    par.format = (par.batch || par.archive) ? '\0'
+                                             : frmt(par.in_file, par.n_threads);  // Not stdin
+  }
+  assert_single(!par.qbin.empty() && par.format != 'Q' && par.format != '\0',
+                "quality score binning applies to FASTQ files.");
+  assert_single(par.long_reads && !par.paired_file.empty(),
+                "long-read mode cannot be combined with paired mode.");
+  assert_single(!par.ref_file.empty() && par.format != 'Q' && par.format != '\0',
+                "reference-based compaction applies to FASTQ files.");
+  assert_single(!par.ref_file.empty() && par.long_reads,
+                "long reads are not mapped to the reference; drop \"--ref\" or \"--long\".");
+  assert_single(!par.reorder.empty() && par.format != 'Q' && par.format != '\0',
+                "reordering applies to FASTQ files.");
+  assert_single(!par.reorder.empty() && (par.long_reads || !par.paired_file.empty()),
+                "reordering cannot be combined with long-read or paired modes.");
+  if (!par.paired_file.empty()) {
+    check_file(par.paired_file);
+    assert_single(par.format != 'Q' || frmt(par.paired_file, par.n_threads) != 'Q',
+                  "paired mode needs two FASTQ files.");
   }
 
   // Compress+encrypt
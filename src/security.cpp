@@ -8,27 +8,32 @@
 
 #include "security.hpp"
 
+#include <algorithm>
+#include <array>
+#include <format>
 #include <fstream>
 #include <iomanip>  // setw, std::setprecision
 #include <mutex>
 #include <numeric>  // std::accumulate, std::iota
+#include <optional>
+#include <stdexcept>
+#include <string>
 
 #include "assert.hpp"
 #include "cryptopp/aes.h"
 #include "cryptopp/eax.h"
 #include "cryptopp/files.h"
 #include "cryptopp/gcm.h"
+#include "cryptopp/osrng.h"
 #include "cryptopp/simple.h"
+#include "file.hpp"
+#include "gzip.hpp"
 #include "numeric.hpp"
+#include "output_file.hpp"
 #include "string.hpp"
 #include "time.hpp"
 using namespace cryfa;
 
-std::mutex mutxSec; /**< @brief Mutex */
-std::mutex Security::derived_state_mutex;
-std::unordered_map<std::string, std::shared_ptr<const Security::DerivedState>>
-    Security::derived_state_cache;
-
 namespace {
 class FunctionSink : public CryptoPP::Bufferless<CryptoPP::Sink> {
  public:
@@ -49,114 +54,313 @@ class FunctionSink : public CryptoPP::Bufferless<CryptoPP::Sink> {
  private:
   std::function<void(std::string_view)> sink_;
 };
+
+// Sealed-record container: magic, then records of
+// [u64 LE plaintext size][ciphertext][tag], closed by an empty final record
+constexpr char RECORD_MAGIC[] = "\x89" "CRYFA2\n";
+constexpr size_t RECORD_MAGIC_SIZE = sizeof(RECORD_MAGIC) - 1;
+constexpr size_t RECORD_SIZE_BYTES = 8;
+
+// Archive: magic, the records of each member, the records of the directory,
+// then a trailer of [u64 LE directory offset][magic]
+constexpr char ARCHIVE_MAGIC[] = "\x89" "CRYFAA\n";
+constexpr size_t ARCHIVE_TRAILER_SIZE = RECORD_SIZE_BYTES + RECORD_MAGIC_SIZE;
+constexpr u64 DIRECTORY_MEMBER = ~0ULL;
+constexpr u64 UNSIZED = ~0ULL;  // Size of a streamed input, until its end
+// Plaintext of a record, at most: a chunk, with a read and its mate past its
+// target, packed. Larger sizes are forged, and rejected before reading
+constexpr u64 MAX_RECORD_SIZE = 4 * MAX_CHUNK_SIZE;
+
+void put_u64(byte* p, u64 v) {
+  for (size_t i = 0; i != 8; ++i) {
+    p[i] = static_cast<byte>(v >> (8 * i));
+  }
+}
+
+u64 get_u64(const byte* p) {
+  u64 v = 0;
+  for (size_t i = 8; i--;) {
+    v = v << 8 | p[i];
+  }
+  return v;
+}
+
+// IV XOR [member][index]; member 0 is a stand-alone file
+template <size_t N>
+std::array<byte, N> record_nonce(std::array<byte, N> iv, u64 member, u64 index) {
+  static_assert(N == 2 * RECORD_SIZE_BYTES);
+  for (size_t i = 0; i != RECORD_SIZE_BYTES; ++i) {
+    iv[i] ^= static_cast<byte>(member >> (8 * i));
+    iv[RECORD_SIZE_BYTES + i] ^= static_cast<byte>(index >> (8 * i));
+  }
+  return iv;
+}
+
+std::array<byte, RECORD_SIZE_BYTES + 1> record_aad(u64 index, bool final) {
+  std::array<byte, RECORD_SIZE_BYTES + 1> aad{};
+  put_u64(aad.data(), index);
+  aad.back() = final ? 1 : 0;
+  return aad;
+}
+
+bool has_magic(std::istream& in, const char* magic) {
+  char head[RECORD_MAGIC_SIZE]{};
+  return in.read(head, RECORD_MAGIC_SIZE) &&
+         std::string_view(head, RECORD_MAGIC_SIZE) == std::string_view(magic, RECORD_MAGIC_SIZE);
+}
+
+struct SealedRecord {
+  std::string sealed;  // Ciphertext and tag
+  bool final = false;
+};
+
+// Read the next record, within the remaining bytes of the stream
+SealedRecord read_sealed(std::istream& in, u64& remaining) {
+  byte size_bytes[RECORD_SIZE_BYTES];
+  if (remaining < RECORD_SIZE_BYTES ||
+      !in.read(reinterpret_cast<char*>(size_bytes), RECORD_SIZE_BYTES)) {
+    throw std::runtime_error("corrupted file.");  // Truncated before the final record
+  }
+  remaining -= RECORD_SIZE_BYTES;
+
+  const u64 size = get_u64(size_bytes);
+  if (size > MAX_RECORD_SIZE || remaining < TAG_SIZE || size > remaining - TAG_SIZE) {
+    throw std::runtime_error("corrupted file.");
+  }
+
+  // Grown as the bytes arrive, so a streamed input cut short costs no more
+  // than what it sent
+  SealedRecord record;
+  for (u64 left = size + TAG_SIZE; left != 0;) {
+    const size_t at = record.sealed.size();
+    const size_t n = static_cast<size_t>(std::min<u64>(left, CHUNK_TARGET_SIZE));
+    record.sealed.resize(at + n);
+    if (!in.read(record.sealed.data() + at, static_cast<std::streamsize>(n))) {
+      throw std::runtime_error("corrupted file.");
+    }
+    left -= n;
+  }
+  remaining -= record.sealed.size();
+  record.final = (size == 0);
+  return record;
+}
 }  // namespace
 
 /**
- * @brief Encrypt
- * @details AES encryption uses a secret key of a variable length (128, 196 or 256 bit).
- *          This key is secretly exchanged between two parties before communication begins.
- *
- *          DEFAULT_KEYLENGTH = 16 bytes.
+ * @brief Seal a record: its nonce is the IV XOR its member and index, and its
+ *        associated data is the index and whether it is the final record
+ * @param state Key and IV
+ * @param member Archive member, or 0
+ * @param index Index of the record in the stream
+ * @param plaintext Plaintext
+ * @param final Whether this is the final record
+ * @return Size, ciphertext and tag
  */
-void Security::encrypt() {
-  std::cerr << bold("[+]") << " Encrypting ...";
-  const auto start = now();  // Start timer
+std::string Security::seal_record(const DerivedState& state, u64 member, u64 index,
+                                  std::string_view plaintext, bool final) {
+  assert_single(plaintext.size() > MAX_RECORD_SIZE,
+                std::format("a chunk packs to {} bytes, more than the {} a record may hold; a "
+                            "header or read of the input is too long.",
+                            plaintext.size(), MAX_RECORD_SIZE));
+  const auto nonce = record_nonce(state.iv, member, index);
+  const auto aad = record_aad(index, final);
+
+  std::string record(RECORD_SIZE_BYTES + plaintext.size() + TAG_SIZE, '\0');
+  auto out = reinterpret_cast<byte*>(record.data());
+  put_u64(out, plaintext.size());
+
+  CryptoPP::GCM<CryptoPP::AES>::Encryption e;
+  e.SetKeyWithIV(state.key.data(), state.key.size(), nonce.data(), nonce.size());
+  e.EncryptAndAuthenticate(out + RECORD_SIZE_BYTES, out + RECORD_SIZE_BYTES + plaintext.size(),
+                           TAG_SIZE, nonce.data(), static_cast<int>(nonce.size()), aad.data(),
+                           aad.size(), reinterpret_cast<const byte*>(plaintext.data()),
+                           plaintext.size());
+  return record;
+}
 
-  const auto state = derived_state();
+/**
+ * @brief Open a record sealed by seal_record()
+ * @param state Key and IV
+ * @param member Archive member, or 0
+ * @param index Index of the record in the stream
+ * @param sealed Ciphertext and tag
+ * @param final Whether this is the final record
+ * @return Plaintext
+ */
+std::string Security::open_record(const DerivedState& state, u64 member, u64 index,
+                                  std::string_view sealed, bool final) {
+  if (sealed.size() < TAG_SIZE) {
+    throw std::runtime_error("corrupted file.");
+  }
 
-  try {
-    CryptoPP::GCM<CryptoPP::AES>::Encryption e;
-    e.SetKeyWithIV(state->key.data(), state->key.size(), state->iv.data(), state->iv.size());
+  const auto nonce = record_nonce(state.iv, member, index);
+  const auto aad = record_aad(index, final);
 
-    CryptoPP::FileSource(PCKD_FNAME.c_str(), true,
-                         new CryptoPP::AuthenticatedEncryptionFilter(
-                             e, new CryptoPP::FileSink(std::cout), false, TAG_SIZE));
-  } catch (CryptoPP::InvalidArgument& e) {
-    std::cerr << "Caught InvalidArgument...\n" << e.what() << "\n";
-  } catch (CryptoPP::Exception& e) {
-    std::cerr << "Caught Exception...\n" << e.what() << "\n";
+  const size_t size = sealed.size() - TAG_SIZE;
+  const auto in = reinterpret_cast<const byte*>(sealed.data());
+  std::string plaintext(size, '\0');
+
+  CryptoPP::GCM<CryptoPP::AES>::Decryption d;
+  d.SetKeyWithIV(state.key.data(), state.key.size(), nonce.data(), nonce.size());
+  if (!d.DecryptAndVerify(reinterpret_cast<byte*>(plaintext.data()), in + size, TAG_SIZE,
+                          nonce.data(), static_cast<int>(nonce.size()), aad.data(), aad.size(),
+                          in, size)) {
+    throw CryptoPP::HashVerificationFilter::HashVerificationFailed();
   }
+  return plaintext;
+}
 
-  const auto finish = now();  // Stop timer
-  std::cerr << "\r" << bold("[+]") << " Encrypting done in " << hms(finish - start);
+/**
+ * @brief Cipher of the runs a sort spills to disk, under a random key and IV
+ *        of its own, so the reads never reach the disk in the clear
+ * @return Cipher sealing each block as a record of member "run"
+ */
+SpillCipher Security::spill_cipher() {
+  auto state = std::make_shared<DerivedState>();
+  CryptoPP::AutoSeededRandomPool rng;
+  rng.GenerateBlock(state->key.data(), state->key.size());
+  rng.GenerateBlock(state->iv.data(), state->iv.size());
+
+  return SpillCipher{
+      [state](u64 run, u64 block, std::string_view plain, bool final) {
+        return seal_record(*state, run, block, plain, final);
+      },
+      [state](u64 run, u64 block, std::string_view sealed, bool final) {
+        if (sealed.size() < RECORD_SIZE_BYTES) {
+          throw std::runtime_error("corrupted file.");
+        }
+        return open_record(*state, run, block, sealed.substr(RECORD_SIZE_BYTES), final);
+      }};
+}
 
-  // Delete packed file
-  const std::string pkdFileName = PCKD_FNAME;
-  std::remove(pkdFileName.c_str());
+/**
+ * @brief Seal and write a record
+ * @param plaintext Plaintext
+ */
+void Security::RecordSink::emit(std::string_view plaintext) {
+  if (plaintext.empty()) {
+    return;  // Only the final record is empty
+  }
+  out_.write(seal_record(*state_, member_, next_index_++, plaintext, false));
 }
 
-void Security::encrypt_stream(const PlaintextProducer& produce_plaintext) {
-  std::cerr << bold("[+]") << " Encrypting ...";
+void Security::encrypt_stream(const RecordProducer& produce_records) {
+  progress() << bold("[+]") << " Encrypting ...";
   const auto start = now();  // Start timer
 
-  const auto state = derived_state();
-
-  try {
-    CryptoPP::GCM<CryptoPP::AES>::Encryption e;
-    e.SetKeyWithIV(state->key.data(), state->key.size(), state->iv.data(), state->iv.size());
-
-    CryptoPP::AuthenticatedEncryptionFilter filter(e, new CryptoPP::FileSink(std::cout), false,
-                                                   TAG_SIZE);
-    const PlaintextSink sink = [&](std::string_view plaintext) {
-      filter.Put(reinterpret_cast<const CryptoPP::byte*>(plaintext.data()), plaintext.size());
-    };
+  // Archive members go to the archive; stand-alone files get their own output
+  std::optional<OutputFile> own_out;
+  OutputFile* out = archive_out_;
+  if (!out) {
+    out = &own_out.emplace(out_file, n_threads, out_sink, memory().output_queue);
+    out->write(std::string(RECORD_MAGIC, RECORD_MAGIC_SIZE));
+  }
 
-    produce_plaintext(sink);
-    filter.MessageEnd();
-  } catch (CryptoPP::InvalidArgument& e) {
-    std::cerr << "Caught InvalidArgument...\n" << e.what() << "\n";
-  } catch (CryptoPP::Exception& e) {
-    std::cerr << "Caught Exception...\n" << e.what() << "\n";
+  RecordSink records(derived_state(), member_, *out, pool, stats, memory());
+  produce_records(records);
+  out->write(seal_record(*records.state_, member_, records.next_index_, {}, true));
+  if (own_out) {
+    own_out->close();
   }
 
   const auto finish = now();  // Stop timer
-  std::cerr << "\r" << bold("[+]") << " Encrypting done in " << hms(finish - start);
+  progress() << "\r" << bold("[+]") << " Encrypting done in " << hms(finish - start);
 }
 
 /**
- * @brief Decrypt
- * @details AES encryption uses a secret key of a variable length (128, 196 or 256 bit).
- *          This key is secretly exchanged between two parties before communication begins.
- *
- *          DEFAULT_KEYLENGTH = 16 bytes.
+ * @brief Make the following encryption a member of an archive
+ * @param member Member number, from 1
+ * @param out Archive output
  */
-void Security::decrypt() {
-  assert_file_good(in_file);
+void Security::set_archive_member(u64 member, OutputFile& out) {
+  member_ = member;
+  archive_out_ = &out;
+}
 
-  std::cerr << bold("[+]") << " Decrypting ...";
-  const auto start = now();  // Start timer
+/**
+ * @brief Make the following decryption read a member of the input archive
+ * @param member Member number, from 1
+ * @param location Where the records of the member are
+ */
+void Security::set_archive_member(u64 member, const ArchiveMember& location) {
+  member_ = member;
+  range_offset_ = location.offset;
+  range_size_ = location.size;
+}
 
-  const auto state = derived_state();
+/**
+ * @brief Read the input from a source and write the output to a sink,
+ *        instead of in_file and out_file
+ * @param source Input, or null for in_file
+ * @param sink Output, or null for out_file
+ */
+void Security::set_streams(std::shared_ptr<InputSource> source, OutputFile::Sink sink) {
+  in_source_ = std::move(source);
+  out_sink = std::move(sink);
+}
 
-  try {
-    std::ifstream in(in_file);
-    const char* outFile = DEC_FNAME.c_str();
+/**
+ * @brief Open an input: the source, if set, in place of in_file
+ * @param name Name of the file
+ * @param inflate Decompress gzip/BGZF input
+ * @return Input stream from the beginning
+ */
+std::unique_ptr<std::istream> Security::open_in(const std::string& name, bool inflate) const {
+  if (in_source_ && name == in_file) {
+    return in_source_->open();
+  }
+  if (!inflate) {
+    return std::make_unique<std::ifstream>(name, std::ios::binary);
+  }
+  return open_input(name, n_threads);
+}
 
-    CryptoPP::GCM<CryptoPP::AES>::Decryption d;
-    d.SetKeyWithIV(state->key.data(), state->key.size(), state->iv.data(), state->iv.size());
+/**
+ * @brief Stream of the progress messages -- discards them if quiet
+ */
+std::ostream& Security::progress() const {
+  static thread_local std::ostream discard(nullptr);
+  return quiet ? discard : std::cerr;
+}
 
-    CryptoPP::AuthenticatedDecryptionFilter df(
-        d, new CryptoPP::FileSink(outFile), CryptoPP::AuthenticatedDecryptionFilter::DEFAULT_FLAGS,
-        TAG_SIZE);
-    CryptoPP::FileSource(in, true, new CryptoPP::Redirector(df /*, PASS_EVERYTHING */));
-    in.close();
-  } catch (CryptoPP::HashVerificationFilter::HashVerificationFailed& e) {
-    std::cerr << "Caught HashVerificationFailed...\n" << e.what() << "\n";
-  } catch (CryptoPP::InvalidArgument& e) {
-    std::cerr << "Caught InvalidArgument...\n" << e.what() << "\n";
-  } catch (CryptoPP::Exception& e) {
-    std::cerr << "Caught Exception...\n" << e.what() << "\n";
+/**
+ * @brief Size of the encrypted input
+ * @return Number of bytes, or UNSIZED if streamed
+ */
+u64 Security::encrypted_size() const {
+  if (!in_source_) {
+    return file_size(in_file);
   }
-
-  const auto finish = now();  // Stop timer
-  std::cerr << "\r" << bold("[+]") << " Decrypting done in " << hms(finish - start);
+  return in_source_->size().value_or(UNSIZED);
 }
 
 char Security::peek_decrypted_type() {
-  assert_file_good(in_file);
+  if (!in_source_) {
+    assert_file_good(in_file);
+  }
 
   const auto state = derived_state();
-  std::ifstream in(in_file, std::ios::binary);
+  const auto in_ptr = open_in(in_file, false);
+  std::istream& in = *in_ptr;
+  u64 remaining = 0;
+  if (range_size_ != 0) {
+    in.seekg(static_cast<std::streamoff>(range_offset_), std::ios::beg);
+    remaining = range_size_;
+  } else if (has_magic(in, RECORD_MAGIC)) {
+    remaining = encrypted_size() - RECORD_MAGIC_SIZE;
+  }
+
+  if (remaining != 0) {
+    const SealedRecord record = read_sealed(in, remaining);
+    if (record.final) {
+      error("corrupted file.");
+    }
+    return open_record(*state, member_, 0, record.sealed, false).front();
+  }
+
+  // Legacy single-message file: decrypt only its first byte
+  in.clear();
+  in.seekg(0, std::ios::beg);
   char encrypted_type = 0;
   if (!in.get(encrypted_type)) {
     error("corrupted file.");
@@ -170,38 +374,183 @@ char Security::peek_decrypted_type() {
   return static_cast<char>(decrypted_type);
 }
 
+/**
+ * @brief Open the records in parallel and pass their plaintext on in order
+ * @param in Input positioned at the first record
+ * @param remaining Number of bytes of the records
+ * @param member Archive member, or 0
+ * @param state Key and IV
+ * @param consume_plaintext Plaintext consumer
+ */
+void Security::decrypt_records(std::istream& in, u64 remaining, u64 member,
+                               const DerivedState& state, const PlaintextSink& consume_plaintext) {
+  const bool unsized = in_source_ && !in_source_->size();
+  bool final_seen = false;
+  auto read_record = [&]() -> std::optional<SealedRecord> {
+    if (final_seen) {
+      if (unsized ? in.peek() != EOF : remaining != 0) {
+        throw std::runtime_error("corrupted file.");  // Data after the final record
+      }
+      return std::nullopt;
+    }
+
+    SealedRecord record = read_sealed(in, remaining);
+    final_seen = record.final;
+    return record;
+  };
+
+  run_ordered_pipeline<SealedRecord>(
+      n_threads, read_record,
+      [&](SealedRecord record, u64 index) {
+        return open_record(state, member, index, record.sealed, record.final);
+      },
+      [&](std::string plaintext) { consume_plaintext(plaintext); }, pool,
+      {stats, Stage::read, Stage::open, Stage::none}, memory());
+}
+
+/**
+ * @brief Decrypt a legacy file, encrypted as a single GCM message
+ * @param in Input positioned at the beginning
+ * @param state Key and IV
+ * @param consume_plaintext Plaintext consumer
+ */
+void Security::decrypt_legacy(std::istream& in, const DerivedState& state,
+                              const PlaintextSink& consume_plaintext) {
+  CryptoPP::GCM<CryptoPP::AES>::Decryption d;
+  d.SetKeyWithIV(state.key.data(), state.key.size(), state.iv.data(), state.iv.size());
+
+  CryptoPP::AuthenticatedDecryptionFilter df(
+      d, new FunctionSink(consume_plaintext),
+      CryptoPP::AuthenticatedDecryptionFilter::DEFAULT_FLAGS, TAG_SIZE);
+  CryptoPP::FileSource(in, true, new CryptoPP::Redirector(df /*, PASS_EVERYTHING */));
+}
+
 void Security::decrypt_stream(const PlaintextSink& consume_plaintext) {
-  assert_file_good(in_file);
+  if (!in_source_) {
+    assert_file_good(in_file);
+  }
 
-  std::cerr << bold("[+]") << " Decrypting ...";
+  progress() << bold("[+]") << " Decrypting ...";
   const auto start = now();  // Start timer
 
   const auto state = derived_state();
 
   try {
-    std::ifstream in(in_file);
-
-    CryptoPP::GCM<CryptoPP::AES>::Decryption d;
-    d.SetKeyWithIV(state->key.data(), state->key.size(), state->iv.data(), state->iv.size());
-
-    CryptoPP::AuthenticatedDecryptionFilter df(
-        d, new FunctionSink(consume_plaintext),
-        CryptoPP::AuthenticatedDecryptionFilter::DEFAULT_FLAGS, TAG_SIZE);
-    CryptoPP::FileSource(in, true, new CryptoPP::Redirector(df /*, PASS_EVERYTHING */));
-    in.close();
+    const auto in_ptr = open_in(in_file, false);
+    std::istream& in = *in_ptr;
+    if (range_size_ != 0) {
+      in.seekg(static_cast<std::streamoff>(range_offset_), std::ios::beg);
+      decrypt_records(in, range_size_, member_, *state, consume_plaintext);
+    } else if (has_magic(in, RECORD_MAGIC)) {
+      decrypt_records(in, encrypted_size() - RECORD_MAGIC_SIZE, 0, *state, consume_plaintext);
+    } else {
+      in.clear();
+      in.seekg(0, std::ios::beg);
+      decrypt_legacy(in, *state, consume_plaintext);
+    }
   } catch (CryptoPP::HashVerificationFilter::HashVerificationFailed& e) {
-    std::cerr << "Caught HashVerificationFailed...\n" << e.what() << "\n";
+    progress() << "Caught HashVerificationFailed...\n" << e.what() << "\n";
     throw;
   } catch (CryptoPP::InvalidArgument& e) {
-    std::cerr << "Caught InvalidArgument...\n" << e.what() << "\n";
+    progress() << "Caught InvalidArgument...\n" << e.what() << "\n";
     throw;
   } catch (CryptoPP::Exception& e) {
-    std::cerr << "Caught Exception...\n" << e.what() << "\n";
+    progress() << "Caught Exception...\n" << e.what() << "\n";
     throw;
   }
 
   const auto finish = now();  // Stop timer
-  std::cerr << "\r" << bold("[+]") << " Decrypting done in " << hms(finish - start);
+  progress() << "\r" << bold("[+]") << " Decrypting done in " << hms(finish - start);
+}
+
+/**
+ * @brief Check if the input file is an archive
+ * @return True or false
+ */
+bool Security::is_archive() const {
+  return has_magic(*open_in(in_file, false), ARCHIVE_MAGIC);
+}
+
+/**
+ * @brief Start an archive
+ * @param out Archive output
+ */
+void Security::begin_archive(OutputFile& out) {
+  out.write(std::string(ARCHIVE_MAGIC, RECORD_MAGIC_SIZE));
+}
+
+/**
+ * @brief End an archive with its encrypted directory and the trailer
+ * @param out Archive output
+ * @param members Members of the archive
+ */
+void Security::write_archive_directory(OutputFile& out, const std::vector<ArchiveMember>& members) {
+  std::string directory;
+  for (const ArchiveMember& member : members) {
+    directory += std::format("{}{}{}{}{}{}", member.name, (char)254, member.offset, (char)254,
+                             member.size, (char)254);
+  }
+
+  const auto state = derived_state();
+  const u64 directory_offset = out.size();
+  u64 index = 0;
+  for (size_t at = 0; at < directory.size(); at += MAX_CHUNK_SIZE) {
+    out.write(seal_record(*state, DIRECTORY_MEMBER, index++,
+                          std::string_view(directory).substr(at, MAX_CHUNK_SIZE), false));
+  }
+  out.write(seal_record(*state, DIRECTORY_MEMBER, index, {}, true));
+
+  std::string trailer(RECORD_SIZE_BYTES, '\0');
+  put_u64(reinterpret_cast<byte*>(trailer.data()), directory_offset);
+  trailer.append(ARCHIVE_MAGIC, RECORD_MAGIC_SIZE);
+  out.write(trailer);
+}
+
+/**
+ * @brief Read the directory of the input archive, from the trailer at its end
+ * @return Members of the archive
+ */
+std::vector<Security::ArchiveMember> Security::read_archive_directory() {
+  const u64 total = file_size(in_file);
+  if (total < RECORD_MAGIC_SIZE + ARCHIVE_TRAILER_SIZE) {
+    error("corrupted file.");
+  }
+
+  std::ifstream in(in_file, std::ios::binary);
+  in.seekg(static_cast<std::streamoff>(total - ARCHIVE_TRAILER_SIZE), std::ios::beg);
+  byte offset_bytes[RECORD_SIZE_BYTES];
+  if (!in.read(reinterpret_cast<char*>(offset_bytes), RECORD_SIZE_BYTES) ||
+      !has_magic(in, ARCHIVE_MAGIC)) {
+    error("corrupted file.");
+  }
+  const u64 directory_offset = get_u64(offset_bytes);
+  if (directory_offset < RECORD_MAGIC_SIZE || directory_offset > total - ARCHIVE_TRAILER_SIZE) {
+    error("corrupted file.");
+  }
+
+  std::string directory;
+  in.seekg(static_cast<std::streamoff>(directory_offset), std::ios::beg);
+  decrypt_records(in, total - ARCHIVE_TRAILER_SIZE - directory_offset, DIRECTORY_MEMBER,
+                  *derived_state(), [&](std::string_view plaintext) { directory += plaintext; });
+
+  std::vector<ArchiveMember> members;
+  std::vector<std::string> fields;
+  for (size_t begin = 0, end; (end = directory.find((char)254, begin)) != std::string::npos;
+       begin = end + 1) {
+    fields.push_back(directory.substr(begin, end - begin));
+  }
+  if (fields.size() % 3 != 0) {
+    error("corrupted file.");
+  }
+  for (size_t i = 0; i != fields.size(); i += 3) {
+    ArchiveMember member{fields[i], std::stoull(fields[i + 1]), std::stoull(fields[i + 2])};
+    if (member.offset < RECORD_MAGIC_SIZE || member.size == 0 ||
+        member.size > directory_offset - member.offset) {
+      error("corrupted file.");
+    }
+    members.push_back(std::move(member));
+  }
+  return members;
 }
 
 /**
@@ -220,27 +569,44 @@ int Security::random() { return (int)(random_engine()() - random_engine().min())
  * @brief Random number engine
  * @return The classic Minimum Standard rand0
  */
-std::minstd_rand0& Security::random_engine() {
-  static std::minstd_rand0 e{};
-  return e;
-}
+std::minstd_rand0& Security::random_engine() { return random_engine_; }
 
+/**
+ * @brief Key, IV and shuffle seed of this job, derived from the password on
+ *        the first call
+ */
 std::shared_ptr<const Security::DerivedState> Security::derived_state() {
-  std::lock_guard<std::mutex> cache_lock(derived_state_mutex);
-  const auto found = derived_state_cache.find(key_file);
-  if (found != derived_state_cache.end()) {
-    return found->second;
-  }
+  std::call_once(derived_once_, [this]() {
+    const std::string pass = key.empty() ? file_to_string(key_file) : key;
+    if (!keys) {
+      derived_ = derive(pass);
+      return;
+    }
 
-  auto state = std::make_shared<DerivedState>();
-  const std::string pass = file_to_string(key_file);
+    std::lock_guard<std::mutex> lock(keys->mutex_);
+    if (keys->states_.size() >= KeyCache::MAX_KEYS && !keys->states_.contains(pass)) {
+      keys->states_.clear();
+    }
+    auto& state = keys->states_[pass];
+    if (!state) {
+      state = derive(pass);
+    }
+    derived_ = state;
+  });
+  return derived_;
+}
 
-  std::lock_guard<std::mutex> random_lock(mutxSec);
+/**
+ * @brief Derive the key, IV and shuffle seed of a password
+ * @param pass Password
+ * @return Derived state
+ */
+std::shared_ptr<const Security::DerivedState> Security::derive(const std::string& pass) {
+  auto state = std::make_shared<DerivedState>();
   build_key(state->key.data(), pass);
   build_iv(state->iv.data(), pass);
   state->shuffle_seed = build_shuff_seed(pass);
-
-  return derived_state_cache.emplace(key_file, state).first->second;
+  return state;
 }
 
 /**
@@ -273,8 +639,22 @@ std::shared_ptr<const std::vector<u64>> Security::unshuffle_positions(u64 size)
   std::iota(positions->begin(), positions->end(), 0);
   std::shuffle(positions->begin(), positions->end(), rng_t(derived_state()->shuffle_seed));
 
+  // Past its capacity, the cache starts over; positions larger than it are not kept
+  const u64 bytes = size * sizeof(u64);
+  const u64 capacity = memory().unshuffle_cache;
   std::lock_guard<std::mutex> cache_lock(unshuffle_cache_mutex);
-  return unshuffle_cache.emplace(size, positions).first->second;
+  if (bytes > capacity) {
+    return positions;
+  }
+  if (unshuffle_cache_bytes + bytes > capacity) {
+    unshuffle_cache.clear();
+    unshuffle_cache_bytes = 0;
+  }
+  const auto [cached, added] = unshuffle_cache.emplace(size, positions);
+  if (added) {
+    unshuffle_cache_bytes += bytes;
+  }
+  return cached->second;
 }
 
 /**
@@ -282,7 +662,11 @@ std::shared_ptr<const std::vector<u64>> Security::unshuffle_positions(u64 size)
  * @param[in,out] str String to be shuffled
  */
 void Security::shuffle(std::string& str) {
+  const auto start = stats ? now() : Stats::time_point{};
   std::shuffle(str.begin(), str.end(), rng_t(derived_state()->shuffle_seed));
+  if (stats) {
+    stats->busy(Stage::shuffle, start, str.size());
+  }
 }
 
 /**
@@ -291,6 +675,7 @@ void Security::shuffle(std::string& str) {
  * @param size Size of shuffled string
  */
 void Security::unshuffle(std::string::iterator& i, u64 size) {
+  const auto start = stats ? now() : Stats::time_point{};
   std::string shuffledStr;  // Copy of shuffled std::string
   shuffledStr.reserve(size);
   for (u64 j = 0; j != size; ++j, ++i) {
@@ -305,6 +690,9 @@ void Security::unshuffle(std::string::iterator& i, u64 size) {
   for (const u64& vI : *positions) {
     *(i + vI) = *shIt++;  // *shIt, then ++shIt
   }
+  if (stats) {
+    stats->busy(Stage::unshuffle, start, size);
+  }
 }
 
 /**
@@ -12,57 +12,163 @@
 #include <array>
 #include <cstddef>
 #include <functional>
+#include <istream>
 #include <memory>
 #include <mutex>
+#include <random>
+#include <string>
 #include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "def.hpp"
+#include "external_sort.hpp"
+#include "input_source.hpp"
+#include "ordered_pipeline.hpp"
+#include "output_file.hpp"
 
 namespace cryfa {
 /**
  * @brief Security
  */
 class Security : public Param {
+  friend class KeyCache;
+
+ private:
+  static constexpr size_t AES_KEY_SIZE = 16;
+  static constexpr size_t AES_IV_SIZE = 16;
+
+  struct DerivedState {
+    std::array<byte, AES_KEY_SIZE> key{};
+    std::array<byte, AES_IV_SIZE> iv{};
+    u64 shuffle_seed = 0;
+  };
+
  public:
+  /**
+   * @brief Member of an archive, and where its records are
+   */
+  struct ArchiveMember {
+    std::string name;
+    u64 offset = 0;
+    u64 size = 0;
+  };
+
   Security() = default;
-  void decrypt();
+  explicit Security(const Param& par) : Param(par) {}
   auto peek_decrypted_type() -> char;
+  auto is_archive() const -> bool;
+  auto read_archive_directory() -> std::vector<ArchiveMember>;
+  void begin_archive(OutputFile&);
+  void write_archive_directory(OutputFile&, const std::vector<ArchiveMember>&);
+  void set_archive_member(u64, OutputFile&);
+  void set_archive_member(u64, const ArchiveMember&);
+  void set_streams(std::shared_ptr<InputSource>, OutputFile::Sink);
 
  protected:
   using PlaintextSink = std::function<void(std::string_view)>;
-  using PlaintextProducer = std::function<void(const PlaintextSink&)>;
+
+  /**
+   * @brief Encrypted output as a sequence of records. Each record is sealed
+   *        on its own, with a nonce derived from its index, so the size of
+   *        the whole stream is not bound by the GCM message length limit
+   */
+  class RecordSink {
+   public:
+    void emit(std::string_view plaintext);
+
+    /**
+     * @brief Run an ordered pipeline whose workers seal the packed chunks.
+     *        Given a sizer, the time to pack and seal each chunk is counted to it
+     */
+    template <typename Chunk, typename ReadChunk, typename PackChunk>
+    void run_pipeline(size_t workers, ReadChunk&& read_chunk, PackChunk&& pack_chunk,
+                      ChunkSizer* sizer = nullptr) {
+      const u64 first = next_index_;
+      run_ordered_pipeline<Chunk>(
+          workers, read_chunk,
+          [&](Chunk chunk, u64 index) {
+            const std::string packed = pack_chunk(std::move(chunk));
+            const auto start = stats_ ? now() : Stats::time_point{};
+            std::string record = seal_record(*state_, member_, first + index, packed, false);
+            if (stats_) {
+              stats_->busy(Stage::seal, start, packed.size(), index);
+            }
+            return record;
+          },
+          [&](std::string record) {
+            out_.write(std::move(record));
+            ++next_index_;
+          },
+          pool_, {stats_}, budget_, sizer);
+    }
+
+   private:
+    friend class Security;
+    RecordSink(std::shared_ptr<const DerivedState> state, u64 member, OutputFile& out,
+               ThreadPool* pool, Stats* stats, const MemoryBudget& budget)
+        : state_(std::move(state)),
+          member_(member),
+          out_(out),
+          pool_(pool),
+          stats_(stats),
+          budget_(budget) {}
+
+    std::shared_ptr<const DerivedState> state_;
+    u64 member_;
+    OutputFile& out_;
+    ThreadPool* pool_;
+    Stats* stats_;
+    MemoryBudget budget_;
+    u64 next_index_ = 0;
+  };
+  using RecordProducer = std::function<void(RecordSink&)>;
 
   bool shuffInProg = true; /**< @brief Shuffle in progress @hideinitializer */
   bool shuffled = true;    /**< @hideinitializer */
+  std::mutex mutxShuff;    /**< @brief Guards shuffInProg and shuffle_timer */
+  /** @brief Output instead of out_file, if set */
+  OutputFile::Sink out_sink;
 
-  void encrypt();
-  void encrypt_stream(const PlaintextProducer&);
+  auto memory() const -> MemoryBudget { return MemoryBudget::of(max_memory, n_threads); }
+  auto chunk_sizer() const -> ChunkSizer {
+    return ChunkSizer(MIN_CHUNK_SIZE, memory().max_chunk_size, n_threads);
+  }
+  static auto spill_cipher() -> SpillCipher;
+  void encrypt_stream(const RecordProducer&);
   void decrypt_stream(const PlaintextSink&);
   void shuffle(std::string&);
   void unshuffle(std::string::iterator&, u64);
+  auto open_in(const std::string&, bool = true) const -> std::unique_ptr<std::istream>;
+  auto progress() const -> std::ostream&;
 
  private:
-  static constexpr size_t AES_KEY_SIZE = 16;
-  static constexpr size_t AES_IV_SIZE = 16;
+  u64 member_ = 0;                   // Archive member, or 0 for a stand-alone file
+  OutputFile* archive_out_ = nullptr;  // Archive being written
+  u64 range_offset_ = 0;             // Records of the archive member being read
+  u64 range_size_ = 0;
+  std::shared_ptr<InputSource> in_source_;  // Input instead of in_file, if set
 
-  struct DerivedState {
-    std::array<byte, AES_KEY_SIZE> key{};
-    std::array<byte, AES_IV_SIZE> iv{};
-    u64 shuffle_seed = 0;
-  };
+  static auto seal_record(const DerivedState&, u64, u64, std::string_view, bool) -> std::string;
+  static auto open_record(const DerivedState&, u64, u64, std::string_view, bool) -> std::string;
+  void decrypt_legacy(std::istream&, const DerivedState&, const PlaintextSink&);
+  void decrypt_records(std::istream&, u64, u64, const DerivedState&, const PlaintextSink&);
+  auto encrypted_size() const -> u64;
 
-  static std::mutex derived_state_mutex;
-  static std::unordered_map<std::string, std::shared_ptr<const DerivedState>> derived_state_cache;
+  std::once_flag derived_once_;  // Key, IV and shuffle seed, derived once per job
+  std::shared_ptr<const DerivedState> derived_;
+  std::minstd_rand0 random_engine_;  // Emulated C rand() of the derivation
 
   std::mutex unshuffle_cache_mutex;
   std::unordered_map<u64, std::shared_ptr<const std::vector<u64>>> unshuffle_cache;
+  u64 unshuffle_cache_bytes = 0;  // Of the positions cached
 
   void srandom(u32);
   auto random() -> int;
   auto random_engine() -> std::minstd_rand0&;
   auto derived_state() -> std::shared_ptr<const DerivedState>;
+  auto derive(const std::string&) -> std::shared_ptr<const DerivedState>;
   auto build_shuff_seed(const std::string&) -> u64;
   auto unshuffle_positions(u64) -> std::shared_ptr<const std::vector<u64>>;
   void build_iv(byte*, const std::string&);
@@ -73,6 +179,19 @@ class Security : public Param {
   void print_key(byte*) const;
 #endif
 };
+
+/**
+ * @brief Key, IV and shuffle seed of the passwords seen, derived once and
+ *        shared by the jobs given the cache
+ */
+class KeyCache {
+ private:
+  friend class Security;
+  static constexpr size_t MAX_KEYS = 256;  // Forgets all past it
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<const Security::DerivedState>> states_;
+};
 }  // namespace cryfa
 
 #endif  // CRYFA_SECURITY_H
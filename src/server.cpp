@@ -0,0 +1,300 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file server.cpp
+ * @brief Daemon mode
+ *
+ * A job is one connection. The client sends a request line,
+ *   encrypt KEY_FILE [NAME=VALUE]...   or   decrypt KEY_FILE [NAME=VALUE]...
+ * with the options of the library by name, then the input, and shuts its
+ * side down for writing. The server sends the output as frames of an 8-byte
+ * little-endian size and the data, an empty frame, then the status: nothing
+ * if the job succeeded, or the error message.
+ */
+
+#include "server.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <format>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "assert.hpp"
+#include "string.hpp"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#endif
+
+namespace cryfa {
+
+#ifndef _WIN32
+/**
+ * @brief Connection of a client
+ */
+class Server::Connection {
+ public:
+  explicit Connection(int fd) : fd_(fd) {}
+  Connection(const Connection&) = delete;
+  auto operator=(const Connection&) -> Connection& = delete;
+  ~Connection() { ::close(fd_); }
+
+  /**
+   * @brief Read the input
+   * @return Number of bytes read, 0 at the end of the input
+   */
+  auto read(char* data, size_t size) -> size_t {
+    if (begin_ != buffer_.size()) {  // Read past the request line
+      const size_t n = std::min(size, buffer_.size() - begin_);
+      std::memcpy(data, buffer_.data() + begin_, n);
+      begin_ += n;
+      return n;
+    }
+    while (true) {
+      const ssize_t n = ::recv(fd_, data, size, 0);
+      if (n >= 0) {
+        return static_cast<size_t>(n);
+      }
+      assert_single(errno != EINTR, "failed reading from the client.");
+    }
+  }
+
+  auto read_line() -> std::string {
+    while (true) {
+      const size_t end = buffer_.find('\n');
+      if (end != std::string::npos) {
+        begin_ = end + 1;
+        return buffer_.substr(0, end);
+      }
+      assert_single(buffer_.size() > MAX_REQUEST_SIZE, "the request line is too long.");
+      char data[MAX_REQUEST_SIZE];
+      const size_t n = read(data, sizeof(data));
+      assert_single(n == 0, "no request has been sent.");
+      buffer_.append(data, n);
+      begin_ = buffer_.size();
+    }
+  }
+
+  void write(std::string_view data) {
+    while (!data.empty()) {
+      const ssize_t n = ::send(fd_, data.data(), data.size(), 0);
+      if (n < 0) {
+        assert_single(errno != EINTR, "failed writing to the client.");
+        continue;
+      }
+      data.remove_prefix(static_cast<size_t>(n));
+    }
+  }
+
+  void write_frame(std::string_view data) {
+    char size[8];
+    for (int i = 0; i != 8; ++i) {
+      size[i] = static_cast<char>((static_cast<u64>(data.size()) >> (8 * i)) & 0xFF);
+    }
+    write(std::string_view(size, sizeof(size)));
+    write(data);
+  }
+
+ private:
+  static constexpr size_t MAX_REQUEST_SIZE = 4096;
+
+  int fd_;
+  std::string buffer_;  // Request line, and the input read past it
+  size_t begin_ = 0;    // Next byte of the buffer to read
+};
+
+/**
+ * @brief Bytes of input the encryption jobs keep in memory, together, within
+ *        a limit
+ */
+class Server::InputAllowance {
+ public:
+  explicit InputAllowance(u64 limit) : limit_(limit) {}
+
+  /**
+   * @brief Take bytes for a job; fail if the jobs would keep more than the
+   *        limit
+   */
+  void take(u64 n) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    assert_single(limit_ != 0 && n > limit_ - held_,
+                  std::format("the jobs of the daemon keep {} bytes of input at most, together "
+                              "(\"--max-total-input\"); try again later.",
+                              limit_));
+    held_ += n;
+  }
+
+  void give_back(u64 n) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    held_ -= n;
+  }
+
+ private:
+  std::mutex mutex_;
+  u64 limit_;
+  u64 held_ = 0;
+};
+
+/**
+ * @brief Run the job of a connection
+ * @param conn Connection
+ * @param pool Worker threads, keys and references shared by the jobs
+ * @param allowance Input kept by the encryption jobs
+ */
+void Server::serve(Connection& conn, Pool& pool, InputAllowance& allowance) const {
+  std::string status;
+  u64 taken = 0;  // Of the allowance
+  try {
+    std::vector<std::string> words;
+    std::istringstream line(conn.read_line());
+    for (std::string word; line >> word;) {
+      words.push_back(word);
+    }
+    assert_single(words.size() < 2 || (words[0] != "encrypt" && words[0] != "decrypt"),
+                  "the request must be \"encrypt|decrypt KEY_FILE [NAME=VALUE]...\".");
+
+    Options options;
+    options.n_threads = par.n_threads;
+    options.pool = &pool;
+    assert_file_good(words[1], std::format("failed opening the password file \"{}\".", words[1]));
+    options.key = file_to_string(words[1]);
+    for (auto word = words.begin() + 2; word != words.end(); ++word) {
+      const size_t eq = word->find('=');
+      assert_single(eq == std::string::npos,
+                    std::format("\"{}\" is not of the form NAME=VALUE.", *word));
+      set_option(options, std::string_view(*word).substr(0, eq),
+                 std::string_view(*word).substr(eq + 1));
+    }
+    if (par.max_input != 0 && (options.max_input == 0 || options.max_input > par.max_input)) {
+      options.max_input = par.max_input;  // A job may only lower the daemon's limit
+    }
+
+    // An encryption job keeps its input; a decryption job streams it
+    const bool keeps = words[0] == "encrypt";
+    auto pull = [&](std::span<char> buffer) {
+      const size_t n = conn.read(buffer.data(), buffer.size());
+      if (keeps) {
+        allowance.take(n);
+        taken += n;
+      }
+      return n;
+    };
+    auto sink = [&](std::span<const char> data) {
+      conn.write_frame(std::string_view(data.data(), data.size()));
+    };
+    if (keeps) {
+      Encoder::encode(options, pull, sink);
+    } else {
+      Decoder::decode(options, pull, sink);
+    }
+  } catch (const std::exception& e) {
+    status = e.what();
+  }
+  allowance.give_back(taken);
+
+  try {
+    conn.write_frame({});
+    conn.write(status);
+  } catch (const std::exception&) {  // The client is gone
+  }
+}
+#endif
+
+/**
+ * @brief Accept jobs on the socket, until it fails. Failures of the moment,
+ *        e.g., running out of descriptors, are waited out
+ */
+void Server::run() {
+#ifdef _WIN32
+  error("\"--serve\" needs Unix domain sockets, which this system lacks.");
+#else
+  const std::string& path = par.in_file;
+  sockaddr_un addr{};
+  assert_single(path.size() >= sizeof(addr.sun_path),
+                std::format("the socket path \"{}\" is too long.", path));
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+  std::signal(SIGPIPE, SIG_IGN);  // Clients leaving fail the writes instead
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  assert_single(fd < 0, "failed creating a socket.");
+
+  // Replace the socket of an earlier run; only the user can connect
+  struct stat st{};
+  if (::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    ::unlink(path.c_str());
+  }
+  const mode_t mask = ::umask(0077);
+  const bool bound = ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+  ::umask(mask);
+  assert_single(!bound || ::listen(fd, SOMAXCONN) != 0,
+                std::format("failed listening on \"{}\".", path));
+
+  Pool pool(par.n_threads);
+  InputAllowance allowance(par.max_total_input);
+  std::cerr << bold("[+]") << " Serving on " << path << '\n';
+
+  std::mutex mutex;
+  std::condition_variable job_done;
+  size_t active = 0;
+  auto backoff = std::chrono::milliseconds(0);
+  while (true) {
+    const int client = ::accept(fd, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno == EBADF || errno == EINVAL || errno == ENOTSOCK || errno == EOPNOTSUPP ||
+          errno == EFAULT) {
+        break;  // The socket itself is broken
+      }
+
+      // Out of descriptors or memory for now, e.g., under load: wait, longer
+      // each time, up to a second
+      if (backoff.count() == 0) {
+        warning(std::format("failed accepting a connection: {}; retrying.", std::strerror(errno)));
+      }
+      backoff = std::clamp(2 * backoff, std::chrono::milliseconds(10),
+                           std::chrono::milliseconds(1000));
+      std::this_thread::sleep_for(backoff);
+      continue;
+    }
+    backoff = std::chrono::milliseconds(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    job_done.wait(lock, [&]() { return active < MAX_SERVE_JOBS; });
+    ++active;
+    lock.unlock();
+    std::thread([&, client]() {
+      {
+        Connection conn(client);
+        serve(conn, pool, allowance);
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      --active;
+      job_done.notify_all();
+    }).detach();
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  job_done.wait(lock, [&]() { return active == 0; });
+  ::close(fd);
+  error(std::format("failed accepting connections on \"{}\".", path));
+#endif
+}
+
+}  // namespace cryfa
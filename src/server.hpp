@@ -0,0 +1,36 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file server.hpp
+ * @brief Daemon mode
+ */
+
+#ifndef CRYFA_SERVER_H
+#define CRYFA_SERVER_H
+
+#include "cryfa/cryfa.hpp"
+#include "def.hpp"
+
+namespace cryfa {
+
+/**
+ * @brief Daemon running the jobs sent to a Unix domain socket, on one warm
+ *        pool of worker threads, with the keys of the passwords seen and the
+ *        references loaded cached
+ */
+class Server {
+  Param par;
+
+  class Connection;
+  class InputAllowance;
+  void serve(Connection&, Pool&, InputAllowance&) const;
+
+ public:
+  explicit Server(const Param& p) : par(p) {}
+  void run();
+};
+
+}  // namespace cryfa
+
+#endif  // CRYFA_SERVER_H
@@ -0,0 +1,227 @@
+/* SPDX-FileCopyrightText: 2026 Morteza Hosseini */
+/* SPDX-License-Identifier: GPL-3.0-only */
+
+/**
+ * @file library_c_test.c
+ * @brief Test of the C API of libcryfa: input pushed in small slices,
+ *        encoded and decoded, alone and on a pool, and the errors kept by
+ *        the handles. Compiled as C with the installed headers only, so that
+ *        cryfa.h stands alone
+ */
+
+#include <cryfa/cryfa.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      fprintf(stderr, "FAILED: %s, line %d\n", #cond, __LINE__);      \
+      ++failures;                                                     \
+    }                                                                 \
+  } while (0)
+
+struct buffer {
+  char* data;
+  size_t size;
+  size_t capacity;
+};
+
+static int append(void* user, const char* data, size_t size) {
+  struct buffer* b = (struct buffer*)user;
+  if (b->size + size > b->capacity) {
+    size_t capacity = 2 * (b->size + size);
+    char* grown = (char*)realloc(b->data, capacity);
+    if (!grown) {
+      return CRYFA_ERROR;
+    }
+    b->data = grown;
+    b->capacity = capacity;
+  }
+  memcpy(b->data + b->size, data, size);
+  b->size += size;
+  return CRYFA_OK;
+}
+
+static int refuse(void* user, const char* data, size_t size) {
+  (void)user;
+  (void)data;
+  (void)size;
+  return CRYFA_ERROR;
+}
+
+/* FASTQ of <reads> reads */
+static struct buffer fastq(size_t reads) {
+  struct buffer b = {NULL, 0, 0};
+  char record[256];
+  unsigned state = 7;
+  for (size_t i = 0; i != reads; ++i) {
+    int n = snprintf(record, sizeof record, "@read.%zu\n", i);
+    char* bases = record + n;
+    for (int j = 0; j != 100; ++j) {
+      state = state * 1103515245u + 12345u;
+      bases[j] = "ACGT"[(state >> 16) % 4];
+    }
+    memcpy(bases + 100, "\n+\n", 3);
+    char* scores = bases + 103;
+    for (int j = 0; j != 100; ++j) {
+      state = state * 1103515245u + 12345u;
+      scores[j] = (char)('!' + (state >> 16) % 41);
+    }
+    scores[100] = '\n';
+    append(&b, record, (size_t)(scores + 101 - record));
+  }
+  return b;
+}
+
+/* Push the input in slices of <slice>, then finish; CRYFA_ERROR at the
+   first failure, with its message in <error> */
+static int encode(const cryfa_options* options, const struct buffer* in, size_t slice,
+                  struct buffer* out, char* error, size_t error_size) {
+  cryfa_encoder* encoder = cryfa_encoder_new(options, append, out);
+  int rc = encoder ? CRYFA_OK : CRYFA_ERROR;
+  for (size_t i = 0; rc == CRYFA_OK && i < in->size; i += slice) {
+    rc = cryfa_encoder_push(encoder, in->data + i, in->size - i < slice ? in->size - i : slice);
+  }
+  if (rc == CRYFA_OK) {
+    rc = cryfa_encoder_finish(encoder);
+  }
+  if (rc != CRYFA_OK && error) {
+    const char* why = cryfa_encoder_error(encoder);
+    snprintf(error, error_size, "%s", why ? why : "");
+  }
+  cryfa_encoder_free(encoder);
+  return rc;
+}
+
+static int decode(const cryfa_options* options, const struct buffer* in, size_t slice,
+                  struct buffer* out) {
+  cryfa_decoder* decoder = cryfa_decoder_new(options, append, out);
+  int rc = decoder ? CRYFA_OK : CRYFA_ERROR;
+  for (size_t i = 0; rc == CRYFA_OK && i < in->size; i += slice) {
+    rc = cryfa_decoder_push(decoder, in->data + i, in->size - i < slice ? in->size - i : slice);
+  }
+  if (rc == CRYFA_OK) {
+    rc = cryfa_decoder_finish(decoder);
+  }
+  if (rc != CRYFA_OK) {
+    CHECK(cryfa_decoder_error(decoder) != NULL);
+    CHECK(cryfa_decoder_push(decoder, "x", 1) == CRYFA_ERROR); /* The error is kept */
+  } else {
+    CHECK(cryfa_decoder_error(decoder) == NULL);
+  }
+  cryfa_decoder_free(decoder);
+  return rc;
+}
+
+static int same(const struct buffer* a, const struct buffer* b) {
+  return a->size == b->size && memcmp(a->data, b->data, a->size) == 0;
+}
+
+static void test_roundtrip(const cryfa_options* options, const struct buffer* input) {
+  struct buffer encrypted = {NULL, 0, 0};
+  struct buffer decrypted = {NULL, 0, 0};
+  CHECK(encode(options, input, 3, &encrypted, NULL, 0) == CRYFA_OK);
+  CHECK(decode(options, &encrypted, 11, &decrypted) == CRYFA_OK);
+  CHECK(same(input, &decrypted));
+  free(encrypted.data);
+  free(decrypted.data);
+}
+
+static void test_errors(const cryfa_options* options, const struct buffer* input) {
+  static const char key[] = "Such a strong password!";
+  static const char other_key[] = "Another strong password";
+  char error[512];
+  struct buffer encrypted = {NULL, 0, 0};
+  struct buffer out = {NULL, 0, 0};
+  CHECK(encode(options, input, 4096, &encrypted, NULL, 0) == CRYFA_OK);
+
+  /* Another key, a changed byte, and a truncated input */
+  cryfa_options* other = cryfa_options_new();
+  cryfa_options_set_key(other, other_key, strlen(other_key));
+  CHECK(decode(other, &encrypted, 4096, &out) == CRYFA_ERROR);
+  encrypted.data[encrypted.size / 2] ^= 1;
+  CHECK(decode(options, &encrypted, 4096, &out) == CRYFA_ERROR);
+  encrypted.data[encrypted.size / 2] ^= 1;
+  struct buffer truncated = encrypted;
+  truncated.size -= 1;
+  CHECK(decode(options, &truncated, 4096, &out) == CRYFA_ERROR);
+
+  /* A short key, unknown options, and a limit on the input */
+  cryfa_options_set_key(other, "short", 5);
+  CHECK(encode(other, input, 4096, &out, error, sizeof error) == CRYFA_ERROR);
+  CHECK(strstr(error, "password") != NULL);
+  CHECK(cryfa_options_set(other, "nonsense", "1") == CRYFA_ERROR);
+  CHECK(cryfa_options_set(other, "max_memory", "lots") == CRYFA_ERROR);
+  cryfa_options_set_key(other, key, strlen(key));
+  CHECK(cryfa_options_set(other, "max_input", "1K") == CRYFA_OK);
+  CHECK(encode(other, input, 600, &out, error, sizeof error) == CRYFA_ERROR);
+  CHECK(strstr(error, "max_input") != NULL);
+
+  /* A sink refusing the output stops the job */
+  cryfa_encoder* encoder = cryfa_encoder_new(options, refuse, NULL);
+  CHECK(cryfa_encoder_push(encoder, input->data, input->size) == CRYFA_OK);
+  CHECK(cryfa_encoder_finish(encoder) == CRYFA_ERROR);
+  CHECK(cryfa_encoder_error(encoder) != NULL && strstr(cryfa_encoder_error(encoder), "sink"));
+  CHECK(cryfa_encoder_finish(encoder) == CRYFA_ERROR);
+  cryfa_encoder_free(encoder);
+
+  /* No options or sink, and no handle */
+  encoder = cryfa_encoder_new(NULL, append, &out);
+  CHECK(cryfa_encoder_push(encoder, "x", 1) == CRYFA_ERROR);
+  CHECK(cryfa_encoder_error(encoder) != NULL);
+  cryfa_encoder_free(encoder);
+  cryfa_decoder* decoder = cryfa_decoder_new(options, NULL, NULL);
+  CHECK(cryfa_decoder_finish(decoder) == CRYFA_ERROR);
+  cryfa_decoder_free(decoder);
+  CHECK(cryfa_encoder_push(NULL, "x", 1) == CRYFA_ERROR);
+  CHECK(cryfa_decoder_finish(NULL) == CRYFA_ERROR);
+  CHECK(cryfa_encoder_error(NULL) == NULL);
+  CHECK(cryfa_options_set_key(NULL, key, strlen(key)) == CRYFA_ERROR);
+
+  cryfa_options_free(other);
+  free(encrypted.data);
+  free(out.data);
+}
+
+int main(void) {
+  static const char key[] = "Such a strong password!";
+  struct buffer input = fastq(2000);
+  static const char text[] = "##fileformat=VCFv4.2\nchr1\t12345\t.\tA\tG\t50\tPASS\tDP=14\n";
+  struct buffer other = {NULL, 0, 0};
+  for (int i = 0; i != 500; ++i) {
+    append(&other, text, sizeof text - 1);
+  }
+
+  cryfa_options* options = cryfa_options_new();
+  CHECK(options != NULL);
+  CHECK(cryfa_options_set_key(options, key, strlen(key)) == CRYFA_OK);
+  CHECK(cryfa_options_set(options, "threads", "4") == CRYFA_OK);
+  test_roundtrip(options, &input);
+  test_roundtrip(options, &other);
+
+  cryfa_pool* pool = cryfa_pool_new(4);
+  CHECK(pool != NULL);
+  CHECK(cryfa_options_set_pool(options, pool) == CRYFA_OK);
+  test_roundtrip(options, &input);
+  CHECK(cryfa_options_set(options, "format", "n") == CRYFA_OK);
+  test_roundtrip(options, &input);
+  CHECK(cryfa_options_set(options, "format", "Q") == CRYFA_OK);
+  test_errors(options, &input);
+
+  cryfa_options_free(options);
+  cryfa_pool_free(pool);
+  free(input.data);
+  free(other.data);
+
+  if (failures != 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("C library test passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,302 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file library_test.cpp
+ * @brief Test of the C++ API of libcryfa: FASTQ, FASTA and other input,
+ *        encoded and decoded whole, in small slices and pulled, alone and
+ *        on a pool, and the errors. Built with the installed headers only,
+ *        so that they stand alone
+ */
+
+#include <cryfa/cryfa.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+  if (!ok) {
+    std::cerr << "FAILED: " << what << '\n';
+    ++failures;
+  }
+}
+
+template <typename Call>
+void check_throws(Call&& call, const std::string& what) {
+  try {
+    call();
+  } catch (const std::exception&) {
+    return;
+  }
+  check(false, what + " did not throw");
+}
+
+auto random_bases(std::mt19937& rng, size_t n) -> std::string {
+  std::string bases(n, 'A');
+  for (char& c : bases) {
+    c = "ACGT"[rng() % 4];
+  }
+  return bases;
+}
+
+auto fastq(size_t reads) -> std::string {
+  std::mt19937 rng(7);
+  std::string text;
+  for (size_t i = 0; i != reads; ++i) {
+    std::string scores(100, 'I');
+    for (char& c : scores) {
+      c = static_cast<char>('!' + rng() % 41);
+    }
+    text += "@read." + std::to_string(i) + " length=100\n" + random_bases(rng, 100) + "\n+\n" +
+            scores + "\n";
+  }
+  return text;
+}
+
+auto fasta(size_t sequences) -> std::string {
+  std::mt19937 rng(11);
+  std::string text;
+  for (size_t i = 0; i != sequences; ++i) {
+    text += ">seq" + std::to_string(i) + " random sequence\n";
+    for (size_t line = 0; line != 40; ++line) {
+      text += random_bases(rng, 60) + "\n";
+    }
+  }
+  return text;
+}
+
+auto vcf(size_t records) -> std::string {
+  std::string text = "##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n";
+  for (size_t i = 0; i != records; ++i) {
+    text += "chr1\t" + std::to_string(1000 + 17 * i) + "\t.\tA\tG\t50\tPASS\tDP=" +
+            std::to_string(i % 90) + "\n";
+  }
+  return text;
+}
+
+// Appends the output to a string
+auto sink_to(std::string& out) -> cryfa::Sink {
+  return [&out](std::span<const char> data) { out.append(data.data(), data.size()); };
+}
+
+auto encode(const cryfa::Options& options, const std::string& input) -> std::string {
+  std::string out;
+  cryfa::Encoder::encode(options, input, sink_to(out));
+  return out;
+}
+
+auto encode_slices(const cryfa::Options& options, const std::string& input, size_t slice)
+    -> std::string {
+  std::string out;
+  cryfa::Encoder encoder(options, sink_to(out));
+  for (size_t i = 0; i < input.size(); i += slice) {
+    encoder.write(std::span<const char>(input).subspan(i, std::min(slice, input.size() - i)));
+  }
+  encoder.finish();
+  return out;
+}
+
+auto encode_pulled(const cryfa::Options& options, const std::string& input, size_t slice)
+    -> std::string {
+  std::string out;
+  size_t pos = 0;
+  cryfa::Encoder::encode(
+      options,
+      [&](std::span<char> buffer) {
+        const size_t n = std::min({slice, buffer.size(), input.size() - pos});
+        input.copy(buffer.data(), n, pos);
+        pos += n;
+        return n;
+      },
+      sink_to(out));
+  return out;
+}
+
+auto decode(const cryfa::Options& options, const std::string& input) -> std::string {
+  std::string out;
+  cryfa::Decoder::decode(options, input, sink_to(out));
+  return out;
+}
+
+auto decode_slices(const cryfa::Options& options, const std::string& input, size_t slice)
+    -> std::string {
+  std::string out;
+  cryfa::Decoder decoder(options, sink_to(out));
+  for (size_t i = 0; i < input.size(); i += slice) {
+    decoder.write(std::span<const char>(input).subspan(i, std::min(slice, input.size() - i)));
+  }
+  decoder.finish();
+  return out;
+}
+
+auto decode_pulled(const cryfa::Options& options, const std::string& input, size_t slice)
+    -> std::string {
+  std::string out;
+  size_t pos = 0;
+  cryfa::Decoder::decode(
+      options,
+      [&](std::span<char> buffer) {
+        const size_t n = std::min({slice, buffer.size(), input.size() - pos});
+        input.copy(buffer.data(), n, pos);
+        pos += n;
+        return n;
+      },
+      sink_to(out));
+  return out;
+}
+
+void test_roundtrips(const cryfa::Options& options, const std::string& name,
+                     const std::string& input) {
+  const std::string encrypted = encode(options, input);
+  check(encrypted.size() > 0 && encrypted.find(input.substr(0, 64)) == std::string::npos,
+        name + ": encrypted");
+  check(decode(options, encrypted) == input, name + ": whole");
+  check(decode_slices(options, encode_slices(options, input, 7), 5) == input,
+        name + ": written in slices");
+  check(decode_pulled(options, encode_pulled(options, input, 4093), 13) == input,
+        name + ": pulled");
+}
+
+// Sizes of the plaintext of the records of an encrypted input: an 8-byte
+// mark, then of each, its 8-byte size, ciphertext and 12-byte tag
+auto record_sizes(const std::string& encrypted) -> std::vector<unsigned long long> {
+  std::vector<unsigned long long> sizes;
+  for (size_t at = 8; at + 8 <= encrypted.size();) {
+    unsigned long long size = 0;
+    for (size_t i = 8; i--;) {
+      size = size << 8 | static_cast<unsigned char>(encrypted[at + i]);
+    }
+    sizes.push_back(size);
+    at += 8 + size + 12;
+  }
+  return sizes;
+}
+
+void test_long_sequence(const cryfa::Options& options) {
+  std::mt19937 rng(13);
+  std::string text = ">chr1 one long sequence\n";
+  for (size_t line = 0; line != 100000; ++line) {
+    text += random_bases(rng, 70) + "\n";
+  }
+  text += ">chr2\nACGT\n";
+
+  const std::string encrypted = encode(options, text);
+  const auto sizes = record_sizes(encrypted);
+  check(sizes.size() > 4 && *std::max_element(sizes.begin(), sizes.end()) < (2u << 20),
+        "a long FASTA sequence cut across records");
+  check(decode(options, encrypted) == text, "a long FASTA sequence");
+}
+
+void test_errors(const cryfa::Options& options, const std::string& input) {
+  const std::string encrypted = encode(options, input);
+
+  cryfa::Options other = options;
+  other.key = "Another strong password";
+  check_throws([&]() { decode(other, encrypted); }, "decoding with another key");
+
+  std::string flipped = encrypted;
+  flipped[flipped.size() / 2] ^= 1;
+  check_throws([&]() { decode(options, flipped); }, "decoding a changed byte");
+  check_throws([&]() { decode(options, encrypted.substr(0, encrypted.size() - 1)); },
+               "decoding a truncated input");
+  check_throws([&]() { decode_slices(options, encrypted.substr(0, 100), 9); },
+               "decoding a truncated input in slices");
+
+  // The size of the first record forged, past any record and wrapping
+  // around with its tag, on a stream of unknown length
+  for (const unsigned long long size : {1ULL << 40, ~0ULL - 4}) {
+    std::string forged = encrypted;
+    for (size_t i = 0; i != 8; ++i) {
+      forged[8 + i] = static_cast<char>(size >> (8 * i));
+    }
+    check_throws([&]() { decode_pulled(options, forged, 4096); },
+                 "decoding a forged record size, " + std::to_string(size));
+  }
+
+  cryfa::Options short_key = options;
+  short_key.key = "short";
+  check_throws([&]() { encode(short_key, input); }, "a short key");
+  cryfa::Options options_set = options;
+  check_throws([&]() { cryfa::set_option(options_set, "nonsense", "1"); }, "an unknown option");
+  cryfa::set_option(options_set, "reorder", "shuffle");
+  check_throws([&]() { encode(options_set, input); }, "an unknown reordering mode");
+
+  std::string out;
+  cryfa::Encoder encoder(options, sink_to(out));
+  encoder.write(input);
+  encoder.finish();
+  check_throws([&]() { encoder.write(input); }, "writing after finish()");
+
+  const std::string small = vcf(20);
+  cryfa::Options capped = options;
+  cryfa::set_option(capped, "max_input", std::to_string(small.size()));
+  check_throws([&]() { encode_slices(capped, small + "\n", 100); }, "writing past max_input");
+  check_throws([&]() { encode_pulled(capped, small + "\n", 100); }, "pulling past max_input");
+  check(decode(options, encode_slices(capped, small, 100)) == small, "writing up to max_input");
+
+  check_throws(
+      [&]() {
+        cryfa::Encoder::encode(options, input,
+                               [](std::span<const char>) { throw std::runtime_error("full"); });
+      },
+      "a failing sink");
+}
+}  // namespace
+
+int main() {
+  try {
+    cryfa::Options options;
+    options.key = "Such a strong password!";
+    options.n_threads = 4;
+
+    const std::vector<std::pair<std::string, std::string>> inputs = {
+        {"FASTQ", fastq(3000)}, {"FASTA", fasta(40)}, {"other", vcf(5000)}};
+    for (const auto& [name, input] : inputs) {
+      test_roundtrips(options, name, input);
+    }
+
+    cryfa::Options forced = options;
+    cryfa::set_option(forced, "format", "n");
+    cryfa::set_option(forced, "shuffle", "0");
+    test_roundtrips(forced, "FASTQ as other data", inputs[0].second);
+
+    test_long_sequence(options);
+
+    cryfa::Options binned = options;
+    cryfa::set_option(binned, "qbin", "illumina8");
+    const std::string reads = inputs[0].second;
+    const std::string decoded = decode(binned, encode(binned, reads));
+    check(decoded.size() == reads.size() && decoded != reads, "FASTQ with binned quality scores");
+
+    cryfa::Pool pool(4);
+    cryfa::Options pooled = options;
+    pooled.pool = &pool;
+    for (const auto& [name, input] : inputs) {
+      test_roundtrips(pooled, name + " on a pool", input);
+    }
+
+    test_errors(options, inputs[0].second);
+    test_errors(pooled, inputs[2].second);
+  } catch (const std::exception& e) {
+    std::cerr << "FAILED: " << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  if (failures != 0) {
+    std::cerr << failures << " checks failed\n";
+    return EXIT_FAILURE;
+  }
+  std::cout << "library test passed\n";
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,204 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file serve_test.cpp
+ * @brief Test of the daemon: starts "cryfa --serve" on a socket in the
+ *        temporary directory, then sends it jobs, as a client would. FASTQ
+ *        encrypted and decrypted again, and failed jobs: a bad request, input
+ *        past the limit and a changed byte, each reported in the status while
+ *        the daemon keeps serving
+ *
+ * serve_test CRYFA PASS_FILE
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+namespace {
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+  if (!ok) {
+    std::cerr << "FAILED: " << what << '\n';
+    ++failures;
+  }
+}
+
+auto fastq(size_t reads) -> std::string {
+  std::mt19937 rng(7);
+  std::string text;
+  for (size_t i = 0; i != reads; ++i) {
+    std::string bases(100, 'A');
+    std::string scores(100, 'I');
+    for (size_t j = 0; j != 100; ++j) {
+      bases[j] = "ACGT"[rng() % 4];
+      scores[j] = static_cast<char>('!' + rng() % 41);
+    }
+    text += "@read." + std::to_string(i) + "\n" + bases + "\n+\n" + scores + "\n";
+  }
+  return text;
+}
+
+auto connect_to(const std::string& path) -> int {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+    return fd;
+  }
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  return -1;
+}
+
+auto read_exactly(int fd, char* data, size_t size) -> bool {
+  while (size != 0) {
+    const ssize_t n = ::recv(fd, data, size, 0);
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+struct Reply {
+  std::string output;
+  std::string status;  // Empty if the job succeeded
+};
+
+/**
+ * @brief Run a job: the request line and the input, then read the frames of
+ *        the output and the status
+ */
+auto job(const std::string& path, const std::string& request, const std::string& input)
+    -> Reply {
+  Reply reply;
+  const int fd = connect_to(path);
+  if (fd < 0) {
+    reply.status = "no connection";
+    return reply;
+  }
+  // Sent by another thread, as the daemon may answer before reading it all
+  std::thread sender([&]() {
+    const std::string sent = request + "\n" + input;
+    for (size_t at = 0; at < sent.size();) {
+      const ssize_t n = ::send(fd, sent.data() + at, sent.size() - at, MSG_NOSIGNAL);
+      if (n <= 0) {
+        break;
+      }
+      at += static_cast<size_t>(n);
+    }
+    ::shutdown(fd, SHUT_WR);
+  });
+
+  while (true) {
+    unsigned char head[8];
+    if (!read_exactly(fd, reinterpret_cast<char*>(head), sizeof(head))) {
+      reply.status = "connection cut";
+      break;
+    }
+    unsigned long long size = 0;
+    for (int i = 8; i--;) {
+      size = size << 8 | head[i];
+    }
+    if (size == 0) {
+      char data[4096];
+      for (ssize_t n; (n = ::recv(fd, data, sizeof(data), 0)) > 0;) {
+        reply.status.append(data, static_cast<size_t>(n));
+      }
+      break;
+    }
+    std::string frame(size, '\0');
+    if (!read_exactly(fd, frame.data(), frame.size())) {
+      reply.status = "connection cut";
+      break;
+    }
+    reply.output += frame;
+  }
+  sender.join();
+  ::close(fd);
+  return reply;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    std::cerr << "Usage: serve_test CRYFA PASS_FILE\n";
+    return EXIT_FAILURE;
+  }
+  const std::string cryfa = argv[1];
+  const std::string pass = argv[2];
+  const std::string socket = (std::filesystem::temp_directory_path() /
+                              ("cryfa-serve-test-" + std::to_string(::getpid()) + ".sock"))
+                                 .string();
+  std::filesystem::remove(socket);
+
+  const pid_t daemon = ::fork();
+  if (daemon == 0) {
+    ::execl(cryfa.c_str(), cryfa.c_str(), "--serve", socket.c_str(), "-t", "2", "--max-input",
+            "1M", static_cast<char*>(nullptr));
+    std::_Exit(127);
+  }
+  for (int i = 0; i != 100; ++i) {  // Up to 10 s to listen
+    if (const int fd = connect_to(socket); fd >= 0) {
+      ::close(fd);
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+
+  const std::string reads = fastq(2000);
+  const std::string encrypt = "encrypt " + pass;
+  const std::string decrypt = "decrypt " + pass;
+
+  const Reply encrypted = job(socket, encrypt, reads);
+  check(encrypted.status.empty(), "encrypting: " + encrypted.status);
+  const Reply decrypted = job(socket, decrypt, encrypted.output);
+  check(decrypted.status.empty(), "decrypting: " + decrypted.status);
+  check(decrypted.output == reads, "a round trip through the daemon");
+
+  const Reply unknown = job(socket, "compress " + pass, reads);
+  check(unknown.status.find("the request must be") != std::string::npos,
+        "an unknown request: " + unknown.status);
+  const Reply option = job(socket, encrypt + " nonsense=1", reads);
+  check(!option.status.empty(), "an unknown option");
+  const Reply big = job(socket, encrypt, reads + reads + reads + reads + reads);
+  check(big.status.find("max_input") != std::string::npos,
+        "input past --max-input: " + big.status);
+  std::string flipped = encrypted.output;
+  flipped[flipped.size() / 2] ^= 1;
+  const Reply changed = job(socket, decrypt, flipped);
+  check(!changed.status.empty() && changed.output != reads, "decrypting a changed byte");
+
+  // Still serving
+  const Reply again = job(socket, decrypt, encrypted.output);
+  check(again.status.empty() && again.output == reads, "a round trip after failed jobs");
+
+  ::kill(daemon, SIGTERM);
+  ::waitpid(daemon, nullptr, 0);
+  std::filesystem::remove(socket);
+
+  if (failures != 0) {
+    std::cerr << failures << " checks failed\n";
+    return EXIT_FAILURE;
+  }
+  std::cout << "serve test passed\n";
+  return EXIT_SUCCESS;
+}
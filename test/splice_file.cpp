@@ -0,0 +1,54 @@
+// SPDX-FileCopyrightText: 2026 Morteza Hosseini
+// SPDX-License-Identifier: GPL-3.0-only
+
+/**
+ * @file splice_file.cpp
+ * @brief Test helper: write byte ranges of a file, in the order given, to
+ *        another. The tests cut and reorder encrypted files with it, which
+ *        CMake scripts cannot, as the bytes hold NULs
+ *
+ * splice_file OUT_FILE IN_FILE [OFFSET SIZE]...
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+/**
+ * @brief Write the ranges
+ * @param argc Number of command line arguments
+ * @param argv Command line arguments
+ * @return SUCCESS or FAILURE
+ */
+int main(int argc, char* argv[]) {
+  if (argc < 3 || argc % 2 == 0) {
+    std::cerr << "Usage: splice_file OUT_FILE IN_FILE [OFFSET SIZE]...\n";
+    return EXIT_FAILURE;
+  }
+
+  std::ifstream in(argv[2], std::ios::binary);
+  if (!in) {
+    std::cerr << "Failed opening \"" << argv[2] << "\".\n";
+    return EXIT_FAILURE;
+  }
+  const std::string data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+
+  std::ofstream out(argv[1], std::ios::binary);
+  for (int i = 3; i < argc; i += 2) {
+    const auto offset = std::stoull(argv[i]);
+    const auto size = std::stoull(argv[i + 1]);
+    if (offset > data.size() || size > data.size() - offset) {
+      std::cerr << "The range " << offset << "+" << size << " is past the end of \"" << argv[2]
+                << "\".\n";
+      return EXIT_FAILURE;
+    }
+    out.write(data.data() + offset, static_cast<std::streamsize>(size));
+  }
+  if (!out.flush()) {
+    std::cerr << "Failed writing \"" << argv[1] << "\".\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}